@@ -5,8 +5,14 @@ int main(int argc, char** argv) {
 
   auto options = New<Config>(argc, argv);;
   auto devices = options->get<std::vector<size_t>>("devices");
+  UTIL_THROW_IF2(devices.size() > 1 && options->get<size_t>("optimizer-delay") > 1,
+                 "--optimizer-delay can only be used with a single device");
+  UTIL_THROW_IF2(devices.size() > 1 && options->get<bool>("fp16"),
+                 "--fp16 can only be used with a single device");
   
-  if(devices.size() > 1)
+  if(devices.size() > 1 && options->get<bool>("sync-sgd"))
+    WrapModelType<Train, SyncGraphGroup>(options)->run();
+  else if(devices.size() > 1)
     WrapModelType<Train, AsyncGraphGroup>(options)->run();
   else
     WrapModelType<Train, Singleton>(options)->run();
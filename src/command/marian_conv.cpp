@@ -0,0 +1,43 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "common/binary_model.h"
+#include "common/logging.h"
+#include "common/quantization.h"
+
+int main(int argc, char** argv) {
+  using namespace marian;
+
+  bool int8 = argc == 4 && std::string(argv[1]) == "--int8";
+  if(argc != 3 && !int8) {
+    std::cerr << "Usage: " << argv[0] << " [--int8] model.npz model.bin" << std::endl
+              << std::endl
+              << "Converts a model to the binary format that is memory-mapped "
+              << "when it is loaded." << std::endl
+              << std::endl
+              << "With --int8 the matrices of the model are quantized to int8 "
+              << "with one scale per column for CPU inference, the output is "
+              << "an .npz model if its name ends in .npz." << std::endl;
+    return 1;
+  }
+
+  if(!int8) {
+    BinaryModel::convert(argv[1], argv[2]);
+    return 0;
+  }
+
+  stderrLogger("info", "[%Y-%m-%d %T] %v");
+
+  std::string in = argv[2], out = argv[3];
+  if(out.size() > 4 && out.substr(out.size() - 4) == ".npz") {
+    quantization::quantizeModel(in, out);
+  }
+  else {
+    std::string temp = out + ".tmp.npz";
+    quantization::quantizeModel(in, temp);
+    BinaryModel::convert(temp, out);
+    std::remove(temp.c_str());
+  }
+  return 0;
+}
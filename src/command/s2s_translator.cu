@@ -1,18 +1,33 @@
 #include "marian.h"
 #include "translator/translator.h"
+#include "translator/server.h"
 #include "translator/beam_search.h"
+#include "translator/greedy_search.h"
 
-int main(int argc, char** argv) {
-  using namespace marian;
+using namespace marian;
+
+template <class Search>
+Ptr<ModelTask> createTask(Ptr<Config> options) {
+  if(options->has("server"))
+    return New<TranslationServer<Search>>(options);
+  else
+    return New<TranslateMultiGPU<Search>>(options);
+}
 
+int main(int argc, char** argv) {
   auto options = New<Config>(argc, argv, true, true);
-  
-  auto task = New<TranslateMultiGPU<BeamSearch>>(options);
-  
+
+  // a single best word per step needs no beam
+  Ptr<ModelTask> task;
+  if(options->get<size_t>("beam-size") == 1 && !options->get<bool>("n-best"))
+    task = createTask<GreedySearch>(options);
+  else
+    task = createTask<BeamSearch>(options);
+
   task->run();
-  
+
   //WrapModelType<TranslateMultiGPU, BeamSearch>(options)->run();
-  
+
   return 0;
 
 }
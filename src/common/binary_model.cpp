@@ -0,0 +1,201 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "3rd_party/cnpy/cnpy.h"
+#include "3rd_party/exception.h"
+#include "common/binary_model.h"
+
+namespace marian {
+
+namespace {
+
+const char MAGIC[8] = {'M', 'A', 'R', 'I', 'A', 'N', 'B', '1'};
+
+size_t aligned(size_t offset) {
+  size_t a = BinaryModel::ALIGNMENT;
+  return (offset + a - 1) / a * a;
+}
+
+template <typename T>
+void write(std::string& out, T value) {
+  out.append((const char*)&value, sizeof(T));
+}
+
+// bounds-checked reading of the header
+class Reader {
+  private:
+    const char* data_;
+    size_t size_;
+    size_t pos_{0};
+    const std::string& file_;
+
+  public:
+    Reader(const char* data, size_t size, const std::string& file)
+      : data_(data), size_(size), file_(file) {}
+
+    const char* take(size_t bytes) {
+      UTIL_THROW_IF2(bytes > size_ - pos_,
+                     "Binary model " << file_ << " is truncated");
+      const char* p = data_ + pos_;
+      pos_ += bytes;
+      return p;
+    }
+
+    template <typename T>
+    T read() {
+      T value;
+      std::memcpy(&value, take(sizeof(T)), sizeof(T));
+      return value;
+    }
+};
+
+}
+
+Shape BinaryModel::Item::shape() const {
+  Shape shape;
+  if(dims.size() == 2) {
+    shape.set(0, dims[0]);
+    shape.set(1, dims[1]);
+  }
+  else if(dims.size() == 1) {
+    shape.set(0, 1);
+    shape.set(1, dims[0]);
+  }
+  return shape;
+}
+
+BinaryModel::BinaryModel(const std::string& file) : file_(file) {
+  int fd = open(file.c_str(), O_RDONLY);
+  UTIL_THROW_IF2(fd == -1,
+                 "Cannot open " << file << ": " << std::strerror(errno));
+
+  struct stat st;
+  if(fstat(fd, &st) == 0 && st.st_size > 0) {
+    size_ = st.st_size;
+    mapping_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  int error = errno;
+  close(fd);
+
+  UTIL_THROW_IF2(!mapping_ || mapping_ == MAP_FAILED,
+                 "Cannot map " << file << ": " << std::strerror(error));
+
+  try {
+    readHeader();
+  }
+  catch(...) {
+    munmap(mapping_, size_);
+    throw;
+  }
+}
+
+void BinaryModel::readHeader() {
+  const char* base = (const char*)mapping_;
+  Reader header(base, size_, file_);
+  UTIL_THROW_IF2(std::memcmp(header.take(sizeof(MAGIC)), MAGIC, sizeof(MAGIC)),
+                 file_ << " is not a binary model");
+
+  uint64_t count = header.read<uint64_t>();
+  for(uint64_t i = 0; i < count; ++i) {
+    Item item;
+    uint32_t nameLength = header.read<uint32_t>();
+    item.name.assign(header.take(nameLength), nameLength);
+    item.wordSize = header.read<uint32_t>();
+
+    uint32_t ndims = header.read<uint32_t>();
+    for(uint32_t d = 0; d < ndims; ++d)
+      item.dims.push_back(header.read<uint64_t>());
+
+    uint64_t offset = header.read<uint64_t>();
+    item.bytes = header.read<uint64_t>();
+    UTIL_THROW_IF2(offset > size_ || item.bytes > size_ - offset,
+                   "Binary model " << file_ << " is truncated");
+    item.data = base + offset;
+
+    index_[item.name] = items_.size();
+    items_.push_back(item);
+  }
+}
+
+BinaryModel::~BinaryModel() {
+  munmap(mapping_, size_);
+}
+
+const BinaryModel::Item* BinaryModel::get(const std::string& name) const {
+  auto it = index_.find(name);
+  return it != index_.end() ? &items_[it->second] : nullptr;
+}
+
+bool BinaryModel::isBinaryModel(const std::string& file) {
+  char magic[sizeof(MAGIC)];
+  std::ifstream in(file, std::ios::binary);
+  return in.read(magic, sizeof(MAGIC))
+         && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void BinaryModel::convert(const std::string& npzFile,
+                          const std::string& binFile) {
+  auto numpy = cnpy::npz_load(npzFile);
+
+  // the header first, its size determines where the data starts
+  std::vector<std::pair<std::string, const cnpy::NpyArray*>> arrays;
+  size_t headerSize = sizeof(MAGIC) + sizeof(uint64_t);
+  for(auto& it : numpy) {
+    arrays.push_back({it.first, &it.second});
+    headerSize += 3 * sizeof(uint32_t) + it.first.size()
+                  + (it.second.shape.size() + 2) * sizeof(uint64_t);
+  }
+
+  std::string header(MAGIC, sizeof(MAGIC));
+  write<uint64_t>(header, arrays.size());
+
+  std::vector<size_t> offsets;
+  size_t offset = aligned(headerSize);
+  for(auto& a : arrays) {
+    const cnpy::NpyArray& np = *a.second;
+    size_t bytes = np.word_size;
+    for(auto d : np.shape)
+      bytes *= d;
+
+    write<uint32_t>(header, a.first.size());
+    header += a.first;
+    write<uint32_t>(header, np.word_size);
+    write<uint32_t>(header, np.shape.size());
+    for(auto d : np.shape)
+      write<uint64_t>(header, d);
+    write<uint64_t>(header, offset);
+    write<uint64_t>(header, bytes);
+
+    offsets.push_back(offset);
+    offset = aligned(offset + bytes);
+  }
+
+  std::ofstream out(binFile, std::ios::binary);
+  UTIL_THROW_IF2(!out, "Cannot write " << binFile);
+  out.write(header.data(), header.size());
+
+  size_t pos = header.size();
+  for(size_t i = 0; i < arrays.size(); ++i) {
+    const cnpy::NpyArray& np = *arrays[i].second;
+    std::string padding(offsets[i] - pos, '\0');
+    out.write(padding.data(), padding.size());
+
+    size_t bytes = np.word_size;
+    for(auto d : np.shape)
+      bytes *= d;
+    out.write(np.data, bytes);
+    pos = offsets[i] + bytes;
+  }
+
+  UTIL_THROW_IF2(!out, "Cannot write " << binFile);
+  numpy.destruct();
+}
+
+}
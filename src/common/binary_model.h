@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/definitions.h"
+#include "common/shape.h"
+
+namespace marian {
+
+/**
+ * @brief A model file that is memory-mapped instead of read.
+ *
+ * The file starts with a header that lists the arrays of the model: name,
+ * element size, dimensions and the position of the data. The data of each
+ * array follows in a block aligned to BinaryModel::ALIGNMENT bytes, so
+ * parameters can use it in place. Processes that map the same file share
+ * its pages through the page cache.
+ *
+ * Such files are created from .npz models with BinaryModel::convert(), see
+ * the marian-conv tool. Arrays whose names start with "special:", e.g. the
+ * model configuration, are kept as raw bytes.
+ */
+class BinaryModel {
+  public:
+    static const size_t ALIGNMENT = 256;
+
+    struct Item {
+      std::string name;
+      size_t wordSize;
+      std::vector<size_t> dims;
+      const char* data;
+      size_t bytes;
+
+      /** Shape of a parameter, vectors become matrices with one row */
+      Shape shape() const;
+
+      const float* floats() const {
+        return (const float*)data;
+      }
+    };
+
+  private:
+    std::string file_;
+    void* mapping_{nullptr};
+    size_t size_{0};
+    std::vector<Item> items_;
+    std::map<std::string, size_t> index_;
+
+    void readHeader();
+
+  public:
+    /** Maps the file read-only, throws if it is not a binary model */
+    BinaryModel(const std::string& file);
+    ~BinaryModel();
+
+    BinaryModel(const BinaryModel&) = delete;
+    BinaryModel& operator=(const BinaryModel&) = delete;
+
+    /** Arrays in the order of the file */
+    const std::vector<Item>& items() const {
+      return items_;
+    }
+
+    /** The array with the given name or nullptr */
+    const Item* get(const std::string& name) const;
+
+    /** Whether the file starts like a binary model */
+    static bool isBinaryModel(const std::string& file);
+
+    /** Writes the arrays of an .npz model to a binary model file */
+    static void convert(const std::string& npzFile, const std::string& binFile);
+};
+
+}
@@ -5,7 +5,9 @@
 #include <string>
 #include <functional>
 #include <memory>
+#ifdef CUDA_FOUND
 #include <cuda.h>
+#endif
 #include <thrust/device_vector.h>
 #include <thrust/host_vector.h>
 
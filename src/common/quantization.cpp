@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cmath>
+
+#include "3rd_party/cnpy/cnpy.h"
+#include "3rd_party/exception.h"
+#include "common/logging.h"
+#include "common/quantization.h"
+
+namespace marian {
+
+Int8Matrix::Int8Matrix(size_t depth, size_t columns,
+                       std::vector<int8_t>&& data, std::vector<float>&& scales)
+  : depth_(depth),
+    columns_(columns),
+    ownedData_(std::move(data)),
+    ownedScales_(std::move(scales)) {
+  UTIL_THROW_IF2(ownedData_.size() != depth_ * columns_
+                 || ownedScales_.size() != columns_,
+                 "Quantized matrix does not match its shape");
+  data_ = ownedData_.data();
+  scales_ = ownedScales_.data();
+  computeSums();
+}
+
+Int8Matrix::Int8Matrix(size_t depth, size_t columns,
+                       const int8_t* data, const float* scales,
+                       Ptr<BinaryModel> model)
+  : depth_(depth),
+    columns_(columns),
+    data_(data),
+    scales_(scales),
+    model_(model) {
+  computeSums();
+}
+
+void Int8Matrix::computeSums() {
+  sums_.assign(columns_, 0);
+  for(size_t j = 0; j < columns_; ++j)
+    for(size_t i = 0; i < depth_; ++i)
+      sums_[j] += column(j)[i];
+}
+
+Ptr<Int8Matrix> Int8Matrix::quantize(const float* w, size_t depth, size_t columns) {
+  std::vector<float> scales(columns, 0.f);
+  for(size_t i = 0; i < depth; ++i)
+    for(size_t j = 0; j < columns; ++j)
+      scales[j] = std::max(scales[j], std::fabs(w[i * columns + j]));
+
+  std::vector<float> inverse(columns, 0.f);
+  for(size_t j = 0; j < columns; ++j) {
+    scales[j] /= 127.f;
+    // a zero column stays zero
+    if(scales[j] > 0)
+      inverse[j] = 1.f / scales[j];
+  }
+
+  std::vector<int8_t> data(depth * columns);
+  for(size_t i = 0; i < depth; ++i)
+    for(size_t j = 0; j < columns; ++j) {
+      float q = std::round(w[i * columns + j] * inverse[j]);
+      data[j * depth + i] = (int8_t)std::max(-127.f, std::min(127.f, q));
+    }
+
+  return New<Int8Matrix>(depth, columns, std::move(data), std::move(scales));
+}
+
+void Int8Matrix::dequantize(float* w) const {
+  for(size_t j = 0; j < columns_; ++j) {
+    const int8_t* c = column(j);
+    for(size_t i = 0; i < depth_; ++i)
+      w[i * columns_ + j] = c[i] * scales_[j];
+  }
+}
+
+size_t Int8Weights::columns() const {
+  size_t n = 0;
+  for(auto& part : parts)
+    n += part.size();
+  return n;
+}
+
+Ptr<Int8Weights> Int8Weights::concatenate(const std::vector<Ptr<Int8Weights>>& weights) {
+  std::vector<Part> parts;
+  for(auto w : weights) {
+    if(!w || w->depth() != weights.front()->depth())
+      return nullptr;
+    parts.insert(parts.end(), w->parts.begin(), w->parts.end());
+  }
+  return New<Int8Weights>(parts);
+}
+
+Ptr<Int8Weights> Int8Weights::select(const std::vector<size_t>& columns) const {
+  std::vector<size_t> offsets;
+  size_t n = 0;
+  for(auto& part : parts) {
+    offsets.push_back(n);
+    n += part.size();
+  }
+
+  // consecutive columns of the same matrix share a part
+  std::vector<Part> selected;
+  for(size_t c : columns) {
+    UTIL_THROW_IF2(c >= n, "Column " << c << " out of range");
+    size_t p = std::upper_bound(offsets.begin(), offsets.end(), c) - offsets.begin() - 1;
+    const Part& part = parts[p];
+    if(selected.empty() || selected.back().matrix != part.matrix)
+      selected.push_back({part.matrix, {}});
+    selected.back().columns.push_back(part.column(c - offsets[p]));
+  }
+  return New<Int8Weights>(selected);
+}
+
+namespace quantization {
+
+std::string quantized(const std::string& name, const std::string& suffix) {
+  if(name.size() <= suffix.size()
+     || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+    return "";
+  return name.substr(0, name.size() - suffix.size());
+}
+
+bool quantizable(const std::string& name, const std::vector<unsigned int>& shape) {
+  // embeddings are looked up by rows and not multiplied
+  return shape.size() == 2 && shape[0] > 1 && shape[1] > 1
+         && name.substr(0, 8) != "special:"
+         && name.find("Wemb") == std::string::npos;
+}
+
+Ptr<Int8Matrix> fromNumpy(const cnpy::NpyArray& data, const cnpy::NpyArray& scales) {
+  UTIL_THROW_IF2(data.word_size != 1 || data.shape.size() != 2
+                 || scales.word_size != sizeof(float) || scales.shape.size() != 1
+                 || scales.shape[0] != data.shape[0],
+                 "Invalid quantized matrix in model");
+
+  size_t columns = data.shape[0];
+  size_t depth = data.shape[1];
+  const int8_t* d = (const int8_t*)data.data;
+  const float* s = (const float*)scales.data;
+  return New<Int8Matrix>(depth, columns,
+                         std::vector<int8_t>(d, d + depth * columns),
+                         std::vector<float>(s, s + columns));
+}
+
+Ptr<Int8Matrix> fromBinary(Ptr<BinaryModel> model,
+                           const BinaryModel::Item& data,
+                           const BinaryModel::Item& scales) {
+  UTIL_THROW_IF2(data.wordSize != 1 || data.dims.size() != 2
+                 || scales.wordSize != sizeof(float) || scales.dims.size() != 1
+                 || scales.dims[0] != data.dims[0]
+                 || data.bytes != data.dims[0] * data.dims[1]
+                 || scales.bytes != scales.dims[0] * sizeof(float),
+                 "Invalid quantized matrix " << data.name << " in model");
+
+  return New<Int8Matrix>(data.dims[1], data.dims[0],
+                         (const int8_t*)data.data, scales.floats(), model);
+}
+
+void quantizeModel(const std::string& npzFile, const std::string& outFile) {
+  auto numpy = cnpy::npz_load(npzFile);
+
+  std::string mode = "w";
+  size_t quantized = 0;
+  for(auto& it : numpy) {
+    const std::string& name = it.first;
+    const cnpy::NpyArray& np = it.second;
+    const unsigned int* shape = np.shape.data();
+    unsigned int dims = np.shape.size();
+
+    if(np.word_size == sizeof(float) && quantizable(name, np.shape)) {
+      auto matrix = Int8Matrix::quantize((const float*)np.data, shape[0], shape[1]);
+
+      const char* values = (const char*)matrix->column(0);
+      std::vector<float> scales;
+      for(size_t j = 0; j < matrix->columns(); ++j)
+        scales.push_back(matrix->scale(j));
+
+      unsigned int transposed[2] = {shape[1], shape[0]};
+      cnpy::npz_save(outFile, name + INT8_SUFFIX, values, transposed, 2, mode);
+      mode = "a";
+      cnpy::npz_save(outFile, name + SCALES_SUFFIX, scales.data(), &shape[1], 1, mode);
+      ++quantized;
+    }
+    else if(np.word_size == sizeof(float)) {
+      cnpy::npz_save(outFile, name, (const float*)np.data, shape, dims, mode);
+    }
+    else if(np.word_size == 1) {
+      cnpy::npz_save(outFile, name, np.data, shape, dims, mode);
+    }
+    else {
+      UTIL_THROW2("Array " << name << " has unsupported word size " << np.word_size);
+    }
+    mode = "a";
+  }
+
+  LOG(info, "Quantized {} of {} arrays to int8", quantized, numpy.size());
+  numpy.destruct();
+}
+
+}
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/binary_model.h"
+#include "common/definitions.h"
+
+namespace cnpy {
+struct NpyArray;
+}
+
+namespace marian {
+
+/**
+ * @brief A depth x columns float matrix quantized to int8 with one scale per
+ * column, the right operand of a product.
+ *
+ * The values are stored column by column, so a product reads the depth
+ * values that belong to one output unit contiguously. Column j holds
+ * round(w / scale(j)) for scale(j) = max |w| / 127 over that column. The
+ * data is either owned or points into a memory-mapped model.
+ */
+class Int8Matrix {
+  private:
+    size_t depth_;
+    size_t columns_;
+    const int8_t* data_;
+    const float* scales_;
+    std::vector<int32_t> sums_;
+
+    std::vector<int8_t> ownedData_;
+    std::vector<float> ownedScales_;
+    Ptr<BinaryModel> model_;
+
+    void computeSums();
+
+  public:
+    Int8Matrix(size_t depth, size_t columns,
+               std::vector<int8_t>&& data, std::vector<float>&& scales);
+
+    /** Uses arrays of a mapped model in place and keeps the model mapped */
+    Int8Matrix(size_t depth, size_t columns,
+               const int8_t* data, const float* scales,
+               Ptr<BinaryModel> model);
+
+    /** Quantizes a row-major depth x columns matrix */
+    static Ptr<Int8Matrix> quantize(const float* w, size_t depth, size_t columns);
+
+    size_t depth() const {
+      return depth_;
+    }
+
+    size_t columns() const {
+      return columns_;
+    }
+
+    const int8_t* column(size_t j) const {
+      return data_ + j * depth_;
+    }
+
+    float scale(size_t j) const {
+      return scales_[j];
+    }
+
+    /** Sum of the int8 values of column j, for products with unsigned values */
+    int32_t sum(size_t j) const {
+      return sums_[j];
+    }
+
+    /** Writes the approximated matrix row-major to w */
+    void dequantize(float* w) const;
+};
+
+/**
+ * @brief The int8 version of a product operand built from quantized
+ * parameters, e.g. the concatenated matrices of a GRU or the columns of an
+ * output layer selected by a shortlist.
+ *
+ * The columns of the operand are the columns of the parts in order, a part
+ * uses either all columns of its matrix or the listed ones.
+ */
+struct Int8Weights {
+  struct Part {
+    Ptr<Int8Matrix> matrix;
+    std::vector<size_t> columns;
+
+    size_t size() const {
+      return columns.empty() ? matrix->columns() : columns.size();
+    }
+
+    size_t column(size_t j) const {
+      return columns.empty() ? j : columns[j];
+    }
+  };
+
+  std::vector<Part> parts;
+
+  Int8Weights(Ptr<Int8Matrix> matrix) {
+    parts.push_back({matrix, {}});
+  }
+
+  Int8Weights(const std::vector<Part>& p) : parts(p) {}
+
+  size_t depth() const {
+    return parts.front().matrix->depth();
+  }
+
+  size_t columns() const;
+
+  /** The operands side by side, nullptr if one is missing or depths differ */
+  static Ptr<Int8Weights> concatenate(const std::vector<Ptr<Int8Weights>>& weights);
+
+  /** The operand made of the given columns */
+  Ptr<Int8Weights> select(const std::vector<size_t>& columns) const;
+};
+
+/**
+ * Models with int8 matrices store each of them as two arrays: the values,
+ * columns x depth int8, named name + INT8_SUFFIX, and the scales, a float
+ * vector named name + SCALES_SUFFIX.
+ */
+namespace quantization {
+
+const std::string INT8_SUFFIX = ":int8";
+const std::string SCALES_SUFFIX = ":scales";
+
+/** The parameter of an array name with the given suffix, "" for other arrays */
+std::string quantized(const std::string& name, const std::string& suffix);
+
+/** Whether a parameter is quantized by quantizeModel() */
+bool quantizable(const std::string& name, const std::vector<unsigned int>& shape);
+
+/** Copies the two arrays of a quantized matrix from an .npz model */
+Ptr<Int8Matrix> fromNumpy(const cnpy::NpyArray& data, const cnpy::NpyArray& scales);
+
+/** Uses the two arrays of a quantized matrix in a binary model in place */
+Ptr<Int8Matrix> fromBinary(Ptr<BinaryModel> model,
+                           const BinaryModel::Item& data,
+                           const BinaryModel::Item& scales);
+
+/**
+ * Writes a copy of an .npz model whose matrices are quantized to int8,
+ * embeddings, vectors and "special:" arrays are copied as they are.
+ */
+void quantizeModel(const std::string& npzFile, const std::string& outFile);
+
+}
+
+}
@@ -108,9 +108,9 @@ Corpus::Corpus(std::vector<std::string> paths,
 SentenceTuple Corpus::next() {
   bool cont = true;
   while(cont) {
-    size_t curId = pos_;
-    if(pos_ < ids_.size())
-      curId = ids_[pos_++];
+    // ids are line numbers, translation restores the input order from them
+    size_t curId = pos_ < ids_.size() ? ids_[pos_] : pos_;
+    pos_++;
 
     SentenceTuple tup(curId);
     for(int i = 0; i < files_.size(); ++i) {
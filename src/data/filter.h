@@ -1,11 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "training/config.h"
 #include "common/definitions.h"
 #include "common/file_stream.h"
+#include "data/corpus.h"
+#include "data/vocab.h"
 
 namespace marian {
   
@@ -26,6 +30,7 @@ class FilterInfo {
       reverseMap_(reverseMap),
       probs_(probs) { }
     
+    /** Selected target words, sorted, position i holds word reverseMap(i) */
     std::vector<Word>& indeces() { return indeces_; }
     std::vector<Word>& mappedIndeces() { return mappedIndeces_; }
     Word reverseMap(Word idx) { return reverseMap_[idx]; }
@@ -33,6 +38,13 @@ class FilterInfo {
     probs() { return probs_; }
 };
   
+/**
+ * Selects the target words that can occur in the translation of a batch:
+ * the firstNum most frequent words and the bestNum most probable
+ * translations of each source word in a lexical table with lines
+ * "target source probability". Configured with
+ * --shortlist path [firstNum=100 [bestNum=100 [threshold=0]]].
+ */
 class Filter {
   private:
     Ptr<Config> options_;
@@ -93,9 +105,9 @@ class Filter {
       srcVocab_(srcVocab), trgVocab_(trgVocab)
     {
       std::vector<std::string> vals
-        = options_->get<std::vector<std::string>>("filter");
+        = options_->get<std::vector<std::string>>("shortlist");
       
-      UTIL_THROW_IF2(vals.empty(), "No path to filter path given");
+      UTIL_THROW_IF2(vals.empty(), "No path to shortlist given");
       std::string fname = vals[0];
       
       firstNum_ = vals.size() > 1 ? std::stoi(vals[1]) : 100;
@@ -104,19 +116,27 @@ class Filter {
       
       load(fname);
       prune(threshold);
+
+      LOG(info, "Loaded shortlist {} with {} frequent and up to {} aligned words",
+          fname, firstNum_, bestNum_);
     }
     
+    /**
+     * Shortlist for a batch. Without a target batch, i.e. in translation,
+     * only the selected words and their mapping are computed.
+     */
     Ptr<FilterInfo> createInfo(Ptr<data::SubBatch> srcBatch,
-                               Ptr<data::SubBatch> trgBatch) {
+                               Ptr<data::SubBatch> trgBatch = nullptr) {
       
-      // add firstNum most frequent words
-      std::unordered_set<Word> idxSet;
+      // add firstNum most frequent words, </s> and <unk> are always kept
+      std::unordered_set<Word> idxSet = {0, 1};
       for(Word i = 0; i < firstNum_ && i < trgVocab_->size(); ++i)
         idxSet.insert(i);
       
       // add all words from ground truth
-      for(auto i : trgBatch->indeces())
-        idxSet.insert(i);
+      if(trgBatch)
+        for(auto i : trgBatch->indeces())
+          idxSet.insert(i);
       
       // collect unique words form source
       std::unordered_set<Word> srcSet;
@@ -125,8 +145,9 @@ class Filter {
       
       // add aligned target words
       for(auto i : srcSet)
-        for(auto& it : data_[i])
-          idxSet.insert(it.first);
+        if(i < data_.size())
+          for(auto& it : data_[i])
+            idxSet.insert(it.first);
       
       // turn into vector and sort (slected indeces)
       std::vector<Word> idx(idxSet.begin(), idxSet.end());
@@ -141,6 +162,11 @@ class Filter {
         reverseMap.push_back(idx[i]);
       }
       
+      if(!trgBatch)
+        return New<FilterInfo>(idx, std::vector<Word>(), reverseMap,
+                               std::make_pair(std::vector<size_t>(),
+                                              std::vector<float>()));
+      
       std::vector<Word> mapped;
       for(auto i : trgBatch->indeces()) {
         // mapped postions for cross-entropy
@@ -159,7 +185,7 @@ class Filter {
               probs.push_back(1);
               sparse.push_back(p);
             }
-            else if(data_[srcWord].count(v)) {
+            else if(srcWord < data_.size() && data_[srcWord].count(v)) {
               probs.push_back(data_[srcWord][v] + eps);
               sparse.push_back(p);
             }
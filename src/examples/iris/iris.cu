@@ -8,8 +8,6 @@
 #include <sstream>
 #include <functional>
 
-#include <cuda.h>
-
 #include "marian.h"
 
 using namespace marian;
@@ -25,6 +25,7 @@ typedef Ptr<Chainable<Tensor>> Expr;
 typedef Weak<Chainable<Tensor>> WExpr;
 
 class ExpressionGraph;
+struct Int8Weights;
 
 /**
  * @brief Abstraction of an element in a computation graph for which a derivative can be calculated.
@@ -53,6 +54,13 @@ struct Chainable {
 
     virtual size_t allocate() = 0;
     virtual void free() = 0;
+    /** @brief Whether val() and grad() are views of the first child's tensors */
+    virtual bool isView() { return false; }
+    /** @brief Drops the value and gradient before a recorded pass is run again */
+    virtual void reset() { }
+    /** @brief Int8 weights of the value, set on quantized parameters of CPU inference graphs */
+    virtual Ptr<Int8Weights> int8() { return nullptr; }
+    virtual void setInt8(Ptr<Int8Weights>) { }
     virtual void init() = 0;
     virtual void init_dependent() { }
     virtual void set_zero_adjoint() { }
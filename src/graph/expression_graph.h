@@ -4,10 +4,15 @@
 #include <unordered_set>
 #include <fstream>
 
+#include "common/binary_model.h"
 #include "common/definitions.h"
+#include "common/quantization.h"
 #include "training/config.h"
 #include "graph/chainable.h"
+#include "graph/memory_plan.h"
 #include "graph/parameters.h"
+#include "graph/profiler.h"
+#include "graph/tape_cache.h"
 #include "graph/node_operators.h"
 #include "data/batch_generator.h"
 #include "tensors/tensor_allocator.h"
@@ -53,6 +58,77 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
     bool inferenceOnly_{false};
     std::string namespace_;
 
+    // largest arena of a memory plan so far, for logging
+    size_t maxPlanned_{0};
+
+    // recorded passes, null unless enabled with setTapeCache()
+    Ptr<TapeCache> tapes_;
+    // the tape of the current pass if it was recorded or replayed
+    Ptr<RecordedTape> tape_;
+    bool recording_{false};
+    std::vector<std::pair<WExpr, InputBinding>> bindings_;
+
+    Ptr<Profiler> profiler_;
+
+    template <class Op>
+    void measure(Expr node, Profiler::Phase phase, const Op& op) {
+      if(profiler_)
+        profiler_->time(node, phase, op);
+      else
+        op();
+    }
+
+    Ptr<RecordedTape> recordTape(Expr top) {
+      if(topNodes_.size() != 1 || !topNodes_.count(top))
+        return nullptr;
+
+      auto tape = New<RecordedTape>();
+      std::unordered_map<Chainable<Tensor>*, size_t> position;
+      for(auto& v : nodesForward_) {
+        position[v.get()] = tape->nodes.size();
+        tape->nodes.push_back(v);
+      }
+      tape->views.resize(tape->nodes.size(), 0);
+
+      for(auto& v : tape->nodes) {
+        std::vector<size_t> children;
+        for(auto& child : v->children()) {
+          auto it = position.find(child.get());
+          if(it == position.end())
+            return nullptr;
+          children.push_back(it->second);
+        }
+        if(v->isView())
+          tape->views[children[0]]++;
+        tape->children.push_back(children);
+      }
+
+      // every input has to be a node of its own to be rebound
+      std::unordered_set<size_t> bound;
+      for(auto& binding : bindings_) {
+        auto node = binding.first.lock();
+        auto it = node ? position.find(node.get()) : position.end();
+        if(it == position.end() || !bound.insert(it->second).second)
+          return nullptr;
+        tape->inputs.push_back({it->second, binding.second});
+      }
+
+      tape->top = position[top.get()];
+      return tape;
+    }
+
+    void logMemoryPlan(const MemoryPlan& plan) {
+      if(plan.unsharedSize() <= maxPlanned_)
+        return;
+      maxPlanned_ = plan.unsharedSize();
+
+      float mb = sizeof(float) / (1024.f * 1024.f);
+      LOG(memory, "Forward pass: {} of {} values are transient, "
+          "{:.2f} MB shared as {:.2f} MB (device {})",
+          plan.entries().size(), plan.values(),
+          plan.unsharedSize() * mb, plan.size() * mb, device_);
+    }
+
   protected:
     // delete copy and move constructors
     ExpressionGraph(const ExpressionGraph&) = delete;
@@ -66,6 +142,8 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
 
 
     ~ExpressionGraph() {
+      if(profiler_)
+        profiler_->write();
       clear();
       params_->clear();
     }
@@ -102,6 +180,19 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
       tensors_->reserve(elements);
     }
 
+    /**
+     * @brief Times every node of the following passes, see Profiler. The
+     * results are written to <prefix>.<device>.{txt,json,dot} when the graph
+     * is destroyed.
+     */
+    void setProfiler(const std::string& prefix) {
+      profiler_ = New<Profiler>(prefix + "." + std::to_string(device_), device_);
+    }
+
+    Ptr<Profiler> getProfiler() {
+      return profiler_;
+    }
+
     void reuseWorkspace(Ptr<ExpressionGraph> graph) {
       tensors_ = graph->tensors_;
     }
@@ -157,11 +248,31 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
 
       hashMap_.clear();
 
+      // values read only within this pass share one arena
+      Tensor arena;
+      {
+        MemoryPlan plan(nodesForward_, topNodes_, !inferenceOnly_,
+                        tape_ ? 1 : 0);
+        if(plan.size() > 0) {
+          tensors_->allocate(arena, {1, (int)plan.size()});
+          for(auto& e : plan.entries())
+            e.node->val().reset(new TensorBase(arena->data() + e.offset,
+                                               e.node->shape(),
+                                               device_));
+        }
+        logMemoryPlan(plan);
+      }
+
+      if(profiler_)
+        profiler_->beginPass();
+
       while(!nodesForward_.empty()) {
         auto v = nodesForward_.front();
-        v->allocate();
-        v->init();
-        v->forward();
+        measure(v, Profiler::Allocate, [&]() {
+          v->allocate();
+          v->init();
+        });
+        measure(v, Profiler::Forward, [&]() { v->forward(); });
 
         if(v->marked_for_debug()) {
           std::cerr << "Debug: " << v->debug_message() << std::endl;
@@ -172,6 +283,9 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
           v->children().clear();
         nodesForward_.pop_front();
       }
+
+      if(arena)
+        tensors_->free(arena);
     }
 
     /**
@@ -185,31 +299,46 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
      *
      * After this method has successfully completed,
      *    and that all backward pass computations have been performed.
+     *
+     * @param zeroGrads       if false, the gradients of the parameters are added
+     *    to the gradients of the previous backward pass instead of replacing them
+     * @param scale           the gradients are those of the top node times scale
      */
-    void backward() {
+    void backward(bool zeroGrads = true, float scale = 1.f) {
       UTIL_THROW_IF2(topNodes_.size() > 1,
         "There are more than one top most node for backward step");
 
       params_->allocateBackward();
-      params_->set_zero_adjoint();
+      if(zeroGrads)
+        params_->set_zero_adjoint();
 
-      for(auto&& v : topNodes_)
+      for(auto&& v : topNodes_) {
         v->init_dependent();
+        if(scale != 1.f)
+          v->grad()->set(scale);
+      }
 
       //named_.clear();
       topNodes_.clear();
       hashMap_.clear();
 
+      // positions on the tape of the pass, if it is the recorded one
+      size_t i = nodesBackward_.size();
+      bool taped = tape_ && tape_->nodes.size() == i;
+
       while(!nodesBackward_.empty()) {
         auto v = nodesBackward_.back();
         nodesBackward_.pop_back();
-
-        for(auto&& child: v->children()) {
-          if(child->trainable())
-            child->set_zero_adjoint();
-        }
+        --i;
+
+        measure(v, Profiler::Allocate, [&]() {
+          for(auto&& child: v->children()) {
+            if(child->trainable())
+              child->set_zero_adjoint();
+          }
+        });
         if(v->trainable())
-          v->backward();
+          measure(v, Profiler::Backward, [&]() { v->backward(); });
 
         if(v->trainable() && v->marked_for_debug()) {
           //std::cerr << "Debug Grad: " << v->debug_message() << std::endl;
@@ -217,6 +346,10 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
         }
 
         v->children().clear();
+
+        // without a tape the node would be destroyed here
+        if(taped && v.use_count() == 2 + tape_->views[i])
+          v->free();
       }
     }
 
@@ -228,6 +361,10 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
      * @return a string representing this expression graph in <code>graphviz</code> notation
      */
     std::string graphviz() {
+      // the nodes are gone after a profiled pass, show it with its timings
+      if(profiler_ && nodesForward_.empty())
+        return profiler_->graphviz();
+
       std::stringstream ss;
       ss << "digraph ExpressionGraph {" << std::endl;
       //ss << "graph[splines=ortho]" << std::endl;
@@ -426,6 +563,99 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
       topNodes_.clear();
       hashMap_.clear();
       tensors_->clear();
+      tape_.reset();
+    }
+
+    /**
+     * @brief Keeps up to the given number of recorded passes, see replay().
+     */
+    void setTapeCache(size_t tapes) {
+      tapes_ = tapes ? New<TapeCache>(tapes) : nullptr;
+    }
+
+    /**
+     * @brief Sets up the graph for the given batch from a recorded pass.
+     *
+     * If a pass for a batch of the same shape has been recorded, its nodes are
+     * put back on the graph, their values and gradients are dropped and the
+     * inputs are rebound to the batch. The returned top node can then be run
+     * with forward() and backward() as if it had been built anew.
+     *
+     * Otherwise an empty expression is returned and the next pass is recorded:
+     * the caller builds the graph, with the batch inputs declared through
+     * bindInput(), and then calls record().
+     *
+     * @return the top node of the replayed pass or an empty expression
+     */
+    Expr replay(Ptr<data::CorpusBatch> batch) {
+      recording_ = false;
+      bindings_.clear();
+      if(!tapes_)
+        return Expr();
+
+      auto tape = tapes_->get(batch);
+      if(!tape) {
+        recording_ = true;
+        return Expr();
+      }
+
+      clear();
+      for(size_t i = 0; i < tape->nodes.size(); ++i) {
+        auto& v = tape->nodes[i];
+        auto& children = v->children();
+        children.clear();
+        for(auto c : tape->children[i])
+          children.push_back(tape->nodes[c]);
+        v->reset();
+
+        nodesForward_.push_back(v);
+        if(!inferenceOnly_)
+          nodesBackward_.push_back(v);
+      }
+      count_ = tape->nodes.size();
+
+      for(auto& input : tape->inputs)
+        input.second(tape->nodes[input.first], batch);
+
+      tape_ = tape;
+      Expr top = tape->nodes[tape->top];
+      topNodes_.insert(top);
+      return top;
+    }
+
+    /**
+     * @brief Declares a node whose value depends on the batch, e.g. the
+     * embedding rows or the mask of a sentence, with the binding that updates
+     * it for another batch. Ignored unless the current pass is recorded.
+     */
+    void bindInput(Expr node, InputBinding binding) {
+      if(recording_)
+        bindings_.push_back({node, binding});
+    }
+
+    /**
+     * @brief Excludes the current pass from recording, for models whose
+     * graphs depend on the batch in ways bindInput() cannot describe.
+     */
+    void cancelRecording() {
+      recording_ = false;
+      bindings_.clear();
+    }
+
+    /**
+     * @brief Stores the pass built since replay() for later batches of the
+     * same shape, with top as the node that is returned on replay.
+     */
+    void record(Ptr<data::CorpusBatch> batch, Expr top) {
+      if(!recording_)
+        return;
+
+      tape_ = recordTape(top);
+      if(tape_)
+        tapes_->put(batch, tape_);
+
+      recording_ = false;
+      bindings_.clear();
     }
 
 
@@ -435,16 +665,46 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
 
     void load(const std::string& name) {
       using namespace keywords;
+      using namespace quantization;
 
       LOG(info, "Loading model from {}", name);
 
+      // quantized matrices are created from their values and scales together
+      if(BinaryModel::isBinaryModel(name)) {
+        auto model = New<BinaryModel>(name);
+        for(auto& item : model->items()) {
+          if(item.name.substr(0, 8) == "special:"
+             || !quantized(item.name, SCALES_SUFFIX).empty())
+            continue;
+          std::string pName = quantized(item.name, INT8_SUFFIX);
+          if(!pName.empty()) {
+            auto scales = model->get(pName + SCALES_SUFFIX);
+            UTIL_THROW_IF2(!scales, "Scales of parameter " << pName << " do not exist.");
+            int8Param(pName, fromBinary(model, item, *scales));
+          }
+          else {
+            mappedParam(item.name, model, item);
+          }
+        }
+        return;
+      }
+
       auto numpy = cnpy::npz_load(name);
 
       for(auto it : numpy) {
         auto name = it.first;
         // skip over special parameters starting with _
-        if(name.substr(0, 8) == "special:")
+        if(name.substr(0, 8) == "special:"
+           || !quantized(name, SCALES_SUFFIX).empty())
+          continue;
+
+        std::string pName = quantized(name, INT8_SUFFIX);
+        if(!pName.empty()) {
+          UTIL_THROW_IF2(numpy.count(pName + SCALES_SUFFIX) == 0,
+                         "Scales of parameter " << pName << " do not exist.");
+          int8Param(pName, fromNumpy(it.second, numpy[pName + SCALES_SUFFIX]));
           continue;
+        }
 
         Shape shape;
         if(it.second.shape.size() == 2) {
@@ -459,6 +719,70 @@ class ExpressionGraph : public std::enable_shared_from_this<ExpressionGraph> {
         param(name, shape,
               init=inits::from_numpy(it.second));
       }
+      numpy.destruct();
+    }
+
+    /**
+     * @brief Creates a parameter from an array of a memory-mapped model.
+     *
+     * In CPU inference graphs the value points into the read-only mapping and
+     * keeps the model mapped, so nothing is copied and processes that load
+     * the same file share its memory. Otherwise the array is copied into the
+     * parameter memory on initialization.
+     */
+    Expr mappedParam(const std::string& name,
+                     Ptr<BinaryModel> model,
+                     const BinaryModel::Item& item) {
+      using namespace keywords;
+
+      UTIL_THROW_IF2(item.wordSize != sizeof(float),
+                     "Parameter " << name << " is not stored as float32");
+
+      Shape shape = item.shape();
+      const float* data = item.floats();
+      size_t size = shape.elements();
+      UTIL_THROW_IF2(size * sizeof(float) != item.bytes,
+                     "Parameter " << name << " does not match its shape");
+
+#ifndef CUDA_FOUND
+      if(inferenceOnly_) {
+        auto p = param(name, shape);
+        if(!p->val())
+          p->val().reset(new TensorBase(const_cast<float*>(data), shape, device_),
+                         [model](TensorBase* t) { delete t; });
+        return p;
+      }
+#endif
+
+      return param(name, shape,
+                   init=[model, data, size](Tensor t) {
+                     t->set(data, data + size);
+                   });
+    }
+
+    /**
+     * @brief Creates a parameter from a matrix of a quantized model.
+     *
+     * The value is the dequantized matrix. In CPU inference graphs the int8
+     * weights are attached to the parameter as well, products with it and
+     * with concatenations or columns of such parameters use them instead.
+     */
+    Expr int8Param(const std::string& name, Ptr<Int8Matrix> matrix) {
+      using namespace keywords;
+
+      Shape shape({(int)matrix->depth(), (int)matrix->columns()});
+      auto p = param(name, shape,
+                     init=[matrix](Tensor t) {
+                       std::vector<float> v(matrix->depth() * matrix->columns());
+                       matrix->dequantize(v.data());
+                       t->set(v);
+                     });
+
+#ifndef CUDA_FOUND
+      if(inferenceOnly_)
+        p->setInt8(New<Int8Weights>(matrix));
+#endif
+      return p;
     }
 
     void save(const std::string& name) {
@@ -1,6 +1,8 @@
 #pragma once
 #include "graph/expression_graph.h"
+#ifdef CUDA_FOUND
 #include "kernels/sparse.h"
+#endif
 
 namespace marian {
 
@@ -129,6 +131,8 @@ Expr dropout(Expr x, Args ...args) {
 
 Expr shift(Expr, Shape);
 
+#ifdef CUDA_FOUND
 Expr lexical_bias(Expr logits, Expr att, float exp, Ptr<sparse::CSR> lf);
+#endif
 
 }
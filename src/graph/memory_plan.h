@@ -0,0 +1,196 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/definitions.h"
+#include "graph/chainable.h"
+
+namespace marian {
+
+/**
+ * @brief Static placement of the values that live only within one forward pass.
+ *
+ * Before the nodes on the tape are executed, the plan finds for each value
+ * the last node that reads it. A value is transient if no later code can
+ * read it: it is not a top node, no expression outside the tape references
+ * it, and in training, where backward() reads the inputs of trainable
+ * nodes, all of its readers are non-trainable. View nodes such as reshapes
+ * share the memory of their input, their readers count as readers of the
+ * input.
+ *
+ * Transient values are given offsets in one arena by a linear scan over the
+ * tape: values whose last reader has run give back their space, which is
+ * reused best-fit by the values computed later. The arena is therefore
+ * only as large as the largest set of transient values alive at once.
+ * All other values are allocated as before and live as long as their nodes.
+ */
+class MemoryPlan {
+  public:
+    struct Entry {
+      Expr node;
+      size_t offset;
+    };
+
+  private:
+    std::vector<Entry> entries_;
+    size_t size_{0};
+    size_t unshared_{0};
+    size_t values_{0};
+
+    // free blocks of the arena by size for best-fit and by offset for
+    // coalescing, as in TensorAllocator
+    std::set<std::pair<size_t, size_t>> bySize_;
+    std::map<size_t, size_t> byOffset_;
+
+    static Expr viewed(Expr node) {
+      while(node->isView())
+        node = node->child(0);
+      return node;
+    }
+
+    void release(size_t offset, size_t size) {
+      auto next = byOffset_.lower_bound(offset);
+      if(next != byOffset_.end() && next->first == offset + size) {
+        size += next->second;
+        bySize_.erase({next->second, next->first});
+        next = byOffset_.erase(next);
+      }
+      if(next != byOffset_.begin()) {
+        auto prev = std::prev(next);
+        if(prev->first + prev->second == offset) {
+          offset = prev->first;
+          size += prev->second;
+          bySize_.erase({prev->second, prev->first});
+          byOffset_.erase(prev);
+        }
+      }
+
+      // a block at the end shrinks the arena instead
+      if(offset + size == size_) {
+        size_ = offset;
+        return;
+      }
+      bySize_.insert({size, offset});
+      byOffset_[offset] = size;
+    }
+
+    size_t place(size_t size) {
+      auto it = bySize_.lower_bound({size, 0});
+      if(it != bySize_.end()) {
+        size_t offset = it->second;
+        size_t free = it->first;
+        bySize_.erase(it);
+        byOffset_.erase(offset);
+        if(free > size) {
+          bySize_.insert({free - size, offset + size});
+          byOffset_[offset + size] = free - size;
+        }
+        return offset;
+      }
+      size_t offset = size_;
+      size_ += size;
+      return offset;
+    }
+
+  public:
+    /**
+     * @param tape nodes of the pass in execution order, the only list holding them
+     * @param topNodes the graph's current top nodes
+     * @param training whether the tape is also on the backward list
+     * @param held references to every node kept by a RecordedTape
+     */
+    MemoryPlan(const std::list<Expr>& tape,
+               const std::unordered_set<Expr>& topNodes,
+               bool training,
+               long held = 0) {
+      // references to each node held by the tape itself
+      std::unordered_map<Chainable<Tensor>*, long> references;
+      std::unordered_map<Chainable<Tensor>*, size_t> lastRead;
+      std::unordered_set<Chainable<Tensor>*> keep;
+
+      size_t i = 0;
+      for(auto& v : tape) {
+        for(auto& child : v->children()) {
+          references[child.get()]++;
+          Expr input = viewed(child);
+          auto& last = lastRead[input.get()];
+          last = std::max(last, i);
+          if(training && v->trainable())
+            keep.insert(input.get());
+        }
+        if(v->isView())
+          references[v->child(0).get()]++;
+        ++i;
+      }
+
+      long lists = (training ? 2 : 1) + held;
+      for(auto& v : tape) {
+        // backward() of a trainable node reads its own value
+        if(training && v->trainable())
+          keep.insert(v.get());
+
+        bool external = topNodes.count(v) || v.use_count() > lists + references[v.get()];
+        if(external)
+          keep.insert(viewed(v).get());
+      }
+
+      // values ordered by last reader to give back their space
+      typedef std::pair<size_t, size_t> Block;
+      typedef std::pair<size_t, Block> Expiry;
+      std::priority_queue<Expiry, std::vector<Expiry>, std::greater<Expiry>> expiries;
+
+      i = 0;
+      for(auto& v : tape) {
+        while(!expiries.empty() && expiries.top().first < i) {
+          release(expiries.top().second.first, expiries.top().second.second);
+          expiries.pop();
+        }
+
+        if(!v->isView() && !v->val()) {
+          ++values_;
+          auto last = lastRead.find(v.get());
+          if(last != lastRead.end() && !keep.count(v.get())) {
+            size_t size = v->shape().elements();
+            unshared_ += size;
+            size_t offset = place(size);
+            entries_.push_back({v, offset});
+            expiries.push({last->second, {offset, size}});
+          }
+        }
+        ++i;
+      }
+
+      // the arena is as large as it was at its peak
+      size_ = 0;
+      for(auto& e : entries_)
+        size_ = std::max(size_, e.offset + (size_t)e.node->shape().elements());
+    }
+
+    /** Transient values and their offsets in the arena */
+    const std::vector<Entry>& entries() const {
+      return entries_;
+    }
+
+    /** Arena size in floats */
+    size_t size() const {
+      return size_;
+    }
+
+    /** Space the transient values would take without sharing */
+    size_t unsharedSize() const {
+      return unshared_;
+    }
+
+    /** Values the pass allocates, transient or not */
+    size_t values() const {
+      return values_;
+    }
+};
+
+}
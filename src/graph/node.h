@@ -3,9 +3,10 @@
 #include <memory>
 #include <iostream>
 #include <thread>
-#include <cublas_v2.h>
 
 #include "common/keywords.h"
+#include "common/quantization.h"
+#include "kernels/backend.h"
 #include "tensors/tensor.h"
 #include "graph/chainable.h"
 
@@ -29,6 +30,8 @@ class Node : public Chainable<Tensor>,
     Tensor val_{nullptr};
     Tensor adj_{nullptr};
 
+    Ptr<Int8Weights> int8_;
+
     bool markedForDebug_{false};
     std::string debugMessage_;
 
@@ -103,8 +106,21 @@ class Node : public Chainable<Tensor>,
 
     virtual void free();
 
+    virtual void reset() {
+      val_.reset();
+      adj_.reset();
+    }
+
     virtual void init() {};
 
+    virtual Ptr<Int8Weights> int8() {
+      return int8_;
+    }
+
+    virtual void setInt8(Ptr<Int8Weights> int8) {
+      int8_ = int8;
+    }
+
     virtual void init_dependent();
 
     virtual void set_zero_adjoint();
@@ -38,4 +38,29 @@ namespace marian {
     }
   }
 
+  void ConcatenateNodeOp::backward() {
+    // Deconcatenate overwrites its outputs, a gradient that already holds
+    // values, e.g. of a parameter, gets its part through a temporary
+    std::vector<Tensor> deconcatenees;
+    std::vector<Tensor> temps;
+    for(int i = 0; i < children_.size(); ++i) {
+      auto childPtr = child(i);
+      Tensor temp;
+      if(childPtr->grad())
+        graph()->tensor(temp, childPtr->shape());
+      else
+        childPtr->set_zero_adjoint();
+      deconcatenees.push_back(temp ? temp : childPtr->grad());
+      temps.push_back(temp);
+    }
+    Deconcatenate(deconcatenees, adj_, ax_);
+
+    for(int i = 0; i < children_.size(); ++i) {
+      if(temps[i]) {
+        Element(_1 += _2, child(i)->grad(), temps[i]);
+        graph()->free(temps[i]);
+      }
+    }
+  }
+
 }
@@ -49,6 +49,15 @@ struct ConstantNode : public Node {
   virtual size_t allocate();
   virtual void init();
 
+  virtual void reset() {
+    Node::reset();
+    initialized_ = false;
+  }
+
+  void setInit(std::function<void(Tensor)> init) {
+    init_ = init;
+  }
+
   const std::string type() {
     return "const";
   }
@@ -89,6 +98,9 @@ struct ParamNode : public Node {
 
   virtual void init();
 
+  // the value lives with the parameters, not in the workspace
+  virtual void reset() { }
+
   const std::string type() {
     return "param";
   }
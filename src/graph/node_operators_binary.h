@@ -28,6 +28,16 @@ struct DotNodeOp : public NaryNodeOp {
   }
 
   NodeOps forwardOps() {
+#ifndef CUDA_FOUND
+    // C = A*B with the int8 weights of a quantized model
+    if(child(1)->int8())
+      return {
+        NodeOp(ProdInt8(getCublasHandle(),
+                        val_,
+                        child(0)->val(),
+                        *child(1)->int8()))
+      };
+#endif
     // C = A*B
     return {
       NodeOp(Prod(getCublasHandle(),
@@ -306,7 +316,15 @@ struct ConcatenateNodeOp : public NaryNodeOp {
   ConcatenateNodeOp(const std::vector<Expr>& nodes, Args ...args)
     : NaryNodeOp(nodes,
                  keywords::shape=newShape(nodes, keywords::Get(keywords::axis, 0, args...)),
-                 args...), ax_(keywords::Get(keywords::axis, 0, args...)) { }
+                 args...), ax_(keywords::Get(keywords::axis, 0, args...)) {
+    // quantized matrices side by side stay quantized
+    if(ax_ == 1 && nodes.front()->int8()) {
+      std::vector<Ptr<Int8Weights>> weights;
+      for(auto child : nodes)
+        weights.push_back(child->int8());
+      setInt8(Int8Weights::concatenate(weights));
+    }
+  }
 
   Shape newShape(const std::vector<Expr>& nodes, int ax) {
     Shape shape = nodes.back()->shape();
@@ -324,15 +342,7 @@ struct ConcatenateNodeOp : public NaryNodeOp {
     Concatenate(val_, concatenees, ax_);
   }
 
-  void backward() {
-    std::vector<Tensor> deconcatenees;
-    for(int i = 0; i < children_.size(); ++i) {
-      auto childPtr = child(i);
-      childPtr->set_zero_adjoint(); // @TODO: this is a hotfix, do this properly
-      deconcatenees.push_back(childPtr->grad());
-    }
-    Deconcatenate(deconcatenees, adj_, ax_);
-  }
+  void backward();
 
   virtual size_t hash() {
     size_t seed = NaryNodeOp::hash();
@@ -401,6 +411,18 @@ struct AffineNodeOp : public NaryNodeOp {
   }
 
   NodeOps forwardOps() {
+#ifndef CUDA_FOUND
+    if(child(1)->int8())
+      return {
+        NodeOp(
+          ProdInt8(getCublasHandle(),
+                   val_,
+                   child(0)->val(),
+                   *child(1)->int8());
+          Add(_1, val_, child(2)->val());
+        )
+      };
+#endif
     return {
       NodeOp(
         Prod(getCublasHandle(),
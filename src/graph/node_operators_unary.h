@@ -4,7 +4,9 @@
 #include "tensors/tensor.h"
 #include "kernels/tensor_operators.h"
 #include "kernels/thrust_functions.h"
+#ifdef CUDA_FOUND
 #include "kernels/sparse.h"
+#endif
 
 namespace marian {
 
@@ -587,9 +589,12 @@ struct RowsNodeOp : public UnaryNodeOp {
 
   template <class ...Args>
   Shape newShape(Expr a, const std::vector<size_t>& indeces) {
-    Shape shape = a->shape();
-    shape.set(0, indeces.size());
-    return shape;
+    // rows of a tensor with more dimensions are taken from its flat matrix
+    return {(int)indeces.size(), a->shape()[1]};
+  }
+
+  void setIndices(const std::vector<size_t>& indeces) {
+    indeces_ = indeces;
   }
 
   const std::string type() {
@@ -619,6 +624,8 @@ struct ColsNodeOp : public UnaryNodeOp {
   ColsNodeOp(Expr a, const std::vector<size_t>& indeces, Args ...args)
     : UnaryNodeOp(a, keywords::shape=newShape(a, indeces), args...),
       indeces_(indeces) {
+    if(a->int8())
+      setInt8(a->int8()->select(indeces));
   }
 
   NodeOps forwardOps() {
@@ -720,6 +727,7 @@ public:
     
   size_t allocate() { return 0; }
   void free() {}
+  bool isView() { return true; }
 
   void forward() {}
   void backward() {}
@@ -784,6 +792,7 @@ public:
 
   size_t allocate() { return 0; }
   void free() {}
+  bool isView() { return true; }
 
   void forward() {}
   void backward() {}
@@ -870,6 +879,7 @@ struct ShiftNodeOp : public UnaryNodeOp {
   Shape shift_;
 };
 
+#ifdef CUDA_FOUND
 struct LexicalProbNodeOp : public NaryNodeOp {
   template <typename ...Args>
   LexicalProbNodeOp(Expr logits, Expr att, float eps, Ptr<sparse::CSR> lf, Args ...args)
@@ -912,5 +922,6 @@ struct LexicalProbNodeOp : public NaryNodeOp {
   float eps_;
   Ptr<sparse::CSR> lf_;
 };
+#endif
 
 }
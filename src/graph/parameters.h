@@ -66,7 +66,15 @@ class Parameters {
 
     void allocateForward() {
       if(vals_->capacity() == 0) {
-        vals_->reserveExact(totalSize());
+        // values of memory-mapped models are already set
+        size_t missing = 0;
+        for(auto p: params_)
+          if(!p->val())
+            missing += p->shape().elements();
+        if(missing == 0)
+          return;
+
+        vals_->reserveExact(missing);
         for(auto p: params_)
           if(!p->val())
             vals_->allocate(p->val(), p->shape());
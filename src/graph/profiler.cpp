@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "common/logging.h"
+#include "graph/profiler.h"
+#include "kernels/backend.h"
+
+#ifdef CUDA_FOUND
+#include <cuda_runtime.h>
+#endif
+
+namespace marian {
+
+namespace {
+
+const char* phaseName(Profiler::Phase phase) {
+  switch(phase) {
+    case Profiler::Allocate: return "allocate";
+    case Profiler::Forward: return "forward";
+    default: return "backward";
+  }
+}
+
+std::string parameterScope(const std::string& name) {
+  size_t pos = name.rfind('_');
+  return pos == std::string::npos || pos == 0 ? name : name.substr(0, pos);
+}
+
+}
+
+Profiler::Profiler(const std::string& prefix, size_t device)
+  : prefix_(prefix), device_(device), start_(Clock::now()) {}
+
+Profiler::Clock::time_point Profiler::now() {
+  cudaStreamSynchronize(0);
+  return Clock::now();
+}
+
+void Profiler::beginPass() {
+  records_.clear();
+  positions_.clear();
+}
+
+size_t Profiler::record(Expr node) {
+  auto it = positions_.find(node.get());
+  if(it != positions_.end())
+    return it->second;
+
+  Record r;
+  r.id = node->getId();
+  r.type = node->type();
+  r.label = node->label();
+  r.form = node->form();
+  r.color = node->color();
+  r.bytes = node->shape().elements() * sizeof(float);
+
+  std::string childScope;
+  for(auto& child : node->children()) {
+    auto c = positions_.find(child.get());
+    if(c == positions_.end())
+      continue;
+    r.children.push_back(c->second);
+
+    const Record& cr = records_[c->second];
+    if(r.scope.empty() && cr.type == "param")
+      r.scope = cr.scope;
+    if(childScope.empty())
+      childScope = cr.scope;
+  }
+  if(r.type == "param")
+    r.scope = parameterScope(node->name());
+  else if(r.scope.empty())
+    r.scope = childScope;
+
+  positions_[node.get()] = records_.size();
+  records_.push_back(r);
+  return records_.size() - 1;
+}
+
+void Profiler::add(Expr node,
+                   Phase phase,
+                   Clock::time_point begin,
+                   Clock::time_point end) {
+  Record& r = records_[record(node)];
+
+  double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+  r.time[phase] += ms;
+
+  for(Total* total : {&byType_[r.type], &byScope_[r.scope]}) {
+    total->time[phase] += ms;
+    if(phase == Forward) {
+      total->calls++;
+      total->bytes += r.bytes;
+    }
+  }
+
+  if(events_.size() < MAX_EVENTS) {
+    double us = std::chrono::duration<double, std::micro>(begin - start_).count();
+    events_.push_back({r.id, r.type, r.scope, phase, us, ms * 1000});
+  }
+}
+
+void Profiler::writeTable(const std::string& file) {
+  std::ofstream out(file);
+
+  auto table = [&out](const std::string& title,
+                      const std::map<std::string, Total>& totals) {
+    typedef std::pair<std::string, Total> Row;
+    std::vector<Row> rows(totals.begin(), totals.end());
+
+    auto sum = [](const Total& t) { return t.time[0] + t.time[1] + t.time[2]; };
+    std::sort(rows.begin(), rows.end(), [&sum](const Row& a, const Row& b) {
+      return sum(a.second) > sum(b.second);
+    });
+
+    double all = 0;
+    for(auto& row : rows)
+      all += sum(row.second);
+
+    out << std::left << std::setw(32) << title << std::right
+        << std::setw(10) << "calls" << std::setw(12) << "MB"
+        << std::setw(12) << "alloc ms" << std::setw(12) << "fwd ms"
+        << std::setw(12) << "bwd ms" << std::setw(12) << "total ms"
+        << std::setw(8) << "%" << std::endl;
+
+    out << std::fixed << std::setprecision(2);
+    for(auto& row : rows) {
+      const Total& t = row.second;
+      out << std::left << std::setw(32) << (row.first.empty() ? "-" : row.first)
+          << std::right << std::setw(10) << t.calls
+          << std::setw(12) << t.bytes / (1024. * 1024.)
+          << std::setw(12) << t.time[Allocate] << std::setw(12) << t.time[Forward]
+          << std::setw(12) << t.time[Backward] << std::setw(12) << sum(t)
+          << std::setw(8) << (all > 0 ? 100 * sum(t) / all : 0) << std::endl;
+    }
+    out << std::endl;
+  };
+
+  table("type", byType_);
+  table("scope", byScope_);
+}
+
+void Profiler::writeTrace(const std::string& file) {
+  std::ofstream out(file);
+  out << "{\"traceEvents\":[" << std::endl;
+  out << std::fixed << std::setprecision(3);
+  for(size_t i = 0; i < events_.size(); ++i) {
+    const Event& e = events_[i];
+    out << "{\"name\":\"" << e.type << "\",\"cat\":\"" << phaseName(e.phase)
+        << "\",\"ph\":\"X\",\"pid\":" << device_ << ",\"tid\":0"
+        << ",\"ts\":" << e.begin << ",\"dur\":" << e.duration
+        << ",\"args\":{\"node\":" << e.id << ",\"scope\":\"" << e.scope << "\"}}"
+        << (i + 1 < events_.size() ? "," : "") << std::endl;
+  }
+  out << "]}" << std::endl;
+}
+
+std::string Profiler::graphviz() {
+  std::stringstream ss;
+  ss << "digraph ExpressionGraph {" << std::endl;
+  ss << "rankdir=LR" << std::endl;
+
+  ss << std::fixed << std::setprecision(3);
+  for(auto r = records_.rbegin(); r != records_.rend(); ++r) {
+    // labels are html-like, <...>, append a line with the measurements
+    std::string label = r->label.substr(0, r->label.size() - 1);
+    ss << "\"" << r->id << "\" [shape=\"" << r->form << "\", label=" << label
+       << "<br/>" << r->time[Forward] << " / " << r->time[Backward] << " ms, "
+       << r->bytes << " B>, style=\"filled\", fillcolor=\"" << r->color << "\"]"
+       << std::endl;
+    for(auto c : r->children)
+      ss << "\"" << records_[c].id << "\" -> \"" << r->id << "\"" << std::endl;
+    ss << std::endl;
+  }
+
+  ss << "}" << std::endl;
+  return ss.str();
+}
+
+void Profiler::write() {
+  writeTable(prefix_ + ".txt");
+  writeTrace(prefix_ + ".json");
+
+  std::ofstream dot(prefix_ + ".dot");
+  dot << graphviz();
+
+  LOG(info, "Profile of device {} written to {}.{{txt,json,dot}}", device_, prefix_);
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/definitions.h"
+#include "graph/chainable.h"
+
+namespace marian {
+
+/**
+ * @brief Times the nodes of an expression graph, see ExpressionGraph::setProfiler().
+ *
+ * Each allocate()/init(), forward() and backward() call of a node is timed
+ * with the device synchronized before and after, so the times include the
+ * kernels the call launched. Times are summed by node type and by scope.
+ * The scope of a parameter is its name without the last component, e.g.
+ * "decoder_ff_logit_l2" for "decoder_ff_logit_l2_W". Any other node takes
+ * the scope of its first parameter child, or else of its first child.
+ *
+ * write() stores
+ * - <prefix>.txt: the totals by type and by scope, sorted by time;
+ * - <prefix>.json: the calls as Chrome trace events (chrome://tracing);
+ * - <prefix>.dot: the last pass in graphviz() form, with the times and value
+ *   sizes of every node.
+ */
+class Profiler {
+  public:
+    enum Phase { Allocate, Forward, Backward };
+
+    typedef std::chrono::steady_clock Clock;
+
+  private:
+    struct Total {
+      size_t calls{0};
+      size_t bytes{0};
+      double time[3]{0, 0, 0};
+    };
+
+    struct Record {
+      size_t id;
+      std::string type;
+      std::string scope;
+      std::string label;
+      std::string form;
+      std::string color;
+      std::vector<size_t> children;
+      size_t bytes{0};
+      double time[3]{0, 0, 0};
+    };
+
+    struct Event {
+      size_t id;
+      std::string type;
+      std::string scope;
+      Phase phase;
+      double begin;
+      double duration;
+    };
+
+    // trace events are kept for the first passes only
+    static const size_t MAX_EVENTS = 200000;
+
+    std::string prefix_;
+    size_t device_;
+    Clock::time_point start_;
+
+    std::map<std::string, Total> byType_;
+    std::map<std::string, Total> byScope_;
+
+    // nodes of the current pass in execution order and their positions
+    std::vector<Record> records_;
+    std::unordered_map<const void*, size_t> positions_;
+    std::vector<Event> events_;
+
+    size_t record(Expr node);
+    void add(Expr node, Phase phase, Clock::time_point begin, Clock::time_point end);
+
+    void writeTable(const std::string& file);
+    void writeTrace(const std::string& file);
+
+  public:
+    Profiler(const std::string& prefix, size_t device);
+
+    /** @brief Current time after the device has finished its work */
+    Clock::time_point now();
+
+    /** @brief Starts a new pass, the records of the previous one are dropped */
+    void beginPass();
+
+    /** @brief Runs op, which executes the given phase of node, and times it */
+    template <class Op>
+    void time(Expr node, Phase phase, const Op& op) {
+      auto begin = now();
+      op();
+      add(node, phase, begin, now());
+    }
+
+    /** @brief The last pass in the format of ExpressionGraph::graphviz() */
+    std::string graphviz();
+
+    void write();
+};
+
+}
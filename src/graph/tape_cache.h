@@ -0,0 +1,87 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "common/definitions.h"
+#include "data/corpus.h"
+#include "graph/chainable.h"
+
+namespace marian {
+
+/** Refills a batch input of a replayed graph, e.g. the indices of a rows() node */
+typedef std::function<void(Expr, Ptr<data::CorpusBatch>)> InputBinding;
+
+/**
+ * @brief A recorded forward/backward pass that can be run again for another
+ * batch of the same shape.
+ *
+ * The tape keeps the nodes alive between passes. Since forward() and
+ * backward() clear the children of the nodes they have executed, the edges
+ * are stored separately as positions on the tape.
+ */
+struct RecordedTape {
+  std::vector<Expr> nodes;
+  std::vector<std::vector<size_t>> children;
+  // number of view nodes on the tape that hold a reference to each node
+  std::vector<long> views;
+  std::vector<std::pair<size_t, InputBinding>> inputs;
+  size_t top{0};
+};
+
+/**
+ * @brief Recorded tapes by batch shape, i.e. batch size and the width of each
+ * sub-batch, least recently used ones are dropped first.
+ */
+class TapeCache {
+  private:
+    typedef std::vector<size_t> Key;
+    typedef std::list<std::pair<Key, Ptr<RecordedTape>>> Tapes;
+
+    size_t capacity_;
+    Tapes tapes_;
+    std::map<Key, Tapes::iterator> index_;
+
+    static Key key(Ptr<data::CorpusBatch> batch) {
+      Key key{batch->size()};
+      for(size_t i = 0; i < batch->sets(); ++i)
+        key.push_back((*batch)[i]->batchWidth());
+      return key;
+    }
+
+  public:
+    TapeCache(size_t capacity) : capacity_(capacity) {}
+
+    Ptr<RecordedTape> get(Ptr<data::CorpusBatch> batch) {
+      auto it = index_.find(key(batch));
+      if(it == index_.end())
+        return nullptr;
+      tapes_.splice(tapes_.begin(), tapes_, it->second);
+      return it->second->second;
+    }
+
+    void put(Ptr<data::CorpusBatch> batch, Ptr<RecordedTape> tape) {
+      Key k = key(batch);
+      auto it = index_.find(k);
+      if(it != index_.end()) {
+        tapes_.erase(it->second);
+        index_.erase(it);
+      }
+
+      tapes_.emplace_front(k, tape);
+      index_[k] = tapes_.begin();
+
+      if(tapes_.size() > capacity_) {
+        index_.erase(tapes_.back().first);
+        tapes_.pop_back();
+      }
+    }
+
+    size_t size() const {
+      return tapes_.size();
+    }
+};
+
+}
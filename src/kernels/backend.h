@@ -0,0 +1,37 @@
+#pragma once
+
+// Handle types of the compute backend. With CUDA_FOUND these are the
+// cuBLAS/cuRAND/CUDA runtime types, the CPU build replaces them with host
+// stand-ins so that graph, translator and training code compile unchanged.
+
+#ifdef CUDA_FOUND
+
+#include <cuda.h>
+#include <cublas_v2.h>
+#include <curand.h>
+
+#else
+
+#include <random>
+
+namespace marian {
+namespace cpu {
+class BlasHandle;
+}
+}
+
+typedef marian::cpu::BlasHandle* cublasHandle_t;
+typedef void* cudaStream_t;
+typedef std::mt19937* curandGenerator_t;
+
+// Host memory is shared by all threads and every kernel is synchronous,
+// so device selection and stream synchronization are no-ops.
+inline int cudaSetDevice(size_t) {
+  return 0;
+}
+
+inline int cudaStreamSynchronize(cudaStream_t) {
+  return 0;
+}
+
+#endif
@@ -1,8 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <cuda.h>
-#include <curand.h>
 
+#include "kernels/backend.h"
 #include "tensors/tensor.h"
 
 namespace marian {
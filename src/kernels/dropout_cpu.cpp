@@ -0,0 +1,23 @@
+#include <random>
+
+#include "kernels/dropout.h"
+
+namespace marian {
+
+curandGenerator_t createCurandGenerator(size_t device,
+                                        size_t seed) {
+  return new std::mt19937(seed);
+}
+
+void Dropout(Tensor tensor, float p,
+             curandGenerator_t gen) {
+  std::uniform_real_distribution<float> dist(0.f, 1.f);
+
+  float keep = 1.f - p;
+  float* data = tensor->data();
+  int n = tensor->size();
+  for(int i = 0; i < n; ++i)
+    data[i] = (dist(*gen) < keep) / keep;
+}
+
+}
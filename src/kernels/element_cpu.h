@@ -0,0 +1,408 @@
+#pragma once
+
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "kernels/parallel_cpu.h"
+#include "tensors/tensor.h"
+
+namespace marian {
+namespace cpu {
+
+/**
+ * Fast paths of the host Element, Add, Reduce and Pick kernels.
+ *
+ * A tensor is laid out in memory as a matrix with shape[1] columns and one
+ * row per combination of the other dimensions. Within the iteration space of
+ * a kernel an operand either has all of its rows or a single row broadcast
+ * over them, and either all of its columns or a single value broadcast along
+ * each row. This covers same-shape, row-broadcast (e.g. a bias), column-
+ * broadcast (e.g. a mask or a per-row scalar) and scalar operands. Whether an
+ * operand is read contiguously or as a broadcast value is a template argument
+ * of the inner loops, which are then plain loops over a row that the
+ * compiler vectorizes. Large iteration spaces are split into blocks of rows
+ * or columns run by workers().
+ *
+ * The functions return false for other broadcasting patterns, those are left
+ * to the generic per-element loops in tensor_operators_cpu.h.
+ */
+
+// Smallest block worth handing to another thread
+const size_t MIN_ELEMENTS_PER_TASK = 1 << 15;
+
+struct Operand {
+  float* data;
+  int rowStride;    // 0 if a single row is broadcast over all rows
+  bool contiguous;  // one value per column, otherwise one per row
+};
+
+struct Range {
+  int rowBegin, rowEnd;
+  int colBegin, colEnd;
+};
+
+/** Reads an operand along a row, contiguously or as a broadcast value */
+template <bool Contiguous>
+struct Lane;
+
+template <>
+struct Lane<true> {
+  const float* p;
+  Lane(const Operand& op, int row) : p(op.data + row * op.rowStride) {}
+  const float& operator[](int j) const { return p[j]; }
+};
+
+template <>
+struct Lane<false> {
+  float v;
+  Lane(const Operand& op, int row) : v(op.data[row * op.rowStride]) {}
+  const float& operator[](int) const { return v; }
+};
+
+template <int... I>
+struct Indices {};
+
+template <int N, int... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct MakeIndices<0, I...> {
+  typedef Indices<I...> type;
+};
+
+/**
+ * The iteration space spanned by a list of tensors and their operands in it.
+ * Operand 0 is the output. If every operand has either the full shape or a
+ * single element, the space is a single row of all elements.
+ */
+template <int N>
+struct Layout {
+  Shape full;
+  int rows, cols;
+  Operand ops[N];
+  bool supported;
+
+  Layout(const Tensor (&tensors)[N], bool flatten = true) : supported(true) {
+    full = tensors[0]->shape();
+    for(int k = 1; k < N; ++k)
+      for(int i = 0; i < full.size(); ++i)
+        full.set(i, std::max(full[i], tensors[k]->shape()[i]));
+
+    bool allSameOrScalar = true;
+    bool allRows[N], allCols[N];
+    for(int k = 0; k < N; ++k) {
+      const Shape& shape = tensors[k]->shape();
+      allRows[k] = shape[0] == full[0] && shape[2] == full[2] && shape[3] == full[3];
+      allCols[k] = shape[1] == full[1];
+      bool oneRow = shape[0] == 1 && shape[2] == 1 && shape[3] == 1;
+      bool oneCol = shape[1] == 1;
+      supported &= (allRows[k] || oneRow) && (allCols[k] || oneCol);
+      allSameOrScalar &= (allRows[k] && allCols[k]) || (oneRow && oneCol);
+    }
+
+    rows = full[0] * full[2] * full[3];
+    cols = full[1];
+    bool flat = flatten && allSameOrScalar;
+    if(flat) {
+      cols *= rows;
+      rows = 1;
+    }
+
+    for(int k = 0; k < N; ++k) {
+      ops[k].data = tensors[k]->data();
+      ops[k].rowStride = allRows[k] ? tensors[k]->shape()[1] : 0;
+      ops[k].contiguous = flat ? allRows[k] && allCols[k] : allCols[k];
+    }
+  }
+};
+
+/**
+ * Calls loop.run<C...>(range) with C[k] set to ops[k].contiguous for the
+ * N inputs of the loop.
+ */
+template <class Loop, int N, bool... C>
+struct Dispatch {
+  static void run(const Loop& loop, const Range& range) {
+    next(loop, range, std::integral_constant<bool, sizeof...(C) == N>());
+  }
+
+  static void next(const Loop& loop, const Range& range, std::true_type) {
+    loop.template run<C...>(range, typename MakeIndices<N>::type());
+  }
+
+  static void next(const Loop& loop, const Range& range, std::false_type) {
+    if(loop.ops[sizeof...(C)].contiguous)
+      Dispatch<Loop, N, C..., true>::run(loop, range);
+    else
+      Dispatch<Loop, N, C..., false>::run(loop, range);
+  }
+};
+
+/**
+ * Splits rows x cols into blocks for the available threads, by rows if
+ * allowed and there are enough of them, otherwise by columns, and calls
+ * Loop::run on each.
+ */
+template <class Loop, int N>
+void forBlocks(const Loop& loop, int rows, int cols,
+               bool splitRows = true, bool splitCols = true) {
+  size_t elements = (size_t)rows * cols;
+  size_t tasks = std::min(numThreads(), elements / MIN_ELEMENTS_PER_TASK);
+
+  if(tasks > 1 && splitRows && (rows >= (int)tasks || !splitCols)) {
+    int step = (rows + tasks - 1) / tasks;
+    parallelTasks((rows + step - 1) / step, [&](size_t t) {
+      int begin = t * step;
+      Dispatch<Loop, N>::run(loop, {begin, std::min(rows, begin + step), 0, cols});
+    });
+  } else if(tasks > 1 && splitCols) {
+    // whole cache lines per block
+    int step = ((cols + tasks - 1) / tasks + 15) / 16 * 16;
+    parallelTasks((cols + step - 1) / step, [&](size_t t) {
+      int begin = t * step;
+      Dispatch<Loop, N>::run(loop, {0, rows, begin, std::min(cols, begin + step)});
+    });
+  } else {
+    Dispatch<Loop, N>::run(loop, {0, rows, 0, cols});
+  }
+}
+
+/** out = f(out, in...) */
+template <class Functor>
+struct ElementLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    // local copies, stores through the output pointer could alias members
+    Functor f = functor;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      float* o = out.data + i * out.rowStride;
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      for(int j = r.colBegin; j < r.colEnd; ++j)
+        o[j] = f(o[j], std::get<I>(in)[j]...);
+    }
+  }
+};
+
+/** out += f(in...) * scale with out spanning the iteration space */
+template <class Functor>
+struct AddLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+  float scale;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    Functor f = functor;
+    float s = scale;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      float* o = out.data + i * out.rowStride;
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      for(int j = r.colBegin; j < r.colEnd; ++j)
+        o[j] += f(std::get<I>(in)[j]...) * s;
+    }
+  }
+};
+
+/** out += sum over rows of f(in...) * scale, out is a single row */
+template <class Functor>
+struct AddRowsLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+  float scale;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    Functor f = functor;
+    float s = scale;
+    std::vector<float> sums(r.colEnd - r.colBegin, 0.f);
+    float* sum = sums.data() - r.colBegin;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      for(int j = r.colBegin; j < r.colEnd; ++j)
+        sum[j] += f(std::get<I>(in)[j]...);
+    }
+    for(int j = r.colBegin; j < r.colEnd; ++j)
+      if(sum[j])
+        out.data[j] += sum[j] * s;
+  }
+};
+
+/** out += sum over columns of f(in...) * scale, out has one value per row */
+template <class Functor>
+struct AddColsLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+  float scale;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    Functor f = functor;
+    float s = scale;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      float sum = 0;
+      for(int j = r.colBegin; j < r.colEnd; ++j)
+        sum += f(std::get<I>(in)[j]...);
+      if(sum)
+        out.data[i * out.rowStride] += sum * s;
+    }
+  }
+};
+
+/** out += sum of all f(in...) * scale, out is a single element */
+template <class Functor>
+struct AddAllLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+  float scale;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    Functor f = functor;
+    float s = scale;
+    float sum = 0;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      for(int j = r.colBegin; j < r.colEnd; ++j)
+        sum += f(std::get<I>(in)[j]...);
+    }
+    if(sum)
+      out.data[0] += sum * s;
+  }
+};
+
+/**
+ * out = f(out, in..., picked) where picked is 1 in the column given
+ * by picks for the row's index in dimension 0 and 0 elsewhere
+ */
+template <class Functor>
+struct PickLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+  const float* picks;
+  int dim0;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    Functor f = functor;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      float* o = out.data + i * out.rowStride;
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      int pick = (int)picks[i % dim0];
+      for(int j = r.colBegin; j < r.colEnd; ++j) {
+        float picked = j == pick;
+        o[j] = f(o[j], std::get<I>(in)[j]..., picked);
+      }
+    }
+  }
+};
+
+/** out += sum over columns of f(in, picked), out has one value per row */
+template <class Functor>
+struct PickReduceLoop {
+  Functor functor;
+  Operand out;
+  const Operand* ops;
+  const float* picks;
+  int dim0;
+
+  template <bool... C, int... I>
+  void run(const Range& r, Indices<I...>) const {
+    Functor f = functor;
+    for(int i = r.rowBegin; i < r.rowEnd; ++i) {
+      std::tuple<Lane<C>...> in{Lane<C>(ops[I], i)...};
+      int pick = (int)picks[i % dim0];
+      float sum = 0;
+      for(int j = r.colBegin; j < r.colEnd; ++j) {
+        float picked = j == pick;
+        sum += f(std::get<I>(in)[j]..., picked);
+      }
+      out.data[i * out.rowStride] += sum;
+    }
+  }
+};
+
+template <class Functor, class... Tensors>
+bool element(Functor functor, Tensor out, Tensors... tensors) {
+  const int N = sizeof...(Tensors);
+  Layout<N + 1> layout({out, tensors...});
+  // inputs are broadcast to the output, which must span the iteration space
+  if(!layout.supported || layout.full != out->shape())
+    return false;
+
+  ElementLoop<Functor> loop{functor, layout.ops[0], layout.ops + 1};
+  forBlocks<decltype(loop), N>(loop, layout.rows, layout.cols);
+  return true;
+}
+
+template <class Functor, class... Tensors>
+bool add(Functor functor, float scale, Tensor out, Tensors... tensors) {
+  const int N = sizeof...(Tensors);
+  Layout<N + 1> layout({out, tensors...});
+  if(!layout.supported)
+    return false;
+
+  const Operand& o = layout.ops[0];
+  const Operand* in = layout.ops + 1;
+  bool sumRows = o.rowStride == 0 && layout.rows > 1;
+  bool sumCols = !o.contiguous && layout.cols > 1;
+
+  if(sumRows && sumCols) {
+    AddAllLoop<Functor> loop{functor, o, in, scale};
+    forBlocks<decltype(loop), N>(loop, layout.rows, layout.cols, false, false);
+  } else if(sumRows) {
+    // each column is summed by one thread in row order
+    AddRowsLoop<Functor> loop{functor, o, in, scale};
+    forBlocks<decltype(loop), N>(loop, layout.rows, layout.cols, false, true);
+  } else if(sumCols) {
+    AddColsLoop<Functor> loop{functor, o, in, scale};
+    forBlocks<decltype(loop), N>(loop, layout.rows, layout.cols, true, false);
+  } else {
+    AddLoop<Functor> loop{functor, o, in, scale};
+    forBlocks<decltype(loop), N>(loop, layout.rows, layout.cols);
+  }
+  return true;
+}
+
+template <class Functor, class... Tensors>
+bool pick(Functor functor, Tensor out, Tensor picks, Tensors... tensors) {
+  const int N = sizeof...(Tensors);
+  // rows have to stay apart to find their pick
+  Layout<N + 1> layout({out, tensors...}, false);
+  if(!layout.supported || layout.full != out->shape())
+    return false;
+
+  PickLoop<Functor> loop{functor, layout.ops[0], layout.ops + 1,
+                         picks->data(), out->shape()[0]};
+  forBlocks<decltype(loop), N>(loop, layout.rows, layout.cols);
+  return true;
+}
+
+/** PickReduce for an output with one value per row, e.g. a cross-entropy */
+template <class Functor>
+bool pickReduce(Functor functor, Tensor out, Tensor in, Tensor picks) {
+  Layout<2> layout({out, in}, false);
+  const Operand& o = layout.ops[0];
+  if(!layout.supported || layout.full != in->shape()
+     || o.rowStride == 0 || o.contiguous)
+    return false;
+
+  PickReduceLoop<Functor> loop{functor, o, layout.ops + 1,
+                               picks->data(), in->shape()[0]};
+  forBlocks<decltype(loop), 1>(loop, layout.rows, layout.cols, true, false);
+  return true;
+}
+
+}
+}
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MARIAN_GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+#include "kernels/gemm_cpu.h"
+#include "kernels/parallel_cpu.h"
+#include "kernels/simd_cpu.h"
+
+namespace marian {
+namespace cpu {
+
+BlasHandle::BlasHandle(size_t threads)
+  : threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+namespace {
+
+// Depth of a packed panel, an MC x KC block of A is sized for L2 and a
+// KC x NR sliver of B for L1. MC and NC are multiples of every MR and NR.
+const size_t KC = 256;
+const size_t MC = 144;
+const size_t NC = 3072;
+
+// Products with fewer multiply-adds per thread are not worth the hand-off.
+const size_t MIN_WORK_PER_THREAD = 64 * 64 * 64;
+
+// Multiplies a packed MR x kc panel of A with a packed kc x NR panel of B
+// and adds the tile to C, clipped to mr x nr.
+typedef void (*MicroKernel)(size_t kc, const float* a, const float* b,
+                            float* c, size_t ldc, size_t mr, size_t nr);
+
+struct Kernel {
+  MicroKernel run;
+  size_t MR;
+  size_t NR;
+};
+
+void kernelGeneric(size_t kc, const float* a, const float* b,
+                   float* c, size_t ldc, size_t mr, size_t nr) {
+  const size_t MR = 4, NR = 16;
+  float acc[MR][NR] = {{0}};
+  for(size_t p = 0; p < kc; ++p) {
+    for(size_t i = 0; i < MR; ++i)
+      for(size_t j = 0; j < NR; ++j)
+        acc[i][j] += a[i] * b[j];
+    a += MR;
+    b += NR;
+  }
+  for(size_t i = 0; i < mr; ++i)
+    for(size_t j = 0; j < nr; ++j)
+      c[i * ldc + j] += acc[i][j];
+}
+
+#ifdef MARIAN_GEMM_X86
+
+MARIAN_TARGET_AVX2
+void kernelAvx2(size_t kc, const float* a, const float* b,
+                float* c, size_t ldc, size_t mr, size_t nr) {
+  const size_t MR = 6, NR = 16;
+  __m256 acc0[MR], acc1[MR];
+  for(size_t i = 0; i < MR; ++i) {
+    acc0[i] = _mm256_setzero_ps();
+    acc1[i] = _mm256_setzero_ps();
+  }
+
+  for(size_t p = 0; p < kc; ++p) {
+    __m256 b0 = _mm256_loadu_ps(b);
+    __m256 b1 = _mm256_loadu_ps(b + 8);
+    for(size_t i = 0; i < MR; ++i) {
+      __m256 ai = _mm256_broadcast_ss(a + i);
+      acc0[i] = _mm256_fmadd_ps(ai, b0, acc0[i]);
+      acc1[i] = _mm256_fmadd_ps(ai, b1, acc1[i]);
+    }
+    a += MR;
+    b += NR;
+  }
+
+  if(mr == MR && nr == NR) {
+    for(size_t i = 0; i < MR; ++i) {
+      float* ci = c + i * ldc;
+      _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), acc0[i]));
+      _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), acc1[i]));
+    }
+  }
+  else {
+    float tile[MR * NR];
+    for(size_t i = 0; i < MR; ++i) {
+      _mm256_storeu_ps(tile + i * NR, acc0[i]);
+      _mm256_storeu_ps(tile + i * NR + 8, acc1[i]);
+    }
+    for(size_t i = 0; i < mr; ++i)
+      for(size_t j = 0; j < nr; ++j)
+        c[i * ldc + j] += tile[i * NR + j];
+  }
+}
+
+MARIAN_TARGET_AVX512
+void kernelAvx512(size_t kc, const float* a, const float* b,
+                  float* c, size_t ldc, size_t mr, size_t nr) {
+  const size_t MR = 8, NR = 32;
+  __m512 acc0[MR], acc1[MR];
+  for(size_t i = 0; i < MR; ++i) {
+    acc0[i] = _mm512_setzero_ps();
+    acc1[i] = _mm512_setzero_ps();
+  }
+
+  for(size_t p = 0; p < kc; ++p) {
+    __m512 b0 = _mm512_loadu_ps(b);
+    __m512 b1 = _mm512_loadu_ps(b + 16);
+    for(size_t i = 0; i < MR; ++i) {
+      __m512 ai = _mm512_set1_ps(a[i]);
+      acc0[i] = _mm512_fmadd_ps(ai, b0, acc0[i]);
+      acc1[i] = _mm512_fmadd_ps(ai, b1, acc1[i]);
+    }
+    a += MR;
+    b += NR;
+  }
+
+  if(mr == MR && nr == NR) {
+    for(size_t i = 0; i < MR; ++i) {
+      float* ci = c + i * ldc;
+      _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), acc0[i]));
+      _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), acc1[i]));
+    }
+  }
+  else {
+    float tile[MR * NR];
+    for(size_t i = 0; i < MR; ++i) {
+      _mm512_storeu_ps(tile + i * NR, acc0[i]);
+      _mm512_storeu_ps(tile + i * NR + 16, acc1[i]);
+    }
+    for(size_t i = 0; i < mr; ++i)
+      for(size_t j = 0; j < nr; ++j)
+        c[i * ldc + j] += tile[i * NR + j];
+  }
+}
+
+#endif
+
+Kernel selectKernel() {
+#ifdef MARIAN_GEMM_X86
+  switch(isa()) {
+    case Isa::Avx512: return {kernelAvx512, 8, 32};
+    case Isa::Avx2:   return {kernelAvx2, 6, 16};
+    default:          break;
+  }
+#endif
+  return {kernelGeneric, 4, 16};
+}
+
+const Kernel& kernel() {
+  static const Kernel k = selectKernel();
+  return k;
+}
+
+// Packs rows [i0, i0 + mc) and columns [p0, p0 + kc) of alpha * op(A) into
+// panels of MR rows stored column by column, padding the last panel with 0.
+void packA(const Kernel& K, bool trans, const float* A, size_t lda,
+           size_t i0, size_t p0, size_t mc, size_t kc, float alpha,
+           float* buf) {
+  for(size_t ir = 0; ir < mc; ir += K.MR) {
+    size_t mr = std::min(K.MR, mc - ir);
+    for(size_t p = 0; p < kc; ++p) {
+      size_t col = p0 + p;
+      for(size_t i = 0; i < mr; ++i) {
+        size_t row = i0 + ir + i;
+        buf[i] = alpha * (trans ? A[col * lda + row] : A[row * lda + col]);
+      }
+      std::fill(buf + mr, buf + K.MR, 0.f);
+      buf += K.MR;
+    }
+  }
+}
+
+// Packs rows [p0, p0 + kc) and columns [j0, j0 + nc) of op(B) into panels
+// of NR columns stored row by row, padding the last panel with 0.
+void packB(const Kernel& K, bool trans, const float* B, size_t ldb,
+           size_t p0, size_t j0, size_t kc, size_t nc, float* buf) {
+  for(size_t jr = 0; jr < nc; jr += K.NR) {
+    size_t nr = std::min(K.NR, nc - jr);
+    if(trans) {
+      for(size_t j = 0; j < nr; ++j) {
+        const float* src = B + (j0 + jr + j) * ldb + p0;
+        for(size_t p = 0; p < kc; ++p)
+          buf[p * K.NR + j] = src[p];
+      }
+      if(nr < K.NR)
+        for(size_t p = 0; p < kc; ++p)
+          std::fill(buf + p * K.NR + nr, buf + (p + 1) * K.NR, 0.f);
+    }
+    else {
+      for(size_t p = 0; p < kc; ++p) {
+        const float* src = B + (p0 + p) * ldb + j0 + jr;
+        std::copy(src, src + nr, buf + p * K.NR);
+        std::fill(buf + p * K.NR + nr, buf + (p + 1) * K.NR, 0.f);
+      }
+    }
+    buf += kc * K.NR;
+  }
+}
+
+// Computes rows [m0, m1) and columns [n0, n1) of C on the calling thread.
+void gemmBlock(bool transA, bool transB,
+               size_t m0, size_t m1, size_t n0, size_t n1, size_t k,
+               float alpha,
+               const float* A, size_t lda,
+               const float* B, size_t ldb,
+               float beta,
+               float* C, size_t ldc) {
+  for(size_t i = m0; i < m1; ++i) {
+    float* ci = C + i * ldc;
+    if(beta == 0)
+      std::fill(ci + n0, ci + n1, 0.f);
+    else if(beta != 1)
+      for(size_t j = n0; j < n1; ++j)
+        ci[j] *= beta;
+  }
+
+  if(k == 0 || alpha == 0)
+    return;
+
+  const Kernel& K = kernel();
+
+  // packing buffers are reused by the long-lived worker threads
+  thread_local std::vector<float> bufA;
+  thread_local std::vector<float> bufB;
+  bufA.resize(MC * KC);
+  bufB.resize(KC * NC);
+
+  for(size_t jc = n0; jc < n1; jc += NC) {
+    size_t nc = std::min(NC, n1 - jc);
+    for(size_t pc = 0; pc < k; pc += KC) {
+      size_t kc = std::min(KC, k - pc);
+      packB(K, transB, B, ldb, pc, jc, kc, nc, bufB.data());
+
+      for(size_t ic = m0; ic < m1; ic += MC) {
+        size_t mc = std::min(MC, m1 - ic);
+        packA(K, transA, A, lda, ic, pc, mc, kc, alpha, bufA.data());
+
+        for(size_t jr = 0; jr < nc; jr += K.NR) {
+          size_t nr = std::min(K.NR, nc - jr);
+          const float* b = bufB.data() + jr * kc;
+          for(size_t ir = 0; ir < mc; ir += K.MR) {
+            size_t mr = std::min(K.MR, mc - ir);
+            const float* a = bufA.data() + ir * kc;
+            K.run(kc, a, b, C + (ic + ir) * ldc + jc + jr, ldc, mr, nr);
+          }
+        }
+      }
+    }
+  }
+}
+
+size_t roundUp(size_t x, size_t multiple) {
+  return (x + multiple - 1) / multiple * multiple;
+}
+
+size_t ceilDiv(size_t x, size_t y) {
+  return (x + y - 1) / y;
+}
+
+}
+
+void Sgemm(BlasHandle* handle,
+           bool transA, bool transB,
+           size_t m, size_t n, size_t k,
+           float alpha,
+           const float* A, size_t lda,
+           const float* B, size_t ldb,
+           float beta,
+           float* C, size_t ldc) {
+  if(m == 0 || n == 0)
+    return;
+
+  const Kernel& K = kernel();
+
+  size_t threads = handle ? handle->threads() : 1;
+  size_t work = m * n * std::max<size_t>(k, 1);
+  threads = std::max<size_t>(1, std::min(threads, work / MIN_WORK_PER_THREAD));
+
+  if(threads == 1 || !workers()) {
+    gemmBlock(transA, transB, 0, m, 0, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+    return;
+  }
+
+  // Pick a tm x tn grid over C that minimizes the largest tile, rows and
+  // columns per tile are rounded to the micro-kernel's MR and NR.
+  size_t tm = 1, tn = 1;
+  size_t bestTile = -1, bestEdge = -1;
+  for(size_t rowParts = 1; rowParts <= threads; ++rowParts) {
+    size_t colParts = threads / rowParts;
+    size_t rows = roundUp(ceilDiv(m, rowParts), K.MR);
+    size_t cols = roundUp(ceilDiv(n, colParts), K.NR);
+    size_t tile = rows * cols;
+    size_t edge = rows + cols;
+    if(tile < bestTile || (tile == bestTile && edge < bestEdge)) {
+      bestTile = tile;
+      bestEdge = edge;
+      tm = rowParts;
+      tn = colParts;
+    }
+  }
+
+  size_t rows = roundUp(ceilDiv(m, tm), K.MR);
+  size_t cols = roundUp(ceilDiv(n, tn), K.NR);
+
+  std::vector<std::pair<size_t, size_t>> tiles;
+  for(size_t i = 0; i < m; i += rows)
+    for(size_t j = 0; j < n; j += cols)
+      tiles.emplace_back(i, j);
+
+  parallelTasks(tiles.size(), [&](size_t t) {
+    size_t i = tiles[t].first, j = tiles[t].second;
+    gemmBlock(transA, transB,
+              i, std::min(m, i + rows), j, std::min(n, j + cols), k,
+              alpha, A, lda, B, ldb, beta, C, ldc);
+  });
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+namespace marian {
+namespace cpu {
+
+/**
+ * State behind the cublasHandle_t of the CPU build: the number of threads a
+ * matrix product may be split over. The threads are taken from the
+ * workers() of the thread that calls Sgemm, see parallel_cpu.h.
+ */
+class BlasHandle {
+  public:
+    /** @param threads number of threads, 0 means one per hardware thread */
+    BlasHandle(size_t threads);
+
+    size_t threads() const {
+      return threads_;
+    }
+
+  private:
+    size_t threads_;
+};
+
+/**
+ * Row-major single precision matrix product
+ * C = alpha * op(A) * op(B) + beta * C, where op(A) is m x k and op(B) is
+ * k x n. As with cuBLAS, C is not read when beta is 0.
+ *
+ * Blocks of A and B are packed into contiguous panels sized for the L2 and L1
+ * caches and multiplied by an AVX-512, AVX2/FMA or portable micro-kernel
+ * chosen at runtime. If a handle is given, C is split into a grid of row and
+ * column ranges that are computed by that many threads.
+ */
+void Sgemm(BlasHandle* handle,
+           bool transA, bool transB,
+           size_t m, size_t n, size_t k,
+           float alpha,
+           const float* A, size_t lda,
+           const float* B, size_t ldb,
+           float beta,
+           float* C, size_t ldc);
+
+}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __CUDACC__
+#include <cuda_fp16.h>
+#endif
+
+namespace marian {
+
+/**
+ * Conversions between float and IEEE 754 half precision (fp16) bits, with
+ * rounding to the nearest even value. Values beyond the fp16 range, 65504,
+ * become infinite, values below 2^-24 become zero.
+ */
+__host__ __device__
+inline uint16_t float2half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+
+  uint16_t h;
+  if(x >= 0x47800000u) {
+    // at least 2^16, infinite or nan
+    h = x > 0x7f800000u ? 0x7e00 : 0x7c00;
+  }
+  else if(x < 0x38800000u) {
+    // below 2^-14, subnormal: adding 0.5 rounds the mantissa into place
+    float t;
+    memcpy(&t, &x, sizeof(t));
+    t += 0.5f;
+    memcpy(&x, &t, sizeof(x));
+    h = x - 0x3f000000u;
+  }
+  else {
+    // rebias the exponent and round to nearest even, an overflow of the
+    // mantissa carries into the exponent and may give infinity
+    uint32_t odd = (x >> 13) & 1;
+    x += 0xc8000fffu + odd;
+    h = x >> 13;
+  }
+  return h | (sign >> 16);
+}
+
+__host__ __device__
+inline float half2float(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+
+  if(exponent == 0) {
+    float f = mantissa * 5.9604644775390625e-8f; // 2^-24
+    return sign ? -f : f;
+  }
+
+  uint32_t x = sign | (mantissa << 13);
+  if(exponent == 31)
+    x |= 0x7f800000u;
+  else
+    x |= (exponent + 112) << 23;
+
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+/** The fp16 value nearest to f, as a float */
+__host__ __device__
+inline float roundToHalf(float f) {
+#ifdef __CUDA_ARCH__
+  return __half2float(__float2half_rn(f));
+#else
+  return half2float(float2half(f));
+#endif
+}
+
+}
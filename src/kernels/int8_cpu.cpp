@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MARIAN_INT8_X86 1
+#include <immintrin.h>
+#define MARIAN_TARGET_AVX512BW __attribute__((target("avx512f,avx512bw")))
+#if defined(__clang__) || __GNUC__ >= 8
+#define MARIAN_INT8_VNNI 1
+#define MARIAN_TARGET_AVX512VNNI __attribute__((target("avx512f,avx512bw,avx512vnni")))
+#endif
+#endif
+
+#include "3rd_party/exception.h"
+#include "kernels/int8_cpu.h"
+#include "kernels/parallel_cpu.h"
+#include "kernels/simd_cpu.h"
+
+namespace marian {
+namespace cpu {
+
+namespace {
+
+// Rows of A per tile, and per block whose int16 values stay in L2 while all
+// columns of B stream past them.
+const size_t MR = 4;
+const size_t MB = 96;
+
+// Products with fewer multiply-adds per thread are not worth the hand-off.
+const size_t MIN_WORK_PER_THREAD = 64 * 64 * 64;
+
+// Sums the products of MR rows of A, lda apart, with NR columns of B over
+// depth k into out[i * NR + j]. The rows of A are int16 values in the int8
+// range or, for kernels with unsignedA, those values plus 128 as uint8.
+typedef void (*TileKernel)(size_t k, const void* a, size_t lda,
+                           const int8_t* const* b, int32_t* out);
+
+struct Kernel {
+  TileKernel run;
+  size_t NR;
+  bool unsignedA;
+};
+
+void tileGeneric(size_t k, const void* a16, size_t lda,
+                 const int8_t* const* b, int32_t* out) {
+  const size_t NR = 2;
+  const int16_t* a = (const int16_t*)a16;
+  for(size_t i = 0; i < MR; ++i)
+    for(size_t j = 0; j < NR; ++j) {
+      int32_t sum = 0;
+      for(size_t p = 0; p < k; ++p)
+        sum += a[i * lda + p] * b[j][p];
+      out[i * NR + j] = sum;
+    }
+}
+
+#ifdef MARIAN_INT8_X86
+
+MARIAN_TARGET_AVX2
+void tileAvx2(size_t k, const void* a16, size_t lda,
+              const int8_t* const* b, int32_t* out) {
+  const size_t NR = 2, W = 16;
+  const int16_t* a = (const int16_t*)a16;
+  __m256i acc[MR][NR];
+  for(size_t i = 0; i < MR; ++i)
+    for(size_t j = 0; j < NR; ++j)
+      acc[i][j] = _mm256_setzero_si256();
+
+  size_t kw = k / W * W;
+  for(size_t p = 0; p < kw; p += W) {
+    __m256i b0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b[0] + p)));
+    __m256i b1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b[1] + p)));
+    for(size_t i = 0; i < MR; ++i) {
+      __m256i ai = _mm256_loadu_si256((const __m256i*)(a + i * lda + p));
+      acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(ai, b0));
+      acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(ai, b1));
+    }
+  }
+
+  for(size_t i = 0; i < MR; ++i)
+    for(size_t j = 0; j < NR; ++j) {
+      __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc[i][j]),
+                                _mm256_extracti128_si256(acc[i][j], 1));
+      s = _mm_hadd_epi32(s, s);
+      s = _mm_hadd_epi32(s, s);
+      int32_t sum = _mm_cvtsi128_si32(s);
+      for(size_t p = kw; p < k; ++p)
+        sum += a[i * lda + p] * b[j][p];
+      out[i * NR + j] = sum;
+    }
+}
+
+// Accumulators of one row of A with four columns of B. GCC keeps named
+// vectors in registers, arrays of them it copies around VPDPBUSD.
+struct Row4 {
+  __m512i c0, c1, c2, c3;
+};
+
+// The sums of the lanes of the four accumulators
+MARIAN_TARGET_AVX512BW MARIAN_SIMD_INLINE
+__m128i reduce4(const Row4& r) {
+  __m256i s0 = _mm256_add_epi32(_mm512_castsi512_si256(r.c0), _mm512_extracti64x4_epi64(r.c0, 1));
+  __m256i s1 = _mm256_add_epi32(_mm512_castsi512_si256(r.c1), _mm512_extracti64x4_epi64(r.c1, 1));
+  __m256i s2 = _mm256_add_epi32(_mm512_castsi512_si256(r.c2), _mm512_extracti64x4_epi64(r.c2, 1));
+  __m256i s3 = _mm256_add_epi32(_mm512_castsi512_si256(r.c3), _mm512_extracti64x4_epi64(r.c3, 1));
+  __m256i s = _mm256_hadd_epi32(_mm256_hadd_epi32(s0, s1), _mm256_hadd_epi32(s2, s3));
+  return _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+}
+
+MARIAN_TARGET_AVX512BW MARIAN_SIMD_INLINE
+void madd4(Row4& r, __m512i a, const __m512i* b) {
+  r.c0 = _mm512_add_epi32(r.c0, _mm512_madd_epi16(a, b[0]));
+  r.c1 = _mm512_add_epi32(r.c1, _mm512_madd_epi16(a, b[1]));
+  r.c2 = _mm512_add_epi32(r.c2, _mm512_madd_epi16(a, b[2]));
+  r.c3 = _mm512_add_epi32(r.c3, _mm512_madd_epi16(a, b[3]));
+}
+
+// Stores the sums of a tile and adds the products past the last full vector
+template <typename T>
+MARIAN_TARGET_AVX512BW MARIAN_SIMD_INLINE
+void store4(const Row4* rows, size_t kw, size_t k, const T* a, size_t lda,
+            const int8_t* const* b, int32_t* out) {
+  const size_t NR = 4;
+  for(size_t i = 0; i < MR; ++i) {
+    _mm_storeu_si128((__m128i*)(out + i * NR), reduce4(rows[i]));
+    for(size_t j = 0; j < NR; ++j)
+      for(size_t p = kw; p < k; ++p)
+        out[i * NR + j] += a[i * lda + p] * b[j][p];
+  }
+}
+
+MARIAN_TARGET_AVX512BW
+void tileAvx512(size_t k, const void* a16, size_t lda,
+                const int8_t* const* b, int32_t* out) {
+  const size_t NR = 4, W = 32;
+  const int16_t* a = (const int16_t*)a16;
+  __m512i zero = _mm512_setzero_si512();
+  Row4 r0 = {zero, zero, zero, zero}, r1 = r0, r2 = r0, r3 = r0;
+
+  size_t kw = k / W * W;
+  for(size_t p = 0; p < kw; p += W) {
+    __m512i bj[NR];
+    for(size_t j = 0; j < NR; ++j)
+      bj[j] = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)(b[j] + p)));
+    madd4(r0, _mm512_loadu_si512((const void*)(a + p)), bj);
+    madd4(r1, _mm512_loadu_si512((const void*)(a + lda + p)), bj);
+    madd4(r2, _mm512_loadu_si512((const void*)(a + 2 * lda + p)), bj);
+    madd4(r3, _mm512_loadu_si512((const void*)(a + 3 * lda + p)), bj);
+  }
+
+  Row4 rows[MR] = {r0, r1, r2, r3};
+  store4(rows, kw, k, a, lda, b, out);
+}
+
+#ifdef MARIAN_INT8_VNNI
+
+// VPDPBUSD multiplies unsigned with signed bytes and sums groups of four
+// into int32, four times the multiply-adds of VPMADDWD per instruction.
+MARIAN_TARGET_AVX512VNNI MARIAN_SIMD_INLINE
+void dpbusd4(Row4& r, __m512i a, const __m512i* b) {
+  r.c0 = _mm512_dpbusd_epi32(r.c0, a, b[0]);
+  r.c1 = _mm512_dpbusd_epi32(r.c1, a, b[1]);
+  r.c2 = _mm512_dpbusd_epi32(r.c2, a, b[2]);
+  r.c3 = _mm512_dpbusd_epi32(r.c3, a, b[3]);
+}
+
+MARIAN_TARGET_AVX512VNNI
+void tileVnni(size_t k, const void* a8, size_t lda,
+              const int8_t* const* b, int32_t* out) {
+  const size_t NR = 4, W = 64;
+  const uint8_t* a = (const uint8_t*)a8;
+  __m512i zero = _mm512_setzero_si512();
+  Row4 r0 = {zero, zero, zero, zero}, r1 = r0, r2 = r0, r3 = r0;
+
+  size_t kw = k / W * W;
+  for(size_t p = 0; p < kw; p += W) {
+    __m512i bj[NR];
+    for(size_t j = 0; j < NR; ++j)
+      bj[j] = _mm512_loadu_si512((const void*)(b[j] + p));
+    dpbusd4(r0, _mm512_loadu_si512((const void*)(a + p)), bj);
+    dpbusd4(r1, _mm512_loadu_si512((const void*)(a + lda + p)), bj);
+    dpbusd4(r2, _mm512_loadu_si512((const void*)(a + 2 * lda + p)), bj);
+    dpbusd4(r3, _mm512_loadu_si512((const void*)(a + 3 * lda + p)), bj);
+  }
+
+  Row4 rows[MR] = {r0, r1, r2, r3};
+  store4(rows, kw, k, a, lda, b, out);
+}
+
+#endif
+
+#endif
+
+Kernel selectKernel() {
+#ifdef MARIAN_INT8_X86
+  switch(isa()) {
+    case Isa::Avx512:
+#ifdef MARIAN_INT8_VNNI
+      if(__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni"))
+        return {tileVnni, 4, true};
+#endif
+      if(__builtin_cpu_supports("avx512bw"))
+        return {tileAvx512, 4, false};
+      return {tileAvx2, 2, false};
+    case Isa::Avx2:
+      return {tileAvx2, 2, false};
+    default:
+      break;
+  }
+#endif
+  return {tileGeneric, 2, false};
+}
+
+const Kernel& kernel() {
+  static const Kernel k = selectKernel();
+  return k;
+}
+
+struct Column {
+  const int8_t* values;
+  float scale;
+  int32_t sum;
+};
+
+// Quantizes the rows of A to values in the int8 range plus offset, padded
+// with zero rows to a multiple of MR.
+template <typename T>
+void quantizeRows(size_t m, size_t k, const float* A, size_t lda, int offset,
+                  std::vector<T>& values, std::vector<float>& scales) {
+  size_t rows = (m + MR - 1) / MR * MR;
+  values.assign(rows * k, offset);
+  scales.assign(rows, 0.f);
+  for(size_t i = 0; i < m; ++i) {
+    const float* ai = A + i * lda;
+    float max = 0;
+    for(size_t p = 0; p < k; ++p)
+      max = std::max(max, std::fabs(ai[p]));
+    if(max == 0)
+      continue;
+    scales[i] = max / 127.f;
+    float inverse = 127.f / max;
+    T* qi = values.data() + i * k;
+    for(size_t p = 0; p < k; ++p)
+      qi[p] = (T)(std::lrint(ai[p] * inverse) + offset);
+  }
+}
+
+// Computes columns [n0, n1) of C on the calling thread.
+void int8Block(size_t m, size_t k,
+               const char* a, size_t rowBytes, const float* rowScales,
+               const std::vector<Column>& columns, size_t n0, size_t n1,
+               float* C, size_t ldc) {
+  const Kernel& K = kernel();
+  const int8_t* b[4];
+  int32_t sums[MR * 4];
+
+  for(size_t ib = 0; ib < m; ib += MB) {
+    size_t mb = std::min(MB, m - ib);
+    for(size_t j = n0; j < n1; j += K.NR) {
+      size_t nr = std::min(K.NR, n1 - j);
+      // a partial tile repeats its last column
+      for(size_t jj = 0; jj < K.NR; ++jj)
+        b[jj] = columns[j + std::min(jj, nr - 1)].values;
+
+      for(size_t i = ib; i < ib + mb; i += MR) {
+        K.run(k, a + i * rowBytes, k, b, sums);
+        size_t mr = std::min(MR, m - i);
+        for(size_t ii = 0; ii < mr; ++ii) {
+          float* ci = C + (i + ii) * ldc + j;
+          for(size_t jj = 0; jj < nr; ++jj) {
+            const Column& column = columns[j + jj];
+            // unsigned rows of A added 128 times the column sum
+            int32_t sum = sums[ii * K.NR + jj];
+            if(K.unsignedA)
+              sum -= 128 * column.sum;
+            ci[jj] = sum * rowScales[i + ii] * column.scale;
+          }
+        }
+      }
+    }
+  }
+}
+
+size_t ceilDiv(size_t x, size_t y) {
+  return (x + y - 1) / y;
+}
+
+}
+
+void Int8Gemm(BlasHandle* handle,
+              size_t m, size_t k,
+              const float* A, size_t lda,
+              const Int8Weights& B,
+              float* C, size_t ldc) {
+  UTIL_THROW_IF2(B.depth() != k, "matrix product requires dimensions to match");
+
+  std::vector<Column> columns;
+  for(auto& part : B.parts)
+    for(size_t j = 0; j < part.size(); ++j) {
+      size_t c = part.column(j);
+      columns.push_back({part.matrix->column(c), part.matrix->scale(c),
+                         part.matrix->sum(c)});
+    }
+  size_t n = columns.size();
+  if(m == 0 || n == 0)
+    return;
+
+  const Kernel& K = kernel();
+  thread_local std::vector<int16_t> values;
+  thread_local std::vector<uint8_t> unsignedValues;
+  thread_local std::vector<float> scales;
+  const char* a;
+  size_t rowBytes;
+  if(K.unsignedA) {
+    quantizeRows(m, k, A, lda, 128, unsignedValues, scales);
+    a = (const char*)unsignedValues.data();
+    rowBytes = k;
+  }
+  else {
+    quantizeRows(m, k, A, lda, 0, values, scales);
+    a = (const char*)values.data();
+    rowBytes = k * sizeof(int16_t);
+  }
+  const float* rowScales = scales.data();
+
+  size_t threads = handle ? handle->threads() : 1;
+  size_t work = m * n * std::max<size_t>(k, 1);
+  threads = std::max<size_t>(1, std::min(threads, work / MIN_WORK_PER_THREAD));
+
+  if(threads == 1 || !workers()) {
+    int8Block(m, k, a, rowBytes, rowScales, columns, 0, n, C, ldc);
+    return;
+  }
+
+  size_t chunk = ceilDiv(ceilDiv(n, threads), K.NR) * K.NR;
+  parallelTasks(ceilDiv(n, chunk), [&](size_t t) {
+    size_t n0 = t * chunk;
+    int8Block(m, k, a, rowBytes, rowScales, columns,
+              n0, std::min(n, n0 + chunk), C, ldc);
+  });
+}
+
+}
+}
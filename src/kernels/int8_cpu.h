@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+#include "common/quantization.h"
+#include "kernels/gemm_cpu.h"
+
+namespace marian {
+namespace cpu {
+
+/**
+ * Matrix product C = A * B of a row-major m x k float matrix A and int8
+ * weights B of depth k, C has B.columns() columns.
+ *
+ * Every row of A is quantized to int8 with its own scale, max |a| / 127,
+ * the products of the int8 values are summed in int32 and scaled back with
+ * the scales of the row and of the column. The sums are computed by an
+ * AVX-512 VNNI, AVX-512BW, AVX2 or portable kernel chosen at runtime. If a
+ * handle is given the columns are split over that many threads, as in Sgemm.
+ */
+void Int8Gemm(BlasHandle* handle,
+              size_t m, size_t k,
+              const float* A, size_t lda,
+              const Int8Weights& B,
+              float* C, size_t ldc);
+
+}
+}
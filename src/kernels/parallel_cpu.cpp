@@ -0,0 +1,24 @@
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+#include "kernels/parallel_cpu.h"
+#include "training/config.h"
+
+namespace marian {
+namespace cpu {
+
+size_t numThreads() {
+  size_t threads = Config::cpuThreads;
+  return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+ThreadPool* workers() {
+  thread_local std::unique_ptr<ThreadPool> pool;
+  if(!pool && numThreads() > 1)
+    pool.reset(new ThreadPool(numThreads() - 1));
+  return pool.get();
+}
+
+}
+}
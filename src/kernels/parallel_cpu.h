@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <future>
+#include <vector>
+
+#include "3rd_party/threadpool.h"
+
+namespace marian {
+namespace cpu {
+
+/** Threads a CPU kernel may use, --cpu-threads with 0 resolved to the number of cores */
+size_t numThreads();
+
+/**
+ * Workers for the kernels called from the current thread, nullptr if kernels
+ * run single-threaded. Every thread that executes a graph, e.g. one per
+ * device in asynchronous training, gets its own pool of numThreads() - 1
+ * workers and takes a share of the work itself.
+ */
+ThreadPool* workers();
+
+/**
+ * Calls task(i) for i in [0, n), task 0 on the calling thread and the others
+ * on workers(), and returns when all of them are done.
+ */
+template <class Task>
+void parallelTasks(size_t n, const Task& task) {
+  ThreadPool* pool = n > 1 ? workers() : nullptr;
+  if(!pool) {
+    for(size_t i = 0; i < n; ++i)
+      task(i);
+    return;
+  }
+
+  std::vector<std::future<void>> results;
+  results.reserve(n - 1);
+  for(size_t i = 1; i < n; ++i)
+    results.emplace_back(pool->enqueue(task, i));
+
+  task(0);
+
+  for(auto& result : results)
+    result.get();
+}
+
+}
+}
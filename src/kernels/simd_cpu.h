@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstring>
+
+namespace marian {
+namespace cpu {
+
+/**
+ * Instruction sets with dedicated code paths in the CPU kernels. The best
+ * one supported by the host is detected once at runtime, kernels are
+ * compiled for each of them through the target attributes below.
+ */
+enum class Isa { Generic, Avx2, Avx512 };
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#define MARIAN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MARIAN_TARGET_AVX512 __attribute__((target("avx512f")))
+
+inline Isa detectIsa() {
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return Isa::Avx512;
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return Isa::Avx2;
+  return Isa::Generic;
+}
+
+#else
+
+#define MARIAN_TARGET_AVX2
+#define MARIAN_TARGET_AVX512
+
+inline Isa detectIsa() {
+  return Isa::Generic;
+}
+
+#endif
+
+inline Isa isa() {
+  static const Isa value = detectIsa();
+  return value;
+}
+
+#define MARIAN_SIMD_INLINE inline __attribute__((always_inline))
+
+// Simd<W> is always inlined into functions compiled for a matching target,
+// so the note that wide vector arguments change the ABI does not apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/**
+ * W floats in a GCC vector type. Code written against Simd<W> is inlined
+ * into functions carrying one of the target attributes above and compiled
+ * to the registers of that instruction set (W = 4, 8 and 16 for SSE2, AVX2
+ * and AVX-512). The functions only use IEEE operations in a fixed order,
+ * so all widths produce bit-identical results, partial vectors at the end
+ * of a row included.
+ */
+template <int W>
+struct Simd {
+  typedef float V __attribute__((vector_size(W * sizeof(float))));
+  typedef int VI __attribute__((vector_size(W * sizeof(int))));
+
+  static MARIAN_SIMD_INLINE V set1(float x) {
+    V v = {};
+    return v + x;
+  }
+
+  /** Loads n <= W floats, lanes past n are 0 */
+  static MARIAN_SIMD_INLINE V load(const float* p, int n = W) {
+    V v = {};
+    if(n >= W)
+      std::memcpy(&v, p, sizeof(V));
+    else
+      std::memcpy(&v, p, n * sizeof(float));
+    return v;
+  }
+
+  /** Stores the first n <= W lanes */
+  static MARIAN_SIMD_INLINE void store(float* p, V v, int n = W) {
+    if(n >= W)
+      std::memcpy(p, &v, sizeof(V));
+    else
+      std::memcpy(p, &v, n * sizeof(float));
+  }
+
+  /** Whether any lane of a comparison result is set */
+  static MARIAN_SIMD_INLINE bool any(VI mask) {
+    int lanes[W];
+    std::memcpy(lanes, &mask, sizeof(lanes));
+    int set = 0;
+    for(int i = 0; i < W; ++i)
+      set |= lanes[i];
+    return set != 0;
+  }
+
+  static MARIAN_SIMD_INLINE V max(V a, V b) {
+    return a > b ? a : b;
+  }
+
+  static MARIAN_SIMD_INLINE V abs(V x) {
+    return (V)((VI)x & 0x7fffffff);
+  }
+
+  /** exp(x) for single precision, Cephes' expf polynomial */
+  static MARIAN_SIMD_INLINE V exp(V x) {
+    // keep 2^n below in the normal range, exp(x) saturates at
+    // FLT_MIN and 2.4e38
+    x = x > 88.37f ? set1(88.37f) : x;
+    x = x < -87.3365447505f ? set1(-87.3365447505f) : x;
+
+    // n = round(x / log(2)): adding 1.5 * 2^23 rounds to an integer that
+    // ends up in the low mantissa bits
+    V shifted = x * 1.44269504088896341f + 12582912.f;
+    VI n = (VI)shifted - 0x4B400000;
+    V fx = shifted - 12582912.f;
+
+    // x - n * log(2) in two steps for precision
+    x = x - fx * 0.693359375f;
+    x = x - fx * -2.12194440e-4f;
+
+    V z = x * x;
+    V y = set1(1.9875691500E-4f);
+    y = y * x + 1.3981999507E-3f;
+    y = y * x + 8.3334519073E-3f;
+    y = y * x + 4.1665795894E-2f;
+    y = y * x + 1.6666665459E-1f;
+    y = y * x + 5.0000001201E-1f;
+    y = y * z + x + 1.f;
+
+    // multiply by 2^n, built in the exponent bits
+    return y * (V)((n + 127) << 23);
+  }
+
+  /** tanh(x), a polynomial around 0 and (1 - e^-2|x|) / (1 + e^-2|x|) beyond */
+  static MARIAN_SIMD_INLINE V tanh(V x) {
+    V ax = abs(x);
+
+    V e = exp(-2.f * ax);
+    V large = (1.f - e) / (1.f + e);
+    large = (V)((VI)large | ((VI)x & (int)0x80000000));
+
+    V z = x * x;
+    V p = set1(-5.70498872745E-3f);
+    p = p * z + 2.06390887954E-2f;
+    p = p * z - 5.37397155531E-2f;
+    p = p * z + 1.33314422036E-1f;
+    p = p * z - 3.33332819422E-1f;
+    V small = p * z * x + x;
+
+    return ax < 0.625f ? small : large;
+  }
+
+  /** 1 / (1 + exp(-x)) */
+  static MARIAN_SIMD_INLINE V sigmoid(V x) {
+    return 1.f / (1.f + exp(-x));
+  }
+};
+
+}
+}
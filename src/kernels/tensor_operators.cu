@@ -95,7 +95,8 @@ cublasHandle_t create_handle(size_t device) {
 __global__ void gSoftmax(float* out,
                          const Shape outShape,
                          const float* in,
-                         const float* mask) {
+                         const float* mask,
+                         int maskRows) {
   int rows = outShape[0] * outShape[2] * outShape[3];
   int cols = outShape[1];
   for(int bid = 0; bid < rows; bid += gridDim.x) {
@@ -103,7 +104,7 @@ __global__ void gSoftmax(float* out,
     if(j < rows) {
       float* so = out + j * cols;
       const float* sp = in + j * cols;
-      const float* mp = mask ? (mask + j * cols) : 0;
+      const float* mp = mask ? (mask + (j % maskRows) * cols) : 0;
 
       extern __shared__ float _share[];
 
@@ -174,16 +175,18 @@ void Softmax(Tensor out, Tensor in, Tensor mask) {
   int threads = std::min(MAX_THREADS, (int) k);
   int shared = sizeof(float) * threads * 2;
 
+  // the mask has one row per sentence and is repeated over the beam
   if(mask)
     gSoftmax<<<blocks, threads, shared>>>(out->data(),
                                           out->shape(),
                                           in->data(),
-                                          mask->data());
+                                          mask->data(),
+                                          mask->shape().elements() / k);
   else
     gSoftmax<<<blocks, threads, shared>>>(out->data(),
                                           out->shape(),
                                           in->data(),
-                                          0);
+                                          0, 1);
   cudaStreamSynchronize(0);
 }
 
@@ -390,32 +393,65 @@ void LogSoftmaxGrad(Tensor grad, Tensor adj, Tensor val) {
 }
 
 ///////////////////////////////////////////////////////
-__global__ void gArgmax(float *out, const float *data, size_t rows, size_t cols) {
-  size_t row = blockIdx.x;
-    size_t startInd = row * cols;
-    float maxScore = -99999;
-    size_t maxInd;
-    for (size_t col = 0; col < cols; ++col) {
-      size_t ind = startInd + col;
-      float score = data[ind];
-      if (score > maxScore) {
-        maxScore = score;
-        maxInd = col;
+__global__ void gArgmax(float *out, const float *data, int rows, int cols) {
+  extern __shared__ float _share[];
+  float* _max = _share;
+  int* _ind = (int*)(_share + blockDim.x);
+
+  for(int bid = 0; bid < rows; bid += gridDim.x) {
+    int j = bid + blockIdx.x;
+    if(j < rows) {
+      const float* sp = data + j * cols;
+
+      // the first index of the largest value, as on the CPU
+      // there are at most cols threads
+      float maxScore = sp[threadIdx.x];
+      int maxInd = threadIdx.x;
+      for(int id = threadIdx.x + blockDim.x; id < cols; id += blockDim.x) {
+        if(sp[id] > maxScore) {
+          maxScore = sp[id];
+          maxInd = id;
+        }
+      }
+      _max[threadIdx.x] = maxScore;
+      _ind[threadIdx.x] = maxInd;
+      __syncthreads();
+
+      int len = blockDim.x;
+      while(len != 1) {
+        __syncthreads();
+        int skip = (len + 1) >> 1;
+        if(threadIdx.x < (len >> 1)) {
+          int other = threadIdx.x + skip;
+          if(_max[other] > _max[threadIdx.x]
+             || (_max[other] == _max[threadIdx.x] && _ind[other] < _ind[threadIdx.x])) {
+            _max[threadIdx.x] = _max[other];
+            _ind[threadIdx.x] = _ind[other];
+          }
+        }
+        len = (len + 1) >> 1;
       }
+      __syncthreads();
+
+      if(threadIdx.x == 0)
+        out[j] = _ind[0];
+      __syncthreads();
     }
-    out[row] = maxInd;
+  }
 }
 
-//void Argmax(Tensor* Out, const Tensor* In) {
-//  size_t m = In->shape()[0];
-//  size_t k = In->shape()[1];
-//
-//  int blocks = m; //std::min(MAX_BLOCKS, (int) m);
-//  int threads = k; //std::min(MAX_THREADS, (int) k);
-//  //int shared = sizeof(float) * threads * 2;
-//  gArgmax<<<blocks, threads>>>(Out->data(), In->data(), m, k);
-//
-//}
+void Argmax(Tensor out, const Tensor in) {
+  cudaSetDevice(out->getDevice());
+
+  int m = in->shape()[0] * in->shape()[2] * in->shape()[3];
+  int k = in->shape()[1];
+
+  int blocks = std::min(MAX_BLOCKS, m);
+  int threads = std::min(MAX_THREADS, k);
+  int shared = (sizeof(float) + sizeof(int)) * threads;
+
+  gArgmax<<<blocks, threads, shared>>>(out->data(), in->data(), m, k);
+}
 
 ///////////////////////////////////////////////////////
 
@@ -927,7 +963,7 @@ __global__ void gGRUFastBackward(float* outState,
           float t = (1-z)*(1-h*h);
 
           // df/ds
-          if(outState) rowOutState[i] += m * z * adj - m + 1;
+          if(outState) rowOutState[i] += (m * z - m + 1) * adj;
 
           // df/d(xW_r) ...
           float dfdxW_r = r * (1-r) * t * adj;
@@ -1192,7 +1228,7 @@ __global__ void gAtt(float* out,
     if(j < rows) {
       const float* vaRow = va;
       const float* ctxRow = ctx + (j % (b * t)) * cols;
-      const float* stateRow = state + (j / (b * t) + j % b) * cols;
+      const float* stateRow = state + ((j / (b * t)) * b + j % b) * cols;
       const float* covRow = cov ? cov + (j % (b * t)) * cols : nullptr;
 
       extern __shared__ float _share[];
@@ -1585,5 +1621,47 @@ void SetSparse(float *out,
 
 }
 
+__global__ void gGetSparse(float* values,
+                           const size_t* indeces,
+                           const float* in,
+                           int length) {
+  for(int bid = 0; bid < length; bid += blockDim.x * gridDim.x) {
+    int index = bid + blockDim.x * blockIdx.x + threadIdx.x;
+    if (index < length) {
+      values[index] = in[indeces[index]];
+    }
+  }
+}
+
+void GetSparse(const float* in,
+               const std::vector<size_t>& indeces,
+               std::vector<float>& values) {
+
+  int length = indeces.size();
+  values.resize(length);
+  if(length == 0)
+    return;
+
+  int threads = std::min(MAX_THREADS, length);
+  int blocks  = std::min(MAX_BLOCKS, length / threads  + (length % threads != 0));
+
+  size_t* d_indeces;
+  CUDA_CHECK(cudaMalloc(&d_indeces, length * sizeof(size_t)));
+  CUDA_CHECK(cudaMemcpy(d_indeces, indeces.data(), length * sizeof(size_t),
+                        cudaMemcpyHostToDevice));
+
+  float* d_values;
+  CUDA_CHECK(cudaMalloc(&d_values, length * sizeof(float)));
+
+  gGetSparse<<<blocks, threads>>>(d_values, d_indeces, in, length);
+
+  // a single copy of all gathered values
+  CUDA_CHECK(cudaMemcpy(values.data(), d_values, length * sizeof(float),
+                        cudaMemcpyDeviceToHost));
+
+  cudaFree(d_indeces);
+  cudaFree(d_values);
+}
+
 
 }  // namespace marian
@@ -1,11 +1,11 @@
 #pragma once
 
-#include <cublas_v2.h>
 #include <thrust/functional.h>
 #include <thrust/host_vector.h>
 #include <thrust/device_vector.h>
 #include <thrust/pair.h>
 
+#include "kernels/backend.h"
 #include "tensors/tensor.h"
 
 namespace marian {
@@ -18,6 +18,8 @@ class TensorGPU;
 
 cublasHandle_t create_handle(size_t);
 
+#ifdef CUDA_FOUND
+
 template <class Functor>
 __global__ void gAdd(Functor functor,
                      float* out,
@@ -820,6 +822,8 @@ void Pick(Functor functor, T1 out, const T2 in1, const T3 in2, const T4 picks) {
 
 }
 
+#endif
+
 float L2Norm(Tensor in);
 
 void Softmax(Tensor out, Tensor in, Tensor mask = nullptr);
@@ -880,4 +884,12 @@ void SetSparse(float*, const
                std::vector<size_t>& indeces,
                const std::vector<float>& values);
 
+void GetSparse(const float*,
+               const std::vector<size_t>& indeces,
+               std::vector<float>& values);
+
 }
+
+#ifndef CUDA_FOUND
+#include "kernels/tensor_operators_cpu.h"
+#endif
@@ -0,0 +1,729 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "kernels/tensor_operators.h"
+#include "kernels/gemm_cpu.h"
+#include "kernels/int8_cpu.h"
+#include "kernels/simd_cpu.h"
+#include "training/config.h"
+
+namespace marian {
+
+cublasHandle_t create_handle(size_t device) {
+  return new cpu::BlasHandle(Config::cpuThreads);
+}
+
+void Softmax(Tensor out, Tensor in, Tensor mask) {
+  int rows = out->shape()[0] * out->shape()[2] * out->shape()[3];
+  int cols = out->shape()[1];
+  // the mask has one row per sentence and is repeated over the beam
+  int maskRows = mask ? mask->shape().elements() / cols : 1;
+
+  for(int j = 0; j < rows; ++j) {
+    float* so = out->data() + j * cols;
+    const float* sp = in->data() + j * cols;
+    const float* mp = mask ? mask->data() + (j % maskRows) * cols : 0;
+
+    float max = sp[0];
+    for(int i = 1; i < cols; ++i)
+      max = std::max(max, sp[i]);
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i) {
+      float ex = 0;
+      if(!mp || mp[i])
+        ex = expf(sp[i] - max);
+      so[i] = ex;
+      sum += ex;
+    }
+
+    for(int i = 0; i < cols; ++i)
+      so[i] /= sum;
+  }
+}
+
+void LogSoftmax(Tensor out, Tensor in) {
+  int rows = out->shape()[0] * out->shape()[2] * out->shape()[3];
+  int cols = out->shape()[1];
+
+  for(int j = 0; j < rows; ++j) {
+    float* so = out->data() + j * cols;
+    const float* sp = in->data() + j * cols;
+
+    float max = sp[0];
+    for(int i = 1; i < cols; ++i)
+      max = std::max(max, sp[i]);
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i) {
+      float sm = sp[i] - max;
+      so[i] = sm;
+      sum += expf(sm);
+    }
+
+    float logSum = logf(sum);
+    for(int i = 0; i < cols; ++i)
+      so[i] -= logSum;
+  }
+}
+
+void SoftmaxGrad(Tensor grad, Tensor adj, Tensor val) {
+  // grad and val are both m-by-k matrices, passed as input.
+  // A weighted average of each row of grad (according to the weights
+  // specified in val) is computed and subtracted from Out.
+  // adj is multiplied for each element to get backward step in autodiff
+  int rows = grad->shape()[0] * grad->shape()[2] * grad->shape()[3];
+  int cols = grad->shape()[1];
+
+  for(int j = 0; j < rows; ++j) {
+    float* gradRow = grad->data() + j * cols;
+    const float* adjRow = adj->data() + j * cols;
+    const float* valRow = val->data() + j * cols;
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i)
+      sum += valRow[i] * adjRow[i];
+
+    for(int i = 0; i < cols; ++i) {
+      float v = valRow[i] * (adjRow[i] - sum);
+      if(v)
+        gradRow[i] += v;
+    }
+  }
+}
+
+void LogSoftmaxGrad(Tensor grad, Tensor adj, Tensor val) {
+  int rows = grad->shape()[0] * grad->shape()[2] * grad->shape()[3];
+  int cols = grad->shape()[1];
+
+  for(int j = 0; j < rows; ++j) {
+    float* gradRow = grad->data() + j * cols;
+    const float* adjRow = adj->data() + j * cols;
+    const float* valRow = val->data() + j * cols;
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i)
+      sum += adjRow[i];
+
+    for(int i = 0; i < cols; ++i)
+      gradRow[i] += adjRow[i] - (expf(valRow[i]) * sum);
+  }
+}
+
+void Prod(cublasHandle_t handle, Tensor C, const Tensor A, const Tensor B,
+             bool transA, bool transB, Float beta) {
+  size_t m = A->shape()[0] * A->shape()[2] * A->shape()[3];
+  size_t k = A->shape()[1];
+  if(transA)
+    std::swap(m, k);
+
+  size_t l = B->shape()[0];
+  size_t n = B->shape()[1];
+  if(transB)
+    std::swap(l, n);
+
+  size_t lda = A->shape()[1];
+  size_t ldb = B->shape()[1];
+  size_t ldc = B->shape()[1];
+
+  if(transB)
+    ldc = B->shape()[0];
+
+  cpu::Sgemm(handle, transA, transB, m, n, k,
+             1.f, A->data(), lda, B->data(), ldb,
+             beta, C->data(), ldc);
+}
+
+void ProdInt8(cublasHandle_t handle, Tensor C, const Tensor A, const Int8Weights& B) {
+  size_t m = A->shape()[0] * A->shape()[2] * A->shape()[3];
+  size_t k = A->shape()[1];
+  cpu::Int8Gemm(handle, m, k, A->data(), k, B, C->data(), C->shape()[1]);
+}
+
+void CopyRows(Tensor out, const Tensor in, const std::vector<size_t>& indeces) {
+  size_t cols = in->shape()[1];
+  for(size_t j = 0; j < indeces.size(); ++j)
+    std::copy(in->data() + indeces[j] * cols,
+              in->data() + (indeces[j] + 1) * cols,
+              out->data() + j * cols);
+}
+
+void PasteRows(Tensor out, const Tensor in, const std::vector<size_t>& indeces) {
+  size_t cols = in->shape()[1];
+  for(size_t j = 0; j < indeces.size(); ++j) {
+    float* rowOut = out->data() + indeces[j] * cols;
+    const float* rowIn = in->data() + j * cols;
+    for(size_t i = 0; i < cols; ++i)
+      rowOut[i] += rowIn[i];
+  }
+}
+
+void CopyCols(Tensor out, const Tensor in, const std::vector<size_t>& indeces) {
+  size_t rows = in->shape()[0] * in->shape()[2] * in->shape()[3];
+  size_t colsIn = in->shape()[1];
+  size_t colsOut = indeces.size();
+
+  for(size_t j = 0; j < rows; ++j) {
+    const float* rowIn = in->data() + j * colsIn;
+    float* rowOut = out->data() + j * colsOut;
+    for(size_t i = 0; i < colsOut; ++i)
+      rowOut[i] = rowIn[indeces[i]];
+  }
+}
+
+void PasteCols(Tensor out, const Tensor in, const std::vector<size_t>& indeces) {
+  size_t rows = out->shape()[0] * out->shape()[2] * out->shape()[3];
+  size_t colsOut = out->shape()[1];
+  size_t colsIn = indeces.size();
+
+  for(size_t j = 0; j < rows; ++j) {
+    const float* rowIn = in->data() + j * colsIn;
+    float* rowOut = out->data() + j * colsOut;
+    for(size_t i = 0; i < colsIn; ++i)
+      rowOut[indeces[i]] = rowIn[i];
+  }
+}
+
+void Transpose(cublasHandle_t cublasHandle, Tensor out, const Tensor in) {
+  size_t steps = in->shape()[2] * in->shape()[3];
+  size_t m = in->shape()[0];
+  size_t n = in->shape()[1];
+
+  for(size_t s = 0; s < steps; s++) {
+    size_t offset = s * m * n;
+    const float* src = in->data() + offset;
+    float* dst = out->data() + offset;
+    for(size_t i = 0; i < m; ++i)
+      for(size_t j = 0; j < n; ++j)
+        dst[j * m + i] = src[i * n + j];
+  }
+}
+
+static void InsertCols(float* out, const float* in,
+                       size_t rows, size_t cols,
+                       size_t colsOut, size_t colsIn,
+                       size_t offsetOut, size_t offsetIn) {
+  for(size_t j = 0; j < rows; ++j)
+    std::copy(in + j * colsIn + offsetIn,
+              in + j * colsIn + offsetIn + cols,
+              out + j * colsOut + offsetOut);
+}
+
+void Concatenate(Tensor out, const std::vector<Tensor>& inputs, int ax) {
+  if(ax == 1) {
+    size_t rows = out->shape()[0] * out->shape()[2] * out->shape()[3];
+    size_t colsOut = out->shape()[1];
+
+    size_t offset = 0;
+    for(auto in : inputs) {
+      UTIL_THROW_IF2(out->shape()[0] != in->shape()[0],
+                     "First dimension must be equal");
+      size_t colsIn = in->shape()[1];
+      InsertCols(out->data(), in->data(), rows, colsIn, colsOut, colsIn, offset, 0);
+      offset += colsIn;
+    }
+  }
+  else {
+    size_t offset = 0;
+    for(auto in : inputs) {
+      UTIL_THROW_IF2(out->shape()[1] != in->shape()[1],
+                     "Second dimension must be equal");
+      std::memcpy(out->data() + offset, in->data(), in->size() * sizeof(float));
+      offset += in->size();
+    }
+  }
+}
+
+void Deconcatenate(std::vector<Tensor>& outputs, const Tensor in, int ax) {
+  if(ax == 1) {
+    size_t rows = in->shape()[0] * in->shape()[2] * in->shape()[3];
+    size_t colsIn = in->shape()[1];
+
+    size_t offset = 0;
+    for(auto out : outputs) {
+      UTIL_THROW_IF2(out->shape()[0] != in->shape()[0],
+                     "First dimension must be equal");
+      size_t colsOut = out->shape()[1];
+      InsertCols(out->data(), in->data(), rows, colsOut, colsOut, colsIn, 0, offset);
+      offset += colsOut;
+    }
+  }
+  else {
+    size_t offset = 0;
+    for(auto out : outputs) {
+      std::memcpy(out->data(), in->data() + offset, out->size() * sizeof(float));
+      offset += out->size();
+    }
+  }
+}
+
+namespace {
+
+// GRU cell over rows [0, rows) with hidden size cols, r, z and the candidate
+// h are computed in one pass over state, xW, sU, b and the mask.
+template <int W>
+MARIAN_SIMD_INLINE void gruForward(float* out,
+                                   const float* state,
+                                   const float* xW,
+                                   const float* sU,
+                                   const float* b,
+                                   const float* mask,
+                                   int rows, int cols, bool final) {
+  typedef cpu::Simd<W> S;
+  typedef typename S::V V;
+
+  for(int j = 0; j < rows; ++j) {
+    float m = !mask || mask[j];
+    float* rowOut = out + j * cols;
+    const float* rowState = state + j * cols;
+    const float* xWrow = xW + j * cols * 3;
+    const float* sUrow = sU + j * cols * 3;
+
+    for(int i = 0; i < cols; i += W) {
+      int n = cols - i;
+      int k = i + cols;
+      int l = i + 2 * cols;
+
+      V r = S::sigmoid(S::load(xWrow + i, n) + S::load(sUrow + i, n) + S::load(b + i, n));
+      V z = S::sigmoid(S::load(xWrow + k, n) + S::load(sUrow + k, n) + S::load(b + k, n));
+
+      V h;
+      if(final)
+        h = S::tanh(S::load(xWrow + l, n) + (S::load(sUrow + l, n) + S::load(b + l, n)) * r);
+      else
+        h = S::tanh(S::load(xWrow + l, n) + S::load(sUrow + l, n) * r + S::load(b + l, n));
+
+      V s = S::load(rowState + i, n);
+      V o = (1.0f - z) * h + z * s;
+      S::store(rowOut + i, m * o + (1 - m) * s, n);
+    }
+  }
+}
+
+// Adds v to the first n floats at p
+template <int W>
+MARIAN_SIMD_INLINE void addTo(float* p, typename cpu::Simd<W>::V v, int n) {
+  cpu::Simd<W>::store(p, cpu::Simd<W>::load(p, n) + v, n);
+}
+
+template <int W>
+MARIAN_SIMD_INLINE void gruBackward(float* outState,
+                                    float* outXW,
+                                    float* outSU,
+                                    float* outB,
+                                    const float* state,
+                                    const float* xW,
+                                    const float* sU,
+                                    const float* b,
+                                    const float* mask,
+                                    const float* adj,
+                                    int rows, int cols, bool final) {
+  typedef cpu::Simd<W> S;
+  typedef typename S::V V;
+
+  for(int j = 0; j < rows; ++j) {
+    float m = !mask || mask[j];
+
+    float* rowOutState = outState + j * cols;
+    float* rowOutXW = outXW + j * cols * 3;
+    float* rowOutSU = outSU + j * cols * 3;
+
+    const float* rowState = state + j * cols;
+    const float* rowXW = xW + j * cols * 3;
+    const float* rowSU = sU + j * cols * 3;
+    const float* rowAdj = adj + j * cols;
+
+    for(int i = 0; i < cols; i += W) {
+      int n = cols - i;
+      int k = i + cols;
+      int l = i + 2 * cols;
+
+      V r = S::sigmoid(S::load(rowXW + i, n) + S::load(rowSU + i, n) + S::load(b + i, n));
+      V z = S::sigmoid(S::load(rowXW + k, n) + S::load(rowSU + k, n) + S::load(b + k, n));
+
+      V sUl = S::load(rowSU + l, n);
+      V bl = S::load(b + l, n);
+      V h;
+      if(final)
+        h = S::tanh(S::load(rowXW + l, n) + (sUl + bl) * r);
+      else
+        h = S::tanh(S::load(rowXW + l, n) + sUl * r + bl);
+
+      V a = S::load(rowAdj + i, n);
+      V t = (1 - z) * (1 - h * h);
+
+      // df/ds, masked positions pass the adjoint through unchanged
+      if(outState)
+        addTo<W>(rowOutState + i, (m * z - m + 1) * a, n);
+
+      // df/d(xW_r) ...
+      V dfdxW_r = r * (1 - r) * t * a;
+      if(final)
+        dfdxW_r = dfdxW_r * (sUl + bl);
+      else
+        dfdxW_r = dfdxW_r * sUl;
+      if(outXW) addTo<W>(rowOutXW + i, m * dfdxW_r, n);
+      if(outSU) addTo<W>(rowOutSU + i, m * dfdxW_r, n);
+      if(outB)  addTo<W>(outB + i, m * dfdxW_r, n);
+
+      // df/d(xW_z) ...
+      V dfdxW_z = (1 - z) * z * (S::load(rowState + i, n) - h) * a;
+      if(outXW) addTo<W>(rowOutXW + k, m * dfdxW_z, n);
+      if(outSU) addTo<W>(rowOutSU + k, m * dfdxW_z, n);
+      if(outB)  addTo<W>(outB + k, m * dfdxW_z, n);
+
+      // df/d(xW_x) ...
+      V dfdxW_x = t * a;
+      if(outXW) addTo<W>(rowOutXW + l, m * dfdxW_x, n);
+      if(outSU) addTo<W>(rowOutSU + l, m * dfdxW_x * r, n);
+      if(outB) {
+        if(final)
+          addTo<W>(outB + l, m * dfdxW_x * r, n);
+        else
+          addTo<W>(outB + l, m * dfdxW_x, n);
+      }
+    }
+  }
+}
+
+#define GRU_FORWARD_ARGS \
+  float* out, const float* state, const float* xW, const float* sU, \
+  const float* b, const float* mask, int rows, int cols, bool final
+#define GRU_FORWARD_PARAMS out, state, xW, sU, b, mask, rows, cols, final
+
+#define GRU_BACKWARD_ARGS \
+  float* outState, float* outXW, float* outSU, float* outB, \
+  const float* state, const float* xW, const float* sU, const float* b, \
+  const float* mask, const float* adj, int rows, int cols, bool final
+#define GRU_BACKWARD_PARAMS \
+  outState, outXW, outSU, outB, state, xW, sU, b, mask, adj, rows, cols, final
+
+void gruForwardGeneric(GRU_FORWARD_ARGS) {
+  gruForward<4>(GRU_FORWARD_PARAMS);
+}
+
+MARIAN_TARGET_AVX2 void gruForwardAvx2(GRU_FORWARD_ARGS) {
+  gruForward<8>(GRU_FORWARD_PARAMS);
+}
+
+MARIAN_TARGET_AVX512 void gruForwardAvx512(GRU_FORWARD_ARGS) {
+  gruForward<16>(GRU_FORWARD_PARAMS);
+}
+
+void gruBackwardGeneric(GRU_BACKWARD_ARGS) {
+  gruBackward<4>(GRU_BACKWARD_PARAMS);
+}
+
+MARIAN_TARGET_AVX2 void gruBackwardAvx2(GRU_BACKWARD_ARGS) {
+  gruBackward<8>(GRU_BACKWARD_PARAMS);
+}
+
+MARIAN_TARGET_AVX512 void gruBackwardAvx512(GRU_BACKWARD_ARGS) {
+  gruBackward<16>(GRU_BACKWARD_PARAMS);
+}
+
+}
+
+void GRUFastForward(Tensor out_, std::vector<Tensor> inputs, bool final) {
+  int rows = out_->shape()[0] * out_->shape()[2] * out_->shape()[3];
+  int cols = out_->shape()[1];
+
+  float* out = out_->data();
+  const float* state = inputs[0]->data();
+  const float* xW = inputs[1]->data();
+  const float* sU = inputs[2]->data();
+  const float* b = inputs[3]->data();
+  const float* mask = inputs.size() > 4 ? inputs[4]->data() : 0;
+
+  switch(cpu::isa()) {
+    case cpu::Isa::Avx512: gruForwardAvx512(GRU_FORWARD_PARAMS); break;
+    case cpu::Isa::Avx2:   gruForwardAvx2(GRU_FORWARD_PARAMS); break;
+    default:               gruForwardGeneric(GRU_FORWARD_PARAMS); break;
+  }
+}
+
+void GRUFastBackward(std::vector<Tensor> outputs,
+                     std::vector<Tensor> inputs,
+                     Tensor adj_, bool final) {
+  int rows = adj_->shape()[0] * adj_->shape()[2] * adj_->shape()[3];
+  int cols = adj_->shape()[1];
+
+  float* outState = outputs[0] ? outputs[0]->data() : 0;
+  float* outXW = outputs[1] ? outputs[1]->data() : 0;
+  float* outSU = outputs[2] ? outputs[2]->data() : 0;
+  float* outB = outputs[3] ? outputs[3]->data() : 0;
+
+  const float* state = inputs[0]->data();
+  const float* xW = inputs[1]->data();
+  const float* sU = inputs[2]->data();
+  const float* b = inputs[3]->data();
+  const float* mask = inputs.size() > 4 ? inputs[4]->data() : 0;
+  const float* adj = adj_->data();
+
+  switch(cpu::isa()) {
+    case cpu::Isa::Avx512: gruBackwardAvx512(GRU_BACKWARD_PARAMS); break;
+    case cpu::Isa::Avx2:   gruBackwardAvx2(GRU_BACKWARD_PARAMS); break;
+    default:               gruBackwardGeneric(GRU_BACKWARD_PARAMS); break;
+  }
+}
+
+void Argmax(Tensor out, const Tensor in) {
+  int rows = in->shape()[0] * in->shape()[2] * in->shape()[3];
+  int cols = in->shape()[1];
+
+  for(int j = 0; j < rows; ++j) {
+    const float* sp = in->data() + j * cols;
+    out->data()[j] = std::max_element(sp, sp + cols) - sp;
+  }
+}
+
+void CrossEntropyPick(Tensor out, Tensor in, Tensor pick) {
+  int rows = in->shape()[0];
+  int cols = in->shape()[1];
+
+  for(int j = 0; j < rows; ++j) {
+    const float* sp = in->data() + j * cols;
+
+    float max = sp[0];
+    for(int i = 1; i < cols; ++i)
+      max = std::max(max, sp[i]);
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i)
+      sum += expf(sp[i] - max);
+
+    // cross-entropy
+    int id = (int)pick->data()[j];
+    out->data()[j] = logf(sum) - sp[id] + max;
+  }
+}
+
+void CrossEntropyPickBackward(Tensor out, Tensor adj, Tensor a, Tensor pick) {
+  int rows = out->shape()[0];
+  int cols = out->shape()[1];
+
+  for(int j = 0; j < rows; ++j) {
+    const float* sp = a->data() + j * cols;
+    float* so = out->data() + j * cols;
+
+    float max = sp[0];
+    for(int i = 1; i < cols; ++i)
+      max = std::max(max, sp[i]);
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i)
+      sum += expf(sp[i] - max);
+
+    // cross-entropy
+    int id = (int)pick->data()[j];
+    float adjRow = adj->data()[j];
+    for(int i = 0; i < cols; ++i) {
+      float sub = (float)(i == id);
+      so[i] += adjRow * (expf(sp[i] - max) / sum - sub);
+    }
+  }
+}
+
+float L2Norm(Tensor in) {
+  const float* data = in->data();
+  size_t size = in->size();
+
+  float sum = 0;
+  for(size_t i = 0; i < size; ++i)
+    sum += data[i] * data[i];
+  return sqrtf(sum);
+}
+
+void Att(Tensor out_,
+         Tensor va_,
+         Tensor context,
+         Tensor state_,
+         Tensor coverage) {
+  int m = out_->shape()[0] * out_->shape()[2] * out_->shape()[3];
+
+  int b = context->shape()[0];
+  int k = context->shape()[1];
+  int t = context->shape()[2];
+
+  float* out = out_->data();
+  const float* va = va_->data();
+  const float* ctx = context->data();
+  const float* state = state_->data();
+  const float* cov = coverage ? coverage->data() : nullptr;
+
+  for(int j = 0; j < m; ++j) {
+    const float* ctxRow = ctx + (j % (b * t)) * k;
+    const float* stateRow = state + ((j / (b * t)) * b + j % b) * k;
+    const float* covRow = cov ? cov + (j % (b * t)) * k : nullptr;
+
+    float sum = 0;
+    for(int i = 0; i < k; ++i) {
+      float z = ctxRow[i] + stateRow[i];
+      if(cov)
+        z += covRow[i];
+      sum += tanhf(z) * va[i];
+    }
+    out[j] = sum;
+  }
+}
+
+void AttBack(Tensor gVa_, Tensor gContext_, Tensor gState_, Tensor gCoverage_,
+             Tensor va_, Tensor context_, Tensor state_, Tensor coverage_,
+             Tensor adj_) {
+  int m = context_->shape()[0] * context_->shape()[2] * context_->shape()[3];
+  int k = context_->shape()[1];
+  int n = context_->shape()[0];
+
+  float* gVa = gVa_->data();
+  float* gContext = gContext_->data();
+  float* gState = gState_->data();
+  float* gCoverage = gCoverage_ ? gCoverage_->data() : nullptr;
+
+  const float* va = va_->data();
+  const float* context = context_->data();
+  const float* state = state_->data();
+  const float* coverage = coverage_ ? coverage_->data() : nullptr;
+  const float* adj = adj_->data();
+
+  for(int j = 0; j < m; ++j) {
+    float* gcRow = gContext + j * k;
+    float* gsRow = gState + (j % n) * k;
+    float* gcovRow = gCoverage ? gCoverage + j * k : nullptr;
+
+    const float* cRow = context + j * k;
+    const float* sRow = state + (j % n) * k;
+    const float* covRow = coverage ? coverage + j * k : nullptr;
+
+    for(int i = 0; i < k; ++i) {
+      float z = cRow[i] + sRow[i];
+      if(coverage)
+        z += covRow[i];
+
+      float t = tanhf(z);
+      float r = va[i] * (1.f - t * t);
+
+      gcRow[i] += r * adj[j];
+      gsRow[i] += r * adj[j];
+      if(gCoverage)
+        gcovRow[i] += r * adj[j];
+      gVa[i] += t * adj[j];
+    }
+  }
+}
+
+void LayerNormalization(Tensor out, Tensor in, Tensor gamma, Tensor beta, float eps) {
+  int rows = in->shape()[0] * in->shape()[2] * in->shape()[3];
+  int cols = in->shape()[1];
+
+  const float* alpha = gamma->data();
+  const float* b = beta ? beta->data() : nullptr;
+
+  for(int j = 0; j < rows; ++j) {
+    float* so = out->data() + j * cols;
+    const float* sp = in->data() + j * cols;
+
+    float sum = 0;
+    for(int i = 0; i < cols; ++i)
+      sum += sp[i];
+    float mean = sum / cols;
+
+    float sqSum = 0;
+    for(int i = 0; i < cols; ++i) {
+      float ex = sp[i] - mean;
+      sqSum += ex * ex;
+    }
+    float sigma = sqrtf(eps + (sqSum / cols));
+
+    for(int i = 0; i < cols; ++i) {
+      float t = alpha[i] * ((sp[i] - mean) / sigma);
+      if(b)
+        t += b[i];
+      so[i] = t;
+    }
+  }
+}
+
+void LayerNormalizationGrad(Tensor gradX, Tensor gradGamma, Tensor gradBeta,
+                            Tensor adj, Tensor y, Tensor x, Tensor gamma, Tensor beta) {
+  int rows = y->shape()[0] * y->shape()[2] * y->shape()[3];
+  int cols = y->shape()[1];
+  float eps = 1e-9;
+
+  const float* g = gamma->data();
+  const float* b = beta ? beta->data() : nullptr;
+  float* gGamma = gradGamma->data();
+  float* gBeta = gradBeta ? gradBeta->data() : nullptr;
+
+  for(int j = 0; j < rows; ++j) {
+    const float* xRow = x->data() + j * cols;
+    const float* yRow = y->data() + j * cols;
+    const float* adjRow = adj->data() + j * cols;
+    float* gradXRow = gradX->data() + j * cols;
+
+    float sumX = 0, sumAdj = 0, sumAdjX = 0, sumSqr = 0;
+    for(int i = 0; i < cols; ++i) {
+      sumX += xRow[i];
+      sumAdjX += adjRow[i] * (yRow[i] - (b ? b[i] : 0)) / g[i];
+      sumAdj += adjRow[i];
+    }
+    float mean = sumX / cols;
+
+    for(int i = 0; i < cols; ++i) {
+      float ex = xRow[i] - mean;
+      sumSqr += ex * ex;
+    }
+    float sigma = sqrtf(eps + (sumSqr / cols));
+
+    for(int i = 0; i < cols; ++i) {
+      float gradx = 0.0f;
+      float xHat = (yRow[i] - (b ? b[i] : 0)) / g[i];
+      gradx += cols * adjRow[i];
+      gradx -= sumAdj;
+      gradx -= sumAdjX * xHat;
+      gradx /= (cols * sigma);
+
+      gradXRow[i] += g[i] * gradx;
+      gGamma[i] += adjRow[i] * xHat;
+      if(gBeta)
+        gBeta[i] += adjRow[i];
+    }
+  }
+}
+
+void Shift(Tensor out, Tensor in, Shape shift, bool invert) {
+  int offset = in->shape().stride(0) * shift[0]
+             + in->shape().stride(1) * shift[1]
+             + in->shape().stride(2) * shift[2]
+             + in->shape().stride(3) * shift[3];
+
+  if(invert)
+    offset = -offset;
+
+  int length = out->shape().elements();
+  float* o = out->data();
+  const float* i = in->data();
+  for(int index = 0; index < length; ++index) {
+    if(index - offset < 0 || index - offset >= length)
+      o[index] = 0;
+    else
+      o[index] = i[index - offset];
+  }
+}
+
+void SetSparse(float* out,
+               const std::vector<size_t>& indeces,
+               const std::vector<float>& values) {
+  for(size_t i = 0; i < indeces.size(); ++i)
+    out[indeces[i]] = values[i];
+}
+
+void GetSparse(const float* in,
+               const std::vector<size_t>& indeces,
+               std::vector<float>& values) {
+  values.resize(indeces.size());
+  for(size_t i = 0; i < indeces.size(); ++i)
+    values[i] = in[indeces[i]];
+}
+
+}
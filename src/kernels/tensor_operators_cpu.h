@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+
+#include "common/quantization.h"
+#include "kernels/backend.h"
+#include "kernels/element_cpu.h"
+#include "tensors/tensor.h"
+
+namespace marian {
+
+/**
+ * Host versions of the functor kernels declared in tensor_operators.h. They
+ * evaluate the same thrust placeholder expressions and follow the
+ * broadcasting rules of their CUDA counterparts. Common shapes are handled by
+ * the vectorized and multi-threaded loops in element_cpu.h, the loops below
+ * compute indices element by element for all others.
+ */
+
+template <class Functor>
+void Add(Functor functor,
+         Tensor out, Tensor in, float scale = 1.0) {
+  if(cpu::add(functor, scale, out, in))
+    return;
+
+  auto full = out->shape();
+  for(int i = 0; i < in->shape().size(); ++i)
+    full.set(i, std::max(full[i], in->shape()[i]));
+
+  float* o = out->data();
+  const float* in1 = in->data();
+  Shape outShape = out->shape();
+  Shape in1Shape = in->shape();
+
+  int outLength = outShape.elements();
+  bool same = outLength == full.elements() && outLength == in1Shape.elements();
+
+  int I = full[0] / outShape[0];
+  int J = full[1] / outShape[1];
+  int K = full[2] / outShape[2];
+  int L = full[3] / outShape[3];
+
+  int dims[4];
+  int dimsFull[4];
+  for(int index = 0; index < outLength; ++index) {
+    if(same) {
+      o[index] += functor(in1[index]) * scale;
+    }
+    else {
+      outShape.dims(index, dims);
+      float sum = 0;
+      for(int i = 0; i < I; ++i) {
+        for(int j = 0; j < J; ++j) {
+          for(int k = 0; k < K; ++k) {
+            for(int l = 0; l < L; ++l) {
+              dimsFull[0] = dims[0] + i;
+              dimsFull[1] = dims[1] + j;
+              dimsFull[2] = dims[2] + k;
+              dimsFull[3] = dims[3] + l;
+
+              int in1Index = in1Shape.bindex(dimsFull);
+              sum += functor(in1[in1Index]);
+            }
+          }
+        }
+      }
+      if(sum)
+        o[index] += sum * scale;
+    }
+  }
+}
+
+template <class Functor, class T1, class T2>
+void Reduce(Functor functor,
+         T1 out, T2 in, float scale = 1.0) {
+  out->set(0);
+  Add(functor, out, in, scale);
+}
+
+template <class Functor>
+void Add(Functor functor,
+         Tensor out, Tensor in1, Tensor in2, float scale = 1.0) {
+  if(cpu::add(functor, scale, out, in1, in2))
+    return;
+
+  auto full = out->shape();
+  for(int i = 0; i < in1->shape().size(); ++i)
+    full.set(i, std::max(full[i], in1->shape()[i]));
+  for(int i = 0; i < in2->shape().size(); ++i)
+    full.set(i, std::max(full[i], in2->shape()[i]));
+
+  float* o = out->data();
+  const float* i1 = in1->data();
+  const float* i2 = in2->data();
+  Shape outShape = out->shape();
+  Shape in1Shape = in1->shape();
+  Shape in2Shape = in2->shape();
+
+  int outLength = outShape.elements();
+  bool same = outLength == full.elements()
+    && outLength == in1Shape.elements()
+    && outLength == in2Shape.elements();
+
+  int I = full[0] / outShape[0];
+  int J = full[1] / outShape[1];
+  int K = full[2] / outShape[2];
+  int L = full[3] / outShape[3];
+
+  int dims[4];
+  int dimsFull[4];
+  for(int index = 0; index < outLength; ++index) {
+    if(same) {
+      o[index] += functor(i1[index], i2[index]) * scale;
+    }
+    else {
+      outShape.dims(index, dims);
+      float sum = 0;
+      for(int i = 0; i < I; ++i) {
+        for(int j = 0; j < J; ++j) {
+          for(int k = 0; k < K; ++k) {
+            for(int l = 0; l < L; ++l) {
+              dimsFull[0] = dims[0] + i;
+              dimsFull[1] = dims[1] + j;
+              dimsFull[2] = dims[2] + k;
+              dimsFull[3] = dims[3] + l;
+
+              int in1Index = in1Shape.bindex(dimsFull);
+              int in2Index = in2Shape.bindex(dimsFull);
+              sum += functor(i1[in1Index], i2[in2Index]);
+            }
+          }
+        }
+      }
+      if(sum)
+        o[index] += sum * scale;
+    }
+  }
+}
+
+template <class Functor>
+void Reduce(Functor functor,
+            Tensor out, Tensor in1, Tensor in2, float scale = 1.0) {
+
+  out->set(0);
+  Add(functor, out, in1, in2, scale);
+}
+
+template <class Functor>
+void Add(Functor functor,
+         Tensor out, Tensor in1, Tensor in2, Tensor in3) {
+  if(cpu::add(functor, 1.f, out, in1, in2, in3))
+    return;
+
+  auto full = out->shape();
+  for(int i = 0; i < in1->shape().size(); ++i)
+    full.set(i, std::max(full[i], in1->shape()[i]));
+  for(int i = 0; i < in2->shape().size(); ++i)
+    full.set(i, std::max(full[i], in2->shape()[i]));
+  for(int i = 0; i < in3->shape().size(); ++i)
+    full.set(i, std::max(full[i], in3->shape()[i]));
+
+  float* o = out->data();
+  const float* i1 = in1->data();
+  const float* i2 = in2->data();
+  const float* i3 = in3->data();
+  Shape outShape = out->shape();
+  Shape in1Shape = in1->shape();
+  Shape in2Shape = in2->shape();
+  Shape in3Shape = in3->shape();
+
+  int outLength = outShape.elements();
+  bool same = outLength == full.elements()
+    && outLength == in1Shape.elements()
+    && outLength == in2Shape.elements()
+    && outLength == in3Shape.elements();
+
+  int I = full[0] / outShape[0];
+  int J = full[1] / outShape[1];
+  int K = full[2] / outShape[2];
+  int L = full[3] / outShape[3];
+
+  int dims[4];
+  int dimsFull[4];
+  for(int index = 0; index < outLength; ++index) {
+    if(same) {
+      o[index] += functor(i1[index], i2[index], i3[index]);
+    }
+    else {
+      outShape.dims(index, dims);
+      float sum = 0;
+      for(int i = 0; i < I; ++i) {
+        for(int j = 0; j < J; ++j) {
+          for(int k = 0; k < K; ++k) {
+            for(int l = 0; l < L; ++l) {
+              dimsFull[0] = dims[0] + i;
+              dimsFull[1] = dims[1] + j;
+              dimsFull[2] = dims[2] + k;
+              dimsFull[3] = dims[3] + l;
+
+              int in1Index = in1Shape.bindex(dimsFull);
+              int in2Index = in2Shape.bindex(dimsFull);
+              int in3Index = in3Shape.bindex(dimsFull);
+              sum += functor(i1[in1Index], i2[in2Index], i3[in3Index]);
+            }
+          }
+        }
+      }
+      if(sum)
+        o[index] += sum;
+    }
+  }
+}
+
+template <class Functor>
+void Reduce(Functor functor,
+            Tensor out, Tensor in1, Tensor in2, Tensor in3) {
+
+  out->set(0);
+  Add(functor, out, in1, in2, in3);
+}
+
+template <class Functor, class T1, class T2>
+void Element(Functor functor,
+             T1 out, T2 in) {
+  if(cpu::element(functor, out, in))
+    return;
+
+  float* o = out->data();
+  const float* i1 = in->data();
+  Shape outShape = out->shape();
+  Shape inShape = in->shape();
+  bool broadcast = outShape != inShape;
+
+  int length = outShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    int inIndex = index;
+    if(broadcast) {
+      outShape.dims(index, dims);
+      inIndex = inShape.bindex(dims);
+    }
+    o[index] = functor(o[index], i1[inIndex]);
+  }
+}
+
+template <class Functor, class T1, class T2, class T3>
+void Element(Functor functor,
+             T1 out, T2 in1, T3 in2) {
+  if(cpu::element(functor, out, in1, in2))
+    return;
+
+  float* o = out->data();
+  const float* i1 = in1->data();
+  const float* i2 = in2->data();
+  Shape outShape = out->shape();
+  Shape inShape1 = in1->shape();
+  Shape inShape2 = in2->shape();
+  bool broadcast = outShape != inShape1 || outShape != inShape2;
+
+  int length = outShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    int inIndex1 = index;
+    int inIndex2 = index;
+    if(broadcast) {
+      outShape.dims(index, dims);
+      inIndex1 = inShape1.bindex(dims);
+      inIndex2 = inShape2.bindex(dims);
+    }
+    o[index] = functor(o[index], i1[inIndex1], i2[inIndex2]);
+  }
+}
+
+template <class Functor, class T1, class T2, class T3, class T4>
+void Element(Functor functor,
+             T1 out, T2 in1, T3 in2, T4 in3) {
+  if(cpu::element(functor, out, in1, in2, in3))
+    return;
+
+  float* o = out->data();
+  const float* i1 = in1->data();
+  const float* i2 = in2->data();
+  const float* i3 = in3->data();
+  Shape outShape = out->shape();
+  Shape inShape1 = in1->shape();
+  Shape inShape2 = in2->shape();
+  Shape inShape3 = in3->shape();
+  bool broadcast = outShape != inShape1
+                || outShape != inShape2
+                || outShape != inShape3;
+
+  int length = outShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    int inIndex1 = index;
+    int inIndex2 = index;
+    int inIndex3 = index;
+    if(broadcast) {
+      outShape.dims(index, dims);
+      inIndex1 = inShape1.bindex(dims);
+      inIndex2 = inShape2.bindex(dims);
+      inIndex3 = inShape3.bindex(dims);
+    }
+    o[index] = functor(o[index], i1[inIndex1], i2[inIndex2], i3[inIndex3]);
+  }
+}
+
+template <class Functor, class T1>
+void Element(Functor functor, T1 out) {
+  cpu::element(functor, out);
+}
+
+/**************** Pick ************************/
+
+template <class Functor, class T1, class T2>
+void Pick(Functor functor, T1 out, const T2 picks) {
+  if(cpu::pick(functor, out, picks))
+    return;
+
+  float* o = out->data();
+  const float* pick = picks->data();
+  Shape outShape = out->shape();
+
+  int length = outShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    outShape.dims(index, dims);
+    int row = dims[0];
+    int col = dims[1];
+    float picked = col == (int)pick[row];
+    o[index] = functor(o[index], picked);
+  }
+}
+
+template <class Functor, class T1, class T2, class T3>
+void Pick(Functor functor, T1 out, const T2 in, const T3 picks) {
+  if(cpu::pick(functor, out, picks, in))
+    return;
+
+  float* o = out->data();
+  const float* i1 = in->data();
+  const float* pick = picks->data();
+  Shape outShape = out->shape();
+  Shape inShape = in->shape();
+
+  int length = outShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    outShape.dims(index, dims);
+    int inIndex = inShape.bindex(dims);
+    int row = dims[0];
+    int col = dims[1];
+    float picked = col == (int)pick[row];
+    o[index] = functor(o[index], i1[inIndex], picked);
+  }
+}
+
+template <class Functor, class T1, class T2, class T3>
+void PickReduce(Functor functor, T1 out, const T2 in, const T3 picks) {
+  out->set(0);
+
+  if(cpu::pickReduce(functor, out, in, picks))
+    return;
+
+  float* o = out->data();
+  const float* i1 = in->data();
+  const float* pick = picks->data();
+  Shape outShape = out->shape();
+  Shape inShape = in->shape();
+
+  int length = inShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    inShape.dims(index, dims);
+    int row = dims[0];
+    int col = dims[1];
+    int outIndex = outShape.bindex(dims);
+    float picked = col == (int)pick[row];
+    float result = functor(i1[index], picked);
+
+    if(result)
+      o[outIndex] += result;
+  }
+}
+
+template <class Functor, class T1, class T2, class T3, class T4>
+void Pick(Functor functor, T1 out, const T2 in1, const T3 in2, const T4 picks) {
+  if(cpu::pick(functor, out, picks, in1, in2))
+    return;
+
+  float* o = out->data();
+  const float* i1 = in1->data();
+  const float* i2 = in2->data();
+  const float* pick = picks->data();
+  Shape outShape = out->shape();
+  Shape inShape1 = in1->shape();
+  Shape inShape2 = in2->shape();
+
+  int length = outShape.elements();
+  int dims[4];
+  for(int index = 0; index < length; ++index) {
+    outShape.dims(index, dims);
+    int inIndex1 = inShape1.bindex(dims);
+    int inIndex2 = inShape2.bindex(dims);
+    int row = dims[0];
+    int col = dims[1];
+    float picked = col == (int)pick[row];
+    o[index] = functor(o[index], i1[inIndex1], i2[inIndex2], picked);
+  }
+}
+
+/**
+ * C = A * B for int8 weights B from a quantized model, see cpu::Int8Gemm.
+ * Products of inference graphs use it when their right operand has int8
+ * weights attached.
+ */
+void ProdInt8(cublasHandle_t handle, Tensor C, const Tensor A, const Int8Weights& B);
+
+}
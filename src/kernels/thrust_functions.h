@@ -22,10 +22,11 @@
 // SOFTWARE.
 
 #include <cmath>
-#include <cublas_v2.h>
 #include <thrust/device_vector.h>
 #include <thrust/functional.h>
 
+#include "kernels/half.h"
+
 namespace thrust
 {
   namespace detail
@@ -114,6 +115,19 @@ namespace thrust
                        make_actor(_2));
       }
 
+      template<typename T>
+      struct unary_float16 : public thrust::unary_function<T,T> {
+        __host__ __device__
+        T operator()(const T &x) const { return marian::roundToHalf(x); }
+      };
+
+      template<typename Eval>
+      __host__ __device__
+      actor<composite<unary_operator<unary_float16>, actor<Eval>>>
+      Float16(const actor<Eval> &_1) {
+        return compose(unary_operator<unary_float16>(), _1);
+      }
+
       template<typename T>
       struct unary_relu : public thrust::unary_function<T,T> {
         __host__ __device__
@@ -149,7 +163,7 @@ namespace thrust
       template<typename T>
       struct binary_clip : public thrust::binary_function<T, T, T> {
         __host__ __device__
-        T operator()(const T &x, const T &y) const { return abs(x) >= y ? sgn(x) * y : x; }
+        T operator()(const T &x, const T &y) const { return fabsf(x) >= y ? sgn(x) * y : x; }
       };
 
       template<typename T1, typename T2>
@@ -171,7 +185,7 @@ namespace thrust
       template<typename T>
       struct binary_prune : public thrust::binary_function<T, T, T> {
         __host__ __device__
-        T operator()(const T &x, const T &eps) const { return abs(x) >= eps ? x : 0; }
+        T operator()(const T &x, const T &eps) const { return fabsf(x) >= eps ? x : 0; }
       };
 
       template<typename T1, typename T2>
@@ -196,7 +210,7 @@ namespace thrust
         T operator()(const T &x, const T &y) const {
           float tx = x;
           if(y == (int)y && (int)y % 2 == 0)
-            tx = abs(x);
+            tx = fabsf(x);
           return powf(tx, y);
         }
       };
@@ -250,6 +250,11 @@ namespace marian {
       }
   };
 
+  /**
+   * Dense layer over the columns filter of its parameters. The single input
+   * version slices the parameters on its first call and reuses them later,
+   * e.g. for all decoder steps of a batch with the same shortlist.
+   */
   class DenseWithFilter : public Layer {
     private:
       int outDim_;
@@ -275,28 +280,28 @@ namespace marian {
       Expr operator()(Expr in) {
         auto g = in->graph();
 
-        auto W = cols(g->param(name_ + "_W", {in->shape()[1], outDim_},
-                               keywords::init=inits::glorot_uniform),
-                      filter_);
-        auto b = cols(g->param(name_ + "_b", {1, outDim_},
-                               keywords::init=inits::zeros),
-                      filter_);
-
-        params_ = { W, b };
+        if(params_.empty()) {
+          auto W = cols(g->param(name_ + "_W", {in->shape()[1], outDim_},
+                                 keywords::init=inits::glorot_uniform),
+                        filter_);
+          auto b = cols(g->param(name_ + "_b", {1, outDim_},
+                                 keywords::init=inits::zeros),
+                        filter_);
 
-        Expr out;
-        if(layerNorm_) {
-          auto gamma = cols(g->param(name_ + "_gamma", {1, outDim_},
-                                     keywords::init=inits::from_value(1.0)),
-                            filter_);
+          params_ = { W, b };
 
-          params_.push_back(gamma);
-          out = layer_norm(dot(in, W), gamma, b);
-        }
-        else {
-          out = affine(in, W, b);
+          if(layerNorm_)
+            params_.push_back(cols(g->param(name_ + "_gamma", {1, outDim_},
+                                            keywords::init=inits::from_value(1.0)),
+                                   filter_));
         }
 
+        Expr out;
+        if(layerNorm_)
+          out = layer_norm(dot(in, params_[0]), params_[2], params_[1]);
+        else
+          out = affine(in, params_[0], params_[1]);
+
         switch (activation_) {
           case act::linear :
             return out;
@@ -115,6 +115,12 @@ std::function<void(Tensor)> from_vector(const std::vector<size_t>& v) {
   return from_vector(vf);
 }
 
+std::function<void(Tensor)> from_tensor(Tensor in) {
+  return [in](Tensor t) {
+    t->copyFrom(in);
+  };
+}
+
 std::function<void(Tensor)> from_sparse_vector(
   std::pair<std::vector<size_t>, std::vector<float>>& v) {
 
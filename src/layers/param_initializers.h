@@ -56,6 +56,9 @@ void glorot_normal(Tensor t);
 std::function<void(Tensor)> from_vector(const std::vector<float>& v);
 std::function<void(Tensor)> from_vector(const std::vector<size_t>& v);
 
+/** Copies a tensor of the same size, which may belong to another graph */
+std::function<void(Tensor)> from_tensor(Tensor in);
+
 std::function<void(Tensor)> from_sparse_vector(
   std::pair<std::vector<size_t>, std::vector<float>>& v);
 
@@ -44,11 +44,12 @@ class DecoderStateAmun : public DecoderState {
     void setProbs(Expr probs) { probs_ = probs; }
 
     Ptr<DecoderState> select(const std::vector<size_t>& selIdx) {
-      int numSelected = selIdx.size();
+      int dimBatch = encState_->getBatchSize();
+      int numSelected = selIdx.size() / dimBatch;
       int dimState = state_->shape()[1];
 
       auto selectedState = reshape(rows(state_, selIdx),
-                                   {1, dimState, 1, numSelected});
+                                   {dimBatch, dimState, 1, numSelected});
 
       return New<DecoderStateAmun>(selectedState, probs_, encState_);
     }
@@ -106,6 +107,11 @@ class EncoderAmun : public EncoderBase {
 
       return New<EncoderStateAmun>(xContext, xMask, batch);
     }
+
+    Ptr<EncoderState>
+    fromContext(Expr context, Expr mask, Ptr<data::CorpusBatch> batch) {
+      return New<EncoderStateAmun>(context, mask, batch);
+    }
 };
 
 class DecoderAmun : public DecoderBase {
@@ -185,7 +191,9 @@ class DecoderAmun : public DecoderBase {
                             normalize=layerNorm)
                         (embeddings, stateOut, alignedContext);
 
-      auto logitsOut = Dense("ff_logit_l2", dimTrgVoc)(logitsL1);
+      auto logitsOut = shortlist_ ?
+        shortlistLogits("ff_logit_l2", logitsL1) :
+        Dense("ff_logit_l2", dimTrgVoc)(logitsL1);
 
       return New<DecoderStateAmun>(stateOut, logitsOut,
                                    state->getEncoderState());
@@ -202,11 +210,10 @@ class Amun : public EncoderDecoder<EncoderAmun, DecoderAmun> {
     void load(Ptr<ExpressionGraph> graph,
               const std::string& name) {
       using namespace keywords;
+      using namespace quantization;
 
       LOG(info, "Loading model from {}", name);
 
-      auto numpy = cnpy::npz_load(name);
-
       std::vector<std::string> parameters = {
         // Source word embeddings
         "Wemb",
@@ -287,7 +294,37 @@ class Amun : public EncoderDecoder<EncoderAmun, DecoderAmun> {
         {"ff_logit_b", "ff_logit_l2_b"}
       };
 
+      if(BinaryModel::isBinaryModel(name)) {
+        auto model = New<BinaryModel>(name);
+        for(auto pName : parameters) {
+          std::string mapped = nameMap.count(pName) ? nameMap[pName] : pName;
+          auto values = model->get(pName + INT8_SUFFIX);
+          auto scales = model->get(pName + SCALES_SUFFIX);
+          if(values && scales) {
+            graph->int8Param(mapped, fromBinary(model, *values, *scales));
+            continue;
+          }
+
+          auto item = model->get(pName);
+          UTIL_THROW_IF2(!item, "Parameter " << pName << " does not exist.");
+          graph->mappedParam(mapped, model, *item);
+        }
+        return;
+      }
+
+      auto numpy = cnpy::npz_load(name);
+
       for(auto name : parameters) {
+        std::string pName = name;
+        if(nameMap.count(name))
+          pName = nameMap[name];
+
+        if(numpy.count(name + INT8_SUFFIX) && numpy.count(name + SCALES_SUFFIX)) {
+          graph->int8Param(pName, fromNumpy(numpy[name + INT8_SUFFIX],
+                                            numpy[name + SCALES_SUFFIX]));
+          continue;
+        }
+
         UTIL_THROW_IF2(numpy.count(name) == 0,
                        "Parameter " << name << " does not exist.");
 
@@ -301,13 +338,10 @@ class Amun : public EncoderDecoder<EncoderAmun, DecoderAmun> {
           shape.set(1, numpy[name].shape[0]);
         }
 
-        std::string pName = name;
-        if(nameMap.count(name))
-          pName = nameMap[name];
-
         graph->param(pName, shape,
                      init=inits::from_numpy(numpy[name]));
       }
+      numpy.destruct();
     }
 
     void save(Ptr<ExpressionGraph> graph,
@@ -2,6 +2,7 @@
 
 #include "data/corpus.h"
 #include "data/batch_generator.h"
+#include "data/filter.h"
 
 #include "training/config.h"
 #include "graph/expression_graph.h"
@@ -12,6 +13,45 @@
 
 namespace marian {
 
+/**
+ * Bindings that refill the batch inputs of a replayed graph, see
+ * ExpressionGraph::replay().
+ */
+namespace inputs {
+
+/** Word indices of the sub-batch for a rows() node */
+inline InputBinding rows(size_t index) {
+  return [index](Expr node, Ptr<data::CorpusBatch> batch) {
+    std::static_pointer_cast<RowsNodeOp>(node)->setIndices((*batch)[index]->indeces());
+  };
+}
+
+/** Word indices of the sub-batch for a constant */
+inline InputBinding indices(size_t index) {
+  return [index](Expr node, Ptr<data::CorpusBatch> batch) {
+    std::static_pointer_cast<ConstantNode>(node)
+      ->setInit(inits::from_vector((*batch)[index]->indeces()));
+  };
+}
+
+/** Mask of the sub-batch for a constant */
+inline InputBinding mask(size_t index) {
+  return [index](Expr node, Ptr<data::CorpusBatch> batch) {
+    std::static_pointer_cast<ConstantNode>(node)
+      ->setInit(inits::from_vector((*batch)[index]->mask()));
+  };
+}
+
+/** Guided alignment of the batch for a constant */
+inline InputBinding guidedAlignment() {
+  return [](Expr node, Ptr<data::CorpusBatch> batch) {
+    std::static_pointer_cast<ConstantNode>(node)
+      ->setInit(inits::from_vector(batch->getGuidedAlignment()));
+  };
+}
+
+}
+
 class EncoderBase {
   protected:
     Ptr<Config> options_;
@@ -38,6 +78,9 @@ class EncoderBase {
       auto xMask = graph->constant({dimBatch, 1, dimWords},
                                    init=inits::from_vector(subBatch->mask()));
 
+      graph->bindInput(chosenEmbeddings, inputs::rows(index));
+      graph->bindInput(xMask, inputs::mask(index));
+
       return std::make_tuple(x, xMask);
     }
 
@@ -52,6 +95,12 @@ class EncoderBase {
 
     virtual Ptr<EncoderState>
     build(Ptr<ExpressionGraph>, Ptr<data::CorpusBatch>, size_t) = 0;
+
+    /** The state build() would return for a context computed elsewhere */
+    virtual Ptr<EncoderState>
+    fromContext(Expr context, Expr mask, Ptr<data::CorpusBatch> batch) {
+      UTIL_THROW2("This encoder cannot be restored from its context");
+    }
 };
 
 class DecoderBase {
@@ -61,6 +110,21 @@ class DecoderBase {
 
     bool inference_{false};
 
+    Ptr<FilterInfo> shortlist_;
+    Ptr<DenseWithFilter> output_;
+
+    /**
+     * The output layer restricted to the shortlist, its parameters are
+     * sliced on the first step and shared by the later ones.
+     */
+    Expr shortlistLogits(const std::string& name, Expr in) {
+      if(!output_)
+        output_ = New<DenseWithFilter>(name,
+                                       options_->get<std::vector<int>>("dim-vocabs").back(),
+                                       shortlist_->indeces());
+      return (*output_)(in);
+    }
+
   public:
 
     template <class ...Args>
@@ -97,6 +161,10 @@ class DecoderBase {
       auto yIdx = graph->constant({(int)subBatch->indeces().size(), 1},
                                   init=inits::from_vector(subBatch->indeces()));
 
+      graph->bindInput(chosenEmbeddings, inputs::rows(index));
+      graph->bindInput(yMask, inputs::mask(index));
+      graph->bindInput(yIdx, inputs::indices(index));
+
       auto yShifted = shift(y, {0, 0, 1, 0});
 
       state->setTargetEmbeddings(yShifted);
@@ -106,6 +174,19 @@ class DecoderBase {
 
     virtual Ptr<DecoderState> startState(Ptr<EncoderState> encState) = 0;
 
+    /**
+     * Computes the output layer only for the words of the shortlist, where
+     * supported. Output column i then belongs to word shortlist->reverseMap(i).
+     */
+    virtual void setShortlist(Ptr<FilterInfo> shortlist) {
+      shortlist_ = shortlist;
+      output_ = nullptr;
+    }
+
+    virtual Ptr<FilterInfo> getShortlist() {
+      return shortlist_;
+    }
+
     virtual void selectEmbeddings(Ptr<ExpressionGraph> graph,
                                   Ptr<DecoderState> state,
                                   const std::vector<size_t>& embIdx) {
@@ -115,9 +196,11 @@ class DecoderBase {
       int dimPosEmb = options_->get<int>("dim-pos");
       int dimTrgVoc = options_->get<std::vector<int>>("dim-vocabs").back();
 
+      int dimBatch = state->getEncoderState()->getBatchSize();
+
       Expr selectedEmbs;
       if(embIdx.empty()) {
-        selectedEmbs = graph->constant({1, dimTrgEmb + dimPosEmb},
+        selectedEmbs = graph->constant({dimBatch, dimTrgEmb + dimPosEmb},
                                        init=inits::zeros);
       }
       else {
@@ -125,7 +208,7 @@ class DecoderBase {
         selectedEmbs = rows(yEmb, embIdx);
 
         selectedEmbs = reshape(selectedEmbs,
-                               {1, dimTrgEmb, 1, (int)embIdx.size()});
+                               {dimBatch, dimTrgEmb, 1, (int)embIdx.size() / dimBatch});
       }
       state->setTargetEmbeddings(selectedEmbs);
     }
@@ -149,11 +232,13 @@ class EncoderDecoderBase {
                                   Ptr<DecoderState> state,
                                   const std::vector<size_t>&) = 0;
 
+    /** One decoder step, the probabilities are unnormalized scores if !normalize */
     virtual Ptr<DecoderState>
     step(Ptr<ExpressionGraph> graph,
          Ptr<DecoderState>,
          const std::vector<size_t>&,
-         const std::vector<size_t>&) = 0;
+         const std::vector<size_t>&,
+         bool normalize = true) = 0;
 
     virtual Ptr<DecoderState>
     step(Ptr<ExpressionGraph>, Ptr<DecoderState>) = 0;
@@ -255,14 +340,16 @@ class EncoderDecoder : public EncoderDecoderBase {
     virtual Ptr<DecoderState> step(Ptr<ExpressionGraph> graph,
                                    Ptr<DecoderState> state,
                                    const std::vector<size_t>& hypIndices,
-                                   const std::vector<size_t>& embIndices) {
+                                   const std::vector<size_t>& embIndices,
+                                   bool normalize = true) {
 
       auto selectedState = hypIndices.empty() ? state : state->select(hypIndices);
 
       selectEmbeddings(graph, selectedState, embIndices);
       selectedState->setSingleStep(true);
       auto nextState = step(graph, selectedState);
-      nextState->setProbs(logsoftmax(nextState->getProbs()));
+      if(normalize)
+        nextState->setProbs(logsoftmax(nextState->getProbs()));
       return nextState;
     }
 
@@ -27,14 +27,15 @@ class DecoderStateHardAtt : public DecoderState {
     virtual void setProbs(Expr probs) { probs_ = probs; }
     
     virtual Ptr<DecoderState> select(const std::vector<size_t>& selIdx) {
-      int numSelected = selIdx.size();
+      int dimBatch = encState_->getBatchSize();
+      int numSelected = selIdx.size() / dimBatch;
       int dimState = states_[0]->shape()[1];
       
       std::vector<Expr> selectedStates;
       for(auto state : states_) {
         selectedStates.push_back(
           reshape(rows(state, selIdx),
-                  {1, dimState, 1, numSelected})
+                  {dimBatch, dimState, 1, numSelected})
         );
       }
       
@@ -220,6 +221,9 @@ class DecoderHardAtt : public DecoderBase {
       using namespace keywords;
 
       auto ret = DecoderBase::groundTruth(state, graph, batch, index);
+
+      // the attention indices below are computed from the words
+      graph->cancelRecording();
       
       auto subBatch = (*batch)[index];
       int dimBatch = subBatch->batchSize();
@@ -252,16 +256,20 @@ class DecoderHardAtt : public DecoderBase {
       
       int dimSrcWords = state->getEncoderState()->getContext()->shape()[2];
 
+      // positions in the flat context, word i of sentence b is i * dimBatch + b
+      int dimBatch = state->getEncoderState()->getBatchSize();
+
       if(embIdx.empty()) {
-        stateHardAtt->setAttentionIndices({0});  
+        std::vector<size_t> attentionIndices(dimBatch);
+        std::iota(attentionIndices.begin(), attentionIndices.end(), 0);
+        stateHardAtt->setAttentionIndices(attentionIndices);
       }
       else {
+        auto& attentionIndices = stateHardAtt->getAttentionIndices();
         for(size_t i = 0; i < embIdx.size(); ++i)
-          if(specialSymbols_.count(embIdx[i])) {
-            stateHardAtt->getAttentionIndices()[i]++;
-            if(stateHardAtt->getAttentionIndices()[i] >= dimSrcWords)
-              stateHardAtt->getAttentionIndices()[i] = dimSrcWords - 1;
-          }
+          if(specialSymbols_.count(embIdx[i])
+             && attentionIndices[i] + dimBatch < dimSrcWords * dimBatch)
+            attentionIndices[i] += dimBatch;
       }
     }
 
@@ -554,16 +562,20 @@ class MultiDecoderHardSoftAtt : public DecoderHardSoftAtt {
       
       int dimSrcWords = mEncState->enc1->getContext()->shape()[2];
 
+      // positions in the flat context, word i of sentence b is i * dimBatch + b
+      int dimBatch = state->getEncoderState()->getBatchSize();
+
       if(embIdx.empty()) {
-        stateHardAtt->setAttentionIndices({0});  
+        std::vector<size_t> attentionIndices(dimBatch);
+        std::iota(attentionIndices.begin(), attentionIndices.end(), 0);
+        stateHardAtt->setAttentionIndices(attentionIndices);
       }
       else {
+        auto& attentionIndices = stateHardAtt->getAttentionIndices();
         for(size_t i = 0; i < embIdx.size(); ++i)
-          if(specialSymbols_.count(embIdx[i])) {
-            stateHardAtt->getAttentionIndices()[i]++;
-            if(stateHardAtt->getAttentionIndices()[i] >= dimSrcWords)
-              stateHardAtt->getAttentionIndices()[i] = dimSrcWords - 1;
-          }
+          if(specialSymbols_.count(embIdx[i])
+             && attentionIndices[i] + dimBatch < dimSrcWords * dimBatch)
+            attentionIndices[i] += dimBatch;
       }
     }
 };
@@ -18,6 +18,10 @@ struct EncoderStateMultiS2S : public EncoderState {
   virtual const std::vector<size_t>& getSourceWords() {
     return enc1->getSourceWords();
   }
+
+  virtual int getBatchSize() {
+    return enc1->getBatchSize();
+  }
 };
 
 typedef DecoderStateS2S DecoderStateMultiS2S;
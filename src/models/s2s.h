@@ -44,14 +44,15 @@ class DecoderStateS2S : public DecoderState {
     void setProbs(Expr probs) { probs_ = probs; }
 
     Ptr<DecoderState> select(const std::vector<size_t>& selIdx) {
-      int numSelected = selIdx.size();
+      int dimBatch = encState_->getBatchSize();
+      int numSelected = selIdx.size() / dimBatch;
       int dimState = states_[0]->shape()[1];
 
       std::vector<Expr> selectedStates;
       for(auto state : states_) {
         selectedStates.push_back(
           reshape(rows(state, selIdx),
-                  {1, dimState, 1, numSelected})
+                  {dimBatch, dimState, 1, numSelected})
         );
       }
 
@@ -130,6 +131,11 @@ class EncoderS2S : public EncoderBase {
         return New<EncoderStateS2S>(xContext, xMask, batch);
       }
     }
+
+    Ptr<EncoderState>
+    fromContext(Expr context, Expr mask, Ptr<data::CorpusBatch> batch) {
+      return New<EncoderStateS2S>(context, mask, batch);
+    }
 };
 
 class DecoderS2S : public DecoderBase {
@@ -249,7 +255,12 @@ class DecoderS2S : public DecoderBase {
                         (embeddings, outputLn, alignedContext);
 
       Expr logitsOut;
-      if(options_->get<bool>("tied-embeddings")) {
+      if(shortlist_) {
+        UTIL_THROW_IF2(options_->get<bool>("tied-embeddings"),
+                       "Shortlists are not supported with tied embeddings");
+        logitsOut = shortlistLogits(prefix_ + "_ff_logit_l2", logitsL1);
+      }
+      else if(options_->get<bool>("tied-embeddings")) {
         if(!tiedOutputWeights_)
           tiedOutputWeights_ = transpose(graph->get(prefix_ + "_Wemb"));
 
@@ -289,6 +300,7 @@ class S2S : public EncoderDecoder<EncoderS2S, DecoderS2S> {
 
         auto aln = graph->constant({dimBatch, 1, dimSrc, dimTrg},
                                    keywords::init=inits::from_vector(batch->getGuidedAlignment()));
+        graph->bindInput(aln, inputs::guidedAlignment());
 
         std::string guidedCostType = options_->get<std::string>("guided-alignment-cost");
 
@@ -9,6 +9,8 @@ struct EncoderState {
   virtual Expr getContext() = 0;
   virtual Expr getMask() = 0;
   virtual const std::vector<size_t>& getSourceWords() = 0;
+
+  virtual int getBatchSize() { return getContext()->shape()[0]; }
 };
 
 class DecoderState {
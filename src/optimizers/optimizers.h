@@ -25,7 +25,34 @@ class OptimizerBase {
     void update(Tensor params, Tensor grads) {
       if(clipper_)
         clipper_->clip(grads);
-      updateImpl(params, grads);
+
+      if(masterWeights_) {
+        if(!master_) {
+          masterAlloc_ = New<TensorAllocator>(params->getDevice());
+          masterAlloc_->reserveExact(params->size());
+          masterAlloc_->allocate(master_, {1, (int)params->size()});
+          master_->copyFrom(params);
+        }
+        updateImpl(master_, grads);
+        Element(_1 = Float16(_2), params, master_);
+      }
+      else {
+        updateImpl(params, grads);
+      }
+    }
+
+    /**
+     * Updates fp32 master copies of the parameters and writes them back to
+     * the parameters rounded to fp16, for mixed precision training. The
+     * copies are taken from the parameters at the first update.
+     */
+    void setMasterWeights(bool masterWeights) {
+      masterWeights_ = masterWeights;
+    }
+
+    /** The fp32 master weights, null before the first update or without them */
+    Tensor masterParams() {
+      return master_;
     }
 
     void updateSchedule() {
@@ -39,6 +66,10 @@ class OptimizerBase {
 
     Ptr<ClipperBase> clipper_;
     float eta_;
+
+    bool masterWeights_{false};
+    Ptr<TensorAllocator> masterAlloc_;
+    Tensor master_;
 };
 
 class Sgd : public OptimizerBase {
@@ -63,6 +63,13 @@ void TensorBase::set(const std::vector<float> &v) {
   cudaStreamSynchronize(0);
 }
 
+void TensorBase::set(const float* begin, const float* end) {
+  CUDA_CHECK(cudaSetDevice(device_));
+  CUDA_CHECK(cudaMemcpy(data_, begin, (end - begin) * sizeof(float),
+             cudaMemcpyHostToDevice));
+  cudaStreamSynchronize(0);
+}
+
 void TensorBase::setSparse(const std::vector<size_t> &k,
                            const std::vector<float> &v) {
   cudaSetDevice(device_);
@@ -70,6 +77,13 @@ void TensorBase::setSparse(const std::vector<size_t> &k,
   cudaStreamSynchronize(0);
 }
 
+void TensorBase::getSparse(const std::vector<size_t> &k,
+                           std::vector<float> &v) {
+  cudaSetDevice(device_);
+  GetSparse(data_, k, v);
+  cudaStreamSynchronize(0);
+}
+
 
 void TensorBase::copyFrom(Tensor in) {
     cudaSetDevice(device_);
@@ -78,99 +92,6 @@ void TensorBase::copyFrom(Tensor in) {
     cudaStreamSynchronize(0);
 }
 
-std::string TensorBase::debug() {
-  cudaSetDevice(device_);
-  std::stringstream strm;
-  assert(shape_.size());
-  strm << "shape=" << shape_[0];
-  for(int i = 1; i < shape_.size(); ++i)
-     strm << "x" << shape_[i];
-  strm << " size=" << shape_.elements()
-     << " (" << shape_.elements() * sizeof(float) << "B)";
-  strm << " device=" << device_ << std::endl;
-
-  // values
-  size_t totSize = shape_.elements();
-  std::vector<Float> values(totSize);
-  get(values);
-
-
-  size_t dispCols = 5;
-  strm << std::fixed << std::setprecision(8) << std::setfill(' ');
-  for(size_t l = 0; l < shape()[3]; ++l) {
-    for(size_t k = 0; k < shape()[2]; ++k) {
-       strm << "[ ";
-       if(shape()[0] > 10) {
-          for (size_t i = 0; i < shape()[0] && i < dispCols; ++i) {
-             if(i > 0)
-               strm << std::endl << "  ";
-             for (size_t j = 0; j < shape()[1] && j < dispCols; ++j) {
-               strm << std::setw(12)
-                    << values[  i * shape().stride(0)
-                              + j * shape().stride(1)
-                              + k * shape().stride(2)
-                              + l * shape().stride(3) ] << " ";
-             }
-             if(shape()[1] > dispCols)
-                strm << "... ";
-             for (size_t j = shape()[1] - dispCols; j < shape()[1]; ++j) {
-               strm << std::setw(12)
-                    << values[  i * shape().stride(0)
-                              + j * shape().stride(1)
-                              + k * shape().stride(2)
-                              + l * shape().stride(3) ] << " ";
-             }
-          }
-          strm << std::endl << "  ...";
-          for (size_t i = shape()[0] - dispCols; i < shape()[0]; ++i) {
-             if(i > 0)
-               strm << std::endl << "  ";
-             for (size_t j = 0; j < shape()[1] && j < dispCols; ++j) {
-               strm << std::setw(12)
-                    << values[  i * shape().stride(0)
-                              + j * shape().stride(1)
-                              + k * shape().stride(2)
-                              + l * shape().stride(3) ] << " ";
-             }
-             if(shape()[1] > dispCols)
-                strm << "... ";
-             for (size_t j = shape()[1] - dispCols; j < shape()[1]; ++j) {
-               strm << std::setw(12)
-                    << values[  i * shape().stride(0)
-                              + j * shape().stride(1)
-                              + k * shape().stride(2)
-                              + l * shape().stride(3) ] << " ";
-             }
-          }
-       }
-       else {
-          for (size_t i = 0; i < shape()[0] && i < 10; ++i) {
-             if(i > 0)
-               strm << std::endl << "  ";
-             for (size_t j = 0; j < shape()[1] && j < dispCols; ++j) {
-               strm << std::setw(12)
-                    << values[  i * shape().stride(0)
-                              + j * shape().stride(1)
-                              + k * shape().stride(2)
-                              + l * shape().stride(3) ] << " ";
-             }
-             if(shape()[1] > dispCols)
-                strm << "... ";
-             for (size_t j = shape()[1] - dispCols; j < shape()[1]; ++j) {
-               strm << std::setw(12)
-                    << values[  i * shape().stride(0)
-                              + j * shape().stride(1)
-                              + k * shape().stride(2)
-                              + l * shape().stride(3) ] << " ";
-             }
-          }
-       }
-       strm << "]" << std::endl;
-    }
-  }
-  return strm.str();
-}
-
 DeviceGPU::~DeviceGPU() {
   cudaSetDevice(device_);
   if(data_) {
@@ -202,14 +123,4 @@ void DeviceGPU::reserve(size_t size) {
    size_ = size;
 }
 
-Tensor operator<<(Tensor t, const std::vector<float>& v) {
-  t->set(v);
-  return t;
-}
-
-Tensor operator>>(Tensor t, std::vector<float>& v) {
-  t->get(v);
-  return t;
-}
-
 }
@@ -63,15 +63,22 @@ class TensorBase : public std::enable_shared_from_this<TensorBase> {
     void set(float value);
 
     void set(const std::vector<float> &v);
+
+    void set(const float* begin, const float* end);
     
     void setSparse(const std::vector<size_t> &k,
                    const std::vector<float> &v);
 
+    /** Gathers the elements at positions k into v with a single copy */
+    void getSparse(const std::vector<size_t> &k,
+                   std::vector<float> &v);
+
     void copyFrom(Tensor);
 
     std::string debug();
 };
 
+#ifdef CUDA_FOUND
 class DeviceGPU {
   private:
     float* data_;
@@ -101,6 +108,7 @@ class DeviceGPU {
       return device_;
     }
 };
+#endif
 
 typedef std::shared_ptr<TensorBase> Tensor;
 
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <map>
 #include <set>
-#include <deque>
 
 #include "common/definitions.h"
 #include "tensors/tensor.h"
+#include "tensors/tensor_cpu.h"
 
 namespace marian {
   
@@ -15,54 +17,94 @@ class AllocationException : public std::exception {
     }
 };
 
-class TensorAllocator {
+/**
+ * Usage figures of a TensorAllocator, sizes are in floats.
+ */
+struct AllocatorStats {
+  size_t capacity{0};       // reserved space
+  size_t used{0};           // space held by allocated tensors
+  size_t peak{0};           // largest value of used since construction
+  size_t free{0};           // space in gaps between and after tensors
+  size_t largestGap{0};
+  size_t gaps{0};
+  size_t reallocations{0};  // times the reserved space had to grow
+
+  /** Share of free space outside the largest gap, 0 if it is all in one piece */
+  float fragmentation() const {
+    return free ? 1.f - (float)largestGap / free : 0.f;
+  }
+};
+
+/**
+ * Hands out tensors from one contiguous block of device memory. Free space
+ * is kept as gaps indexed both by size, for a best-fit search, and by
+ * address, so that a freed tensor is merged with the gaps right before and
+ * after it. Allocated tensors are indexed by address as well. Allocation and
+ * deallocation take O(log n) in the number of tensors and gaps.
+ */
+template <class Device>
+class TensorAllocatorDerived {
   private:
     const size_t CHUNK  = 512;
     const size_t MBYTE  = 1024 * 1024;
     const size_t FLOATS = CHUNK * MBYTE / sizeof(float);
 
-    DeviceGPU device_;
+    Device device_;
 
+    // gaps ordered by size and then address for best-fit and by address
+    // for coalescing, both hold every gap
     typedef std::pair<size_t, float*> Gap;
     std::set<Gap> gaps_;
-    Gap lastGap_;
-    
+    std::map<float*, size_t> gapsByAddress_;
+
     bool throw_{false};
 
-    std::deque<Tensor> allocated_;
+    // tensors of size 0 may share an address with another tensor
+    std::multimap<float*, Tensor> allocated_;
+
+    size_t used_{0};
+    size_t peak_{0};
+    size_t reallocations_{0};
 
     void reset(Tensor t, float* start) {
       t->reset(start);
     }
 
+    void insertGap(float* start, size_t size) {
+      if(size > 0) {
+        gaps_.emplace(size, start);
+        gapsByAddress_.emplace(start, size);
+      }
+    }
+
+    void eraseGap(std::map<float*, size_t>::iterator it) {
+      gaps_.erase(Gap(it->second, it->first));
+      gapsByAddress_.erase(it);
+    }
+
     void resetAllocated(float* oldStart) {
       gaps_.clear();
+      gapsByAddress_.clear();
+
+      std::multimap<float*, Tensor> moved;
       size_t prev = 0;
-      for(auto&& t : allocated_) {
+      for(auto&& a : allocated_) {
+        Tensor t = a.second;
         size_t dist = t->data() - oldStart;
         reset(t, device_.data() + dist);
+        moved.emplace(t->data(), t);
         if(dist > prev)
-          gaps_.emplace(dist - prev, device_.data() + prev);
-        prev = dist + t->size();
+          insertGap(device_.data() + prev, dist - prev);
+        prev = std::max(prev, dist + t->size());
       }
+      allocated_.swap(moved);
 
-      if(allocated_.empty()) {
-        lastGap_ = { device_.capacity(), device_.data() };
-      }
-      else {
-        size_t used = allocated_.back()->data() - device_.data() + allocated_.back()->size();
-        size_t gap = device_.capacity() - used;
-        float* addr = allocated_.back()->data() + allocated_.back()->size();
-        lastGap_ = { gap, addr };
-      }
-
-      gaps_.insert(lastGap_);
+      insertGap(device_.data() + prev, device_.capacity() - prev);
     }
 
     auto getGap(Shape shape) -> decltype(gaps_.begin()) {
-      auto it = std::lower_bound(gaps_.begin(), gaps_.end(),
-                                 std::make_pair((size_t)shape.elements(), (float*)0));
-      return it;
+      size_t elements = std::max(shape.elements(), 1);
+      return gaps_.lower_bound(std::make_pair(elements, (float*)0));
     }
 
     auto checkSpace(Shape shape) -> decltype(gaps_.begin()) {
@@ -70,24 +112,28 @@ class TensorAllocator {
       if(gapIt == gaps_.end()) {
         if(throw_)
           throw AllocationException();
-        size_t incr = device_.capacity() - lastGap_.first + shape.elements();
+
+        // grow by the space up to the last tensor and the requested size,
+        // which extends the gap at the end
+        size_t incr = size() + shape.elements();
         reserve(device_.capacity() + incr);
-        gapIt = gaps_.find(lastGap_);
+        ++reallocations_;
+        logStats();
+        gapIt = getGap(shape);
       }
       return gapIt;
     }
 
   public:
-    TensorAllocator(size_t device)
+    TensorAllocatorDerived(size_t device)
      : device_(device) {
-      lastGap_ = { device_.capacity(), device_.data() };
-      gaps_.insert(lastGap_);
+      insertGap(device_.data(), device_.capacity());
     }
 
-    ~TensorAllocator() {
+    ~TensorAllocatorDerived() {
       clear();
     }
-    
+
     void throwAtReallocation(bool throwRealloc) {
       throw_ = throwRealloc;
     }
@@ -97,7 +143,6 @@ class TensorAllocator {
       LOG(memory, "Extending reserved space to {} MB (device {})",
 	  mult * CHUNK, device_.getDevice());
 
-      size_t old = device_.capacity();
       float* oldStart = device_.data();
       device_.reserve(mult * FLOATS);
       resetAllocated(oldStart);
@@ -108,7 +153,6 @@ class TensorAllocator {
       LOG(memory, "Reserving space for {} floats ({} MB, device {})",
 	  elements, mbytes, device_.getDevice());
 
-      size_t old = device_.capacity();
       float* oldStart = device_.data();
       device_.reserve(elements);
       resetAllocated(oldStart);
@@ -116,49 +160,62 @@ class TensorAllocator {
 
     void clear() {
       gaps_.clear();
-      lastGap_ = { device_.capacity(), device_.data() };
-      gaps_.insert(lastGap_);
+      gapsByAddress_.clear();
+      insertGap(device_.data(), device_.capacity());
       allocated_.clear();
+      used_ = 0;
     }
 
     void allocate(Tensor &t, Shape shape) {
       if(!t || t->shape() != shape) {
         auto it = checkSpace(shape);
-        float* start = it->second;
-        t.reset(new TensorBase(start, shape, device_.getDevice()));
-        allocated_.push_back(t);
-        if(it->first > t->size())
-          gaps_.emplace(it->first - t->size(), it->second + t->size());
+        Gap gap = *it;
         gaps_.erase(it);
+        gapsByAddress_.erase(gap.second);
+
+        t.reset(new TensorBase(gap.second, shape, device_.getDevice()));
+        allocated_.emplace(t->data(), t);
+        insertGap(gap.second + t->size(), gap.first - t->size());
+
+        used_ += t->size();
+        peak_ = std::max(peak_, used_);
       }
     }
 
     void free(Tensor& t) {
-      auto it = allocated_.rbegin();
-      while(it != allocated_.rend()) {
-        if(*it == t) {
-          Gap gap = { t->size(), t->data() };
-          allocated_.erase(std::next(it).base());
-
-          auto it2 = gaps_.begin();
-          std::vector<decltype(it2)> adjacent;
-          while(it2 != gaps_.end()) {
-            if(it2->second + it2->first  == gap.second) {
-              gap = { gap.first + it2->first, it2->second };
-              adjacent.push_back(it2);
-            }
-            if(gap.second + gap.first == it2->second) {
-              gap = { gap.first + it2->first, gap.second };
-              adjacent.push_back(it2);
+      if(!t)
+        return;
+
+      auto range = allocated_.equal_range(t->data());
+      for(auto it = range.first; it != range.second; ++it) {
+        if(it->second == t) {
+          allocated_.erase(it);
+          used_ -= t->size();
+
+          float* start = t->data();
+          size_t size = t->size();
+
+          // merge with the gap that begins where the tensor ends
+          auto next = gapsByAddress_.lower_bound(start);
+          if(next != gapsByAddress_.end() && next->first == start + size) {
+            size += next->second;
+            auto erase = next++;
+            eraseGap(erase);
+          }
+
+          // and with the one that ends where it begins
+          if(next != gapsByAddress_.begin()) {
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == start) {
+              start = prev->first;
+              size += prev->second;
+              eraseGap(prev);
             }
-            it2++;
           }
-          for(auto&& a : adjacent)
-            gaps_.erase(a);
-          gaps_.insert(gap);
+
+          insertGap(start, size);
           break;
         }
-        it++;
       }
       t.reset();
     }
@@ -172,14 +229,41 @@ class TensorAllocator {
       return device_.capacity();
     }
 
+    /** Space up to the end of the last tensor */
     size_t size() {
-      float* start = device_.data();
-      float* end = start;
-      if(!allocated_.empty())
-        end = allocated_.back()->data() + allocated_.back()->size();
+      if(allocated_.empty())
+        return 0;
+      Tensor last = std::prev(allocated_.end())->second;
+      return last->data() + last->size() - device_.data();
+    }
 
-      return end - start;
+    AllocatorStats stats() {
+      AllocatorStats stats;
+      stats.capacity = device_.capacity();
+      stats.used = used_;
+      stats.peak = peak_;
+      stats.free = stats.capacity - used_;
+      stats.largestGap = gaps_.empty() ? 0 : gaps_.rbegin()->first;
+      stats.gaps = gaps_.size();
+      stats.reallocations = reallocations_;
+      return stats;
+    }
+
+    void logStats() {
+      auto s = stats();
+      LOG(memory, "Device {}: {} MB reserved, {} MB in use, peak {} MB, "
+          "{} gaps, fragmentation {:.2f}, {} reallocations",
+          device_.getDevice(),
+          s.capacity * sizeof(float) / MBYTE, s.used * sizeof(float) / MBYTE,
+          s.peak * sizeof(float) / MBYTE, s.gaps, s.fragmentation(),
+          s.reallocations);
     }
 };
 
+#ifdef CUDA_FOUND
+typedef TensorAllocatorDerived<DeviceGPU> TensorAllocator;
+#else
+typedef TensorAllocatorDerived<DeviceCPU> TensorAllocator;
+#endif
+
 }
@@ -0,0 +1,48 @@
+#include <cstring>
+#include <algorithm>
+
+#include "tensors/tensor.h"
+#include "kernels/tensor_operators.h"
+
+namespace marian {
+
+float TensorBase::get(size_t i) {
+  return data_[i];
+}
+
+void TensorBase::set(size_t i, float value) {
+  data_[i] = value;
+}
+
+void TensorBase::get(std::vector<float> &v) {
+  v.resize(size());
+  std::copy(data_, data_ + size(), v.begin());
+}
+
+void TensorBase::set(float value) {
+  std::fill(data_, data_ + size(), value);
+}
+
+void TensorBase::set(const std::vector<float> &v) {
+  std::copy(v.begin(), v.end(), data_);
+}
+
+void TensorBase::set(const float* begin, const float* end) {
+  std::copy(begin, end, data_);
+}
+
+void TensorBase::setSparse(const std::vector<size_t> &k,
+                           const std::vector<float> &v) {
+  SetSparse(data_, k, v);
+}
+
+void TensorBase::getSparse(const std::vector<size_t> &k,
+                           std::vector<float> &v) {
+  GetSparse(data_, k, v);
+}
+
+void TensorBase::copyFrom(Tensor in) {
+  std::memcpy(data_, in->data(), in->size() * sizeof(float));
+}
+
+}
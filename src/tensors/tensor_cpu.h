@@ -21,65 +21,50 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <cstdlib>
 #include <cstring>
+#include <algorithm>
 
 #include "tensors/tensor.h"
 
 namespace marian {
 
-class TensorCPU : public TensorBase {
-  public:
-    TensorCPU(float* data, Shape shape)
-    : TensorBase(data, shape) {}
-
-    float get(size_t i) {
-      return data_[i];
-    }
-
-    void set(size_t i, float value) {
-      data_[i] = value;
-    }
-
-    void get(std::vector<float> &v) {
-      v.resize(size());
-      std::copy(data_, data_ + size(), v.begin());
-    }
-
-    void set(float value) {
-      std::fill(data_, data_ + size(), value);
-    }
-
-    void set(const std::vector<float> &v) {
-      std::copy(v.begin(), v.end(), data_);
-    }
-};
-
+/**
+ * @brief Host memory device, mirrors the interface of DeviceGPU so that it can
+ * back a TensorAllocator. Memory is aligned to cache lines.
+ */
 class DeviceCPU {
   private:
+    const size_t ALIGN = 64;
+
     float* data_;
-    size_t size_
+    size_t size_;
+    size_t device_;
 
   public:
-    DeviceCPU()
-    : data_(0), size_(0) {}
+    DeviceCPU(size_t device)
+    : data_(0), size_(0), device_(device) {}
 
     ~DeviceCPU() {
       if(data_)
-        delete[] data_;
+        std::free(data_);
     }
 
-    typedef TensorCPU tensor_type;
+    typedef TensorBase tensor_type;
 
     void reserve(size_t size) {
       UTIL_THROW_IF2(size < size_, "New size must be larger than old size");
-      float* temp = new float[size];
+
+      void* temp = nullptr;
+      UTIL_THROW_IF2(posix_memalign(&temp, ALIGN, std::max(size, (size_t)1) * sizeof(float)),
+                     "Could not allocate " << size * sizeof(float) << " bytes of host memory");
 
       if(data_) {
-        std::memcpy(temp, data_, size_* sizeof(float));
-        delete[] data_;
+        std::memcpy(temp, data_, size_ * sizeof(float));
+        std::free(data_);
       }
 
-      data_ = temp;
+      data_ = (float*)temp;
       size_ = size;
     }
 
@@ -90,6 +75,10 @@ class DeviceCPU {
     size_t capacity() {
       return size_;
     }
+
+    size_t getDevice() {
+      return device_;
+    }
 };
 
 }
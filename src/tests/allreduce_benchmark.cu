@@ -0,0 +1,131 @@
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include "common/logging.h"
+#include "training/ring_reduce.h"
+
+using namespace marian;
+
+// Averages gradients of 2, 4 and 8 workers and copies them back to all
+// workers, as an update of SyncGraphGroup does, once through a master that
+// sums and distributes everything and once with RingReduce. In the CPU
+// build the workers are threads on host memory. Usage:
+//
+//   allreduce_benchmark [floats per worker, default 16M] [workers...]
+
+void fill(std::vector<Tensor>& tensors, std::vector<std::vector<float>>& values) {
+  for(size_t i = 0; i < tensors.size(); ++i)
+    tensors[i]->set(values[i]);
+}
+
+int main(int argc, char** argv) {
+  // the allocators log their reservations
+  stderrLogger("memory", "[%Y-%m-%d %T] [memory] %v");
+
+  int size = argc > 1 ? std::stoi(argv[1]) : 16 * 1024 * 1024;
+  std::vector<size_t> counts;
+  for(int i = 2; i < argc; ++i)
+    counts.push_back(std::stoul(argv[i]));
+  if(counts.empty())
+    counts = {2, 4, 8};
+
+  std::cout << std::setw(8) << "workers"
+            << std::setw(14) << "master ms"
+            << std::setw(14) << "ring ms"
+            << std::setw(16) << "ring GB/s"
+            << std::setw(12) << "max diff" << std::endl;
+
+  std::mt19937 engine(1234);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+  for(size_t workers : counts) {
+    std::vector<size_t> devices;
+    for(size_t i = 0; i < workers; ++i)
+      devices.push_back(i);
+
+    std::vector<Ptr<TensorAllocator>> allocators;
+    std::vector<Tensor> tensors;
+    std::vector<std::vector<float>> values(workers, std::vector<float>(size));
+    for(size_t i = 0; i < workers; ++i) {
+      Tensor t;
+      auto allocator = New<TensorAllocator>(devices[i]);
+      allocator->reserveExact(size);
+      allocator->allocate(t, {1, size});
+      allocators.push_back(allocator);
+      tensors.push_back(t);
+      for(auto& v : values[i])
+        v = dist(engine);
+    }
+
+    Tensor temp;
+    auto tempAllocator = New<TensorAllocator>(devices[0]);
+    tempAllocator->reserveExact(size);
+    tempAllocator->allocate(temp, {1, size});
+
+    float denom = workers;
+    auto master = [&]() {
+      for(size_t i = 1; i < workers; ++i) {
+        temp->copyFrom(tensors[i]);
+        Element(_1 += _2, tensors[0], temp);
+      }
+      Element(_1 /= denom, tensors[0]);
+      for(size_t i = 1; i < workers; ++i)
+        tensors[i]->copyFrom(tensors[0]);
+      cudaStreamSynchronize(0);
+    };
+
+    RingReduce ring(devices, size);
+    auto allReduce = [&]() {
+      ring.reduceScatter(tensors);
+      ring.forEach([&](size_t i) {
+        auto chunk = ring.chunk(tensors[i], ring.owner(i));
+        if(chunk)
+          Element(_1 /= denom, chunk);
+      });
+      ring.allGather(tensors);
+    };
+
+    auto time = [&](std::function<void()> f) {
+      size_t iterations = 0;
+      double seconds = 0;
+      do {
+        fill(tensors, values);
+        boost::timer::cpu_timer timer;
+        f();
+        seconds += timer.elapsed().wall * 1e-9;
+        ++iterations;
+      } while(seconds < 1.0);
+      return seconds / iterations;
+    };
+
+    double masterSeconds = time(master);
+    std::vector<float> expected;
+    tensors[0]->get(expected);
+
+    double ringSeconds = time(allReduce);
+    float maxDiff = 0;
+    for(auto t : tensors) {
+      std::vector<float> result;
+      t->get(result);
+      for(int j = 0; j < size; ++j)
+        maxDiff = std::max(maxDiff, std::fabs(result[j] - expected[j]));
+    }
+
+    // bytes each worker sends, as for bus bandwidth of NCCL
+    double bytes = 2.0 * (workers - 1) / workers * size * sizeof(float);
+    std::cout << std::setw(8) << workers
+              << std::setw(14) << std::fixed << std::setprecision(2) << masterSeconds * 1e3
+              << std::setw(14) << ringSeconds * 1e3
+              << std::setw(16) << bytes / ringSeconds * 1e-9
+              << std::setw(12) << std::scientific << std::setprecision(1) << maxDiff
+              << std::endl;
+  }
+
+  return 0;
+}
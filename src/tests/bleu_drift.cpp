@@ -0,0 +1,103 @@
+// Compares the translations of a quantized model with those of the float
+// model: prints the corpus BLEU of both against the references, the BLEU of
+// the quantized translations against the float ones and how many lines are
+// identical. BLEU is case-sensitive on whitespace tokens, 4-grams, with the
+// brevity penalty of Papineni et al. (2002).
+//
+//   s2s -m model.npz ... < test.src > float.txt
+//   s2s -m model.int8.npz ... < test.src > int8.txt
+//   bleu_drift test.ref float.txt int8.txt
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::vector<std::string> Words;
+
+std::vector<Words> readLines(const std::string& file) {
+  std::ifstream in(file);
+  if(!in) {
+    std::cerr << "Cannot read " << file << std::endl;
+    exit(1);
+  }
+  std::vector<Words> lines;
+  std::string line;
+  while(std::getline(in, line)) {
+    std::istringstream words(line);
+    lines.emplace_back(std::istream_iterator<std::string>(words),
+                       std::istream_iterator<std::string>());
+  }
+  return lines;
+}
+
+double bleu(const std::vector<Words>& refs, const std::vector<Words>& hyps) {
+  const size_t N = 4;
+  std::vector<double> matches(N, 0), totals(N, 0);
+  double refLength = 0, hypLength = 0;
+
+  for(size_t l = 0; l < hyps.size(); ++l) {
+    const Words& ref = refs[l];
+    const Words& hyp = hyps[l];
+    refLength += ref.size();
+    hypLength += hyp.size();
+
+    for(size_t n = 1; n <= N; ++n) {
+      std::map<Words, size_t> counts;
+      for(size_t i = 0; i + n <= ref.size(); ++i)
+        counts[Words(ref.begin() + i, ref.begin() + i + n)]++;
+      for(size_t i = 0; i + n <= hyp.size(); ++i) {
+        auto it = counts.find(Words(hyp.begin() + i, hyp.begin() + i + n));
+        if(it != counts.end() && it->second > 0) {
+          it->second--;
+          matches[n - 1]++;
+        }
+        totals[n - 1]++;
+      }
+    }
+  }
+
+  double logPrecision = 0;
+  for(size_t n = 0; n < N; ++n) {
+    if(matches[n] == 0)
+      return 0;
+    logPrecision += std::log(matches[n] / totals[n]) / N;
+  }
+  double brevity = std::min(0.0, 1.0 - refLength / hypLength);
+  return 100 * std::exp(logPrecision + brevity);
+}
+
+int main(int argc, char** argv) {
+  if(argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " reference float.txt int8.txt" << std::endl;
+    return 1;
+  }
+
+  auto refs = readLines(argv[1]);
+  auto floats = readLines(argv[2]);
+  auto int8s = readLines(argv[3]);
+  if(refs.size() != floats.size() || refs.size() != int8s.size()) {
+    std::cerr << "The files have different numbers of lines" << std::endl;
+    return 1;
+  }
+
+  size_t identical = 0;
+  for(size_t l = 0; l < refs.size(); ++l)
+    identical += floats[l] == int8s[l];
+
+  double floatBleu = bleu(refs, floats);
+  double int8Bleu = bleu(refs, int8s);
+  std::cout << std::fixed << std::setprecision(2)
+            << "BLEU float       " << floatBleu << std::endl
+            << "BLEU int8        " << int8Bleu << std::endl
+            << "drift            " << int8Bleu - floatBleu << std::endl
+            << "BLEU int8/float  " << bleu(floats, int8s) << std::endl
+            << "identical lines  " << identical << " of " << refs.size() << std::endl;
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include "training/config.h"
+#include "kernels/int8_cpu.h"
+#include "kernels/tensor_operators.h"
+
+using namespace marian;
+
+// Times the float product against the int8 product of a quantized model for
+// the translation shapes of a default s2s model (dim-emb 512, dim-rnn 1024,
+// 50000 target words) with beam size 12 and for a batch of 64 sentences of
+// 10 words, and reports GFLOP/s. The error of the int8 result is relative to
+// the largest entry of the float result.
+
+struct ProdShape {
+  std::string name;
+  size_t m, n, k;
+};
+
+template <class F>
+double gflops(const ProdShape& s, F f) {
+  size_t iterations = 0;
+  boost::timer::cpu_timer timer;
+  do {
+    f();
+    ++iterations;
+  } while(timer.elapsed().wall < 1e9);
+  double seconds = timer.elapsed().wall * 1e-9;
+  return 2.0 * s.m * s.n * s.k * iterations / seconds * 1e-9;
+}
+
+int main(int argc, char** argv) {
+  auto options = New<Config>(argc, argv, false);
+
+  size_t batch = 64 * 10;
+  size_t beam = 12;
+  size_t dimEmb = 512;
+  size_t dimRnn = 1024;
+  size_t dimVoc = 50000;
+
+  std::vector<ProdShape> shapes = {
+    {"GRU::apply1 xW",              batch, 3 * dimRnn, dimEmb},
+    {"GRU::apply2 sU",                 64, 3 * dimRnn, dimRnn},
+    {"GRU::apply2 sU beam",          beam, 3 * dimRnn, dimRnn},
+    {"_ff_logit_l1",                   64, dimEmb, dimRnn},
+    {"_ff_logit_l2",                   64, dimVoc, dimEmb},
+    {"_ff_logit_l2 beam",            beam, dimVoc, dimEmb}
+  };
+
+  auto handle = create_handle(0);
+
+  std::mt19937 engine(1234);
+  std::normal_distribution<float> dist(0.f, 1.f);
+
+  std::cout << std::left << std::setw(24) << "shape"
+            << std::right << std::setw(8) << "m"
+            << std::setw(8) << "n" << std::setw(8) << "k"
+            << std::setw(14) << "float GFLOP/s"
+            << std::setw(14) << "int8 GFLOP/s"
+            << std::setw(10) << "speedup"
+            << std::setw(12) << "rel err" << std::endl;
+
+  for(auto& s : shapes) {
+    std::vector<float> a(s.m * s.k), b(s.k * s.n);
+    for(auto& v : a) v = dist(engine);
+    for(auto& v : b) v = 0.05f * dist(engine);
+    Int8Weights weights(Int8Matrix::quantize(b.data(), s.k, s.n));
+
+    std::vector<float> c(s.m * s.n), c8(s.m * s.n);
+    auto prodFloat = [&]() {
+      cpu::Sgemm(handle, false, false, s.m, s.n, s.k,
+                 1.f, a.data(), s.k, b.data(), s.n, 0.f, c.data(), s.n);
+    };
+    auto prodInt8 = [&]() {
+      cpu::Int8Gemm(handle, s.m, s.k, a.data(), s.k, weights, c8.data(), s.n);
+    };
+
+    prodFloat();
+    prodInt8();
+    float maxErr = 0, maxValue = 0;
+    for(size_t i = 0; i < c.size(); ++i) {
+      maxErr = std::max(maxErr, std::fabs(c8[i] - c[i]));
+      maxValue = std::max(maxValue, std::fabs(c[i]));
+    }
+
+    double floatGflops = gflops(s, prodFloat);
+    double int8Gflops = gflops(s, prodInt8);
+
+    std::cout << std::left << std::setw(24) << s.name
+              << std::right << std::setw(8) << s.m
+              << std::setw(8) << s.n << std::setw(8) << s.k
+              << std::setw(14) << std::fixed << std::setprecision(2) << floatGflops
+              << std::setw(14) << int8Gflops
+              << std::setw(10) << int8Gflops / floatGflops
+              << std::setw(12) << std::scientific << std::setprecision(1)
+              << maxErr / maxValue
+              << std::endl;
+  }
+
+  return 0;
+}
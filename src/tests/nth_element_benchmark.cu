@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include "training/config.h"
+#include "translator/nth_element.h"
+#include "tensors/tensor_allocator.h"
+
+using namespace marian;
+
+// Times NthElement::getNBestList for one sentence during beam search, i.e.
+// beam rows of log-probabilities over the target vocabulary, each shifted by
+// the cost of its hypothesis, for vocabularies of 50000 to 90000 words and
+// beam sizes 5 to 12. The selected keys and costs are compared to those of
+// std::partial_sort on the host, whose time is reported as well.
+
+// log-softmax of Zipf-like logits, the best words of each row differ
+void logProbs(std::vector<float>& out, size_t rows, size_t cols,
+              std::mt19937& engine) {
+  std::normal_distribution<float> noise(0.f, 1.f);
+  std::vector<int> words(cols);
+  std::iota(words.begin(), words.end(), 0);
+
+  out.resize(rows * cols);
+  for(size_t r = 0; r < rows; ++r) {
+    std::shuffle(words.begin(), words.end(), engine);
+    float* row = out.data() + r * cols;
+    for(size_t j = 0; j < cols; ++j)
+      row[words[j]] = -std::log(1.f + j) + noise(engine);
+
+    float max = *std::max_element(row, row + cols);
+    double sum = 0;
+    for(size_t j = 0; j < cols; ++j)
+      sum += std::exp(row[j] - max);
+    float shift = max + std::log(sum) + 2.f * r;
+    for(size_t j = 0; j < cols; ++j)
+      row[j] -= shift;
+  }
+}
+
+void reference(const std::vector<float>& probs, size_t n,
+               std::vector<unsigned>& keys, std::vector<float>& costs) {
+  std::vector<unsigned> idx(probs.size());
+  std::iota(idx.begin(), idx.end(), 0);
+  std::partial_sort(idx.begin(), idx.begin() + n, idx.end(),
+                    [&](unsigned a, unsigned b) {
+                      return probs[a] > probs[b]
+                             || (probs[a] == probs[b] && a < b);
+                    });
+
+  keys.assign(idx.begin(), idx.begin() + n);
+  costs.clear();
+  for(auto k : keys)
+    costs.push_back(probs[k]);
+}
+
+int main(int argc, char** argv) {
+  auto options = New<Config>(argc, argv, false);
+
+  std::vector<size_t> vocabs = {50000, 70000, 90000};
+  std::vector<size_t> beams = {5, 8, 12};
+
+  auto alloc = New<TensorAllocator>(0);
+  alloc->reserveExact(beams.back() * vocabs.back());
+
+  std::mt19937 engine(1234);
+
+  std::cout << std::right << std::setw(8) << "vocab" << std::setw(6) << "beam"
+            << std::setw(14) << "nth us" << std::setw(14) << "sort us"
+            << std::setw(8) << "match" << std::endl;
+
+  for(size_t dimVoc : vocabs) {
+    for(size_t beam : beams) {
+      std::vector<float> probs;
+      logProbs(probs, beam, dimVoc, engine);
+
+      Tensor P;
+      alloc->clear();
+      alloc->allocate(P, {(int)beam, (int)dimVoc});
+      P->set(probs);
+
+      NthElement nth(beam, 1, 0);
+      std::vector<size_t> beamSizes = {beam};
+
+      std::vector<unsigned> keys, refKeys;
+      std::vector<float> costs, refCosts;
+      nth.getNBestList(beamSizes, P, costs, keys);
+      reference(probs, beam, refKeys, refCosts);
+      bool match = keys == refKeys && costs == refCosts;
+
+      size_t iterations = 0;
+      boost::timer::cpu_timer timer;
+      do {
+        keys.clear();
+        costs.clear();
+        nth.getNBestList(beamSizes, P, costs, keys);
+        cudaStreamSynchronize(0);
+        ++iterations;
+      } while(timer.elapsed().wall < 1e9);
+      double nthUs = timer.elapsed().wall * 1e-3 / iterations;
+
+      iterations = 0;
+      timer.start();
+      do {
+        reference(probs, beam, refKeys, refCosts);
+        ++iterations;
+      } while(timer.elapsed().wall < 1e9);
+      double sortUs = timer.elapsed().wall * 1e-3 / iterations;
+
+      std::cout << std::setw(8) << dimVoc << std::setw(6) << beam
+                << std::setw(14) << std::fixed << std::setprecision(1) << nthUs
+                << std::setw(14) << sortUs
+                << std::setw(8) << (match ? "yes" : "NO") << std::endl;
+    }
+  }
+
+  return 0;
+}
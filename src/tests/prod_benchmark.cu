@@ -0,0 +1,121 @@
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include "training/config.h"
+#include "kernels/tensor_operators.h"
+#include "tensors/tensor_allocator.h"
+
+using namespace marian;
+
+// Times Prod for the matrix shapes of a default s2s model (dim-emb 512,
+// dim-rnn 1024, 50000 target words) during training with 64 sentences of
+// 10 words and during translation with beam size 12, and reports GFLOP/s.
+// A sample of result entries is checked against a naive dot product.
+
+struct ProdShape {
+  std::string name;
+  size_t m, n, k;
+  bool transA, transB;
+};
+
+int main(int argc, char** argv) {
+  auto options = New<Config>(argc, argv, false);
+
+  size_t batch = 64 * 10;
+  size_t beam = 12;
+  size_t dimEmb = 512;
+  size_t dimRnn = 1024;
+  size_t dimVoc = 50000;
+
+  std::vector<ProdShape> shapes = {
+    {"GRU::apply1 xW",              batch, 3 * dimRnn, dimEmb, false, false},
+    {"GRU::apply2 sU",                 64, 3 * dimRnn, dimRnn, false, false},
+    {"GRU::apply2 sU beam",          beam, 3 * dimRnn, dimRnn, false, false},
+    {"GRU::apply2 dState",             64, dimRnn, 3 * dimRnn, false, true},
+    {"GRU::apply2 dU",             dimRnn, 3 * dimRnn, 64,     true,  false},
+    {"_ff_logit_l2",                batch, dimVoc, dimEmb,     false, false},
+    {"_ff_logit_l2 beam",            beam, dimVoc, dimEmb,     false, false},
+    {"_ff_logit_l2 dInput",         batch, dimEmb, dimVoc,     false, true},
+    {"_ff_logit_l2 dW",            dimEmb, dimVoc, batch,      true,  false}
+  };
+
+  size_t maxElements = 0;
+  for(auto& s : shapes)
+    maxElements = std::max(maxElements, s.m * s.k + s.k * s.n + s.m * s.n);
+
+  auto alloc = New<TensorAllocator>(0);
+  alloc->reserveExact(maxElements);
+  auto handle = create_handle(0);
+
+  std::mt19937 engine(1234);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+
+  std::cout << std::left << std::setw(24) << "shape"
+            << std::right << std::setw(8) << "m"
+            << std::setw(8) << "n" << std::setw(8) << "k"
+            << std::setw(6) << "op"
+            << std::setw(12) << "GFLOP/s"
+            << std::setw(12) << "max err" << std::endl;
+
+  for(auto& s : shapes) {
+    Tensor A, B, C;
+    Shape shapeA = s.transA ? Shape({(int)s.k, (int)s.m}) : Shape({(int)s.m, (int)s.k});
+    Shape shapeB = s.transB ? Shape({(int)s.n, (int)s.k}) : Shape({(int)s.k, (int)s.n});
+
+    alloc->clear();
+    alloc->allocate(A, shapeA);
+    alloc->allocate(B, shapeB);
+    alloc->allocate(C, {(int)s.m, (int)s.n});
+
+    std::vector<float> a(shapeA.elements()), b(shapeB.elements());
+    for(auto& v : a) v = dist(engine);
+    for(auto& v : b) v = dist(engine);
+    A->set(a);
+    B->set(b);
+
+    // warm-up, also used for the correctness check
+    Prod(handle, C, A, B, s.transA, s.transB, 0);
+    std::vector<float> c;
+    C->get(c);
+
+    float maxErr = 0;
+    std::uniform_int_distribution<size_t> rows(0, s.m - 1), cols(0, s.n - 1);
+    for(int t = 0; t < 64; ++t) {
+      size_t i = rows(engine), j = cols(engine);
+      double ref = 0;
+      for(size_t p = 0; p < s.k; ++p) {
+        float x = s.transA ? a[p * s.m + i] : a[i * s.k + p];
+        float y = s.transB ? b[j * s.k + p] : b[p * s.n + j];
+        ref += x * y;
+      }
+      maxErr = std::max(maxErr, (float)std::fabs(ref - c[i * s.n + j]));
+    }
+
+    size_t iterations = 0;
+    boost::timer::cpu_timer timer;
+    do {
+      Prod(handle, C, A, B, s.transA, s.transB, 1);
+      cudaStreamSynchronize(0);
+      ++iterations;
+    } while(timer.elapsed().wall < 1e9);
+
+    double seconds = timer.elapsed().wall * 1e-9;
+    double gflops = 2.0 * s.m * s.n * s.k * iterations / seconds * 1e-9;
+
+    std::string op = std::string(s.transA ? "T" : "N") + (s.transB ? "T" : "N");
+    std::cout << std::left << std::setw(24) << s.name
+              << std::right << std::setw(8) << s.m
+              << std::setw(8) << s.n << std::setw(8) << s.k
+              << std::setw(6) << op
+              << std::setw(12) << std::fixed << std::setprecision(2) << gflops
+              << std::setw(12) << std::scientific << std::setprecision(1) << maxErr
+              << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+// Client for s2s --server: sends the lines of a file from concurrent clients,
+// each waits for a translation before sending its next line. Translations
+// are printed in input order, latency and throughput go to stderr.
+//
+//   s2s -m model.npz -v src.yml trg.yml --server /tmp/s2s.sock &
+//   server_benchmark /tmp/s2s.sock input.txt 16 > output.txt
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+int connectTo(const std::string& path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if(fd == -1 || connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+    std::cerr << "Cannot connect to " << path << ": " << std::strerror(errno)
+              << std::endl;
+    exit(1);
+  }
+  return fd;
+}
+
+bool readLine(int fd, std::string& buffer, std::string& line) {
+  size_t pos;
+  while((pos = buffer.find('\n')) == std::string::npos) {
+    char chunk[4096];
+    ssize_t bytes = read(fd, chunk, sizeof(chunk));
+    if(bytes <= 0)
+      return false;
+    buffer.append(chunk, bytes);
+  }
+  line = buffer.substr(0, pos);
+  buffer.erase(0, pos + 1);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " socket input [clients]" << std::endl;
+    return 1;
+  }
+  std::string path = argv[1];
+  size_t clients = argc > 3 ? std::stoul(argv[3]) : 1;
+
+  std::vector<std::string> lines;
+  std::ifstream in(argv[2]);
+  for(std::string line; std::getline(in, line);)
+    lines.push_back(line);
+
+  std::vector<std::string> outputs(lines.size());
+  std::vector<double> latencies(lines.size());
+  std::atomic<size_t> next(0);
+
+  auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for(size_t c = 0; c < clients; ++c) {
+    threads.emplace_back([&]() {
+      int fd = connectTo(path);
+      std::string buffer;
+      for(size_t i; (i = next++) < lines.size();) {
+        std::string request = lines[i] + "\n";
+        auto begin = Clock::now();
+        if(write(fd, request.data(), request.size()) != (ssize_t)request.size()
+           || !readLine(fd, buffer, outputs[i])) {
+          std::cerr << "Connection to " << path << " lost" << std::endl;
+          exit(1);
+        }
+        latencies[i] = std::chrono::duration<double, std::milli>(
+            Clock::now() - begin).count();
+      }
+      close(fd);
+    });
+  }
+  for(auto& t : threads)
+    t.join();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  for(auto& output : outputs)
+    std::cout << output << std::endl;
+
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    return latencies.empty() ? 0 : latencies[std::min(
+        latencies.size() - 1, (size_t)(p * latencies.size()))];
+  };
+  std::cerr << lines.size() << " sentences, " << clients << " clients: "
+            << lines.size() / seconds << " sentences/s, latency p50 "
+            << percentile(0.5) << " ms, p99 " << percentile(0.99) << " ms"
+            << std::endl;
+  return 0;
+}
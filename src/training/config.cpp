@@ -1,9 +1,11 @@
 
+#include <cstring>
 #include <set>
 #include <string>
 #include <boost/algorithm/string.hpp>
 
 #include "training/config.h"
+#include "common/binary_model.h"
 #include "common/file_stream.h"
 #include "common/logging.h"
 #include "3rd_party/cnpy/cnpy.h"
@@ -32,6 +34,7 @@ uint16_t guess_terminal_width(uint16_t max_width) {
 }
 
 size_t Config::seed = (size_t) time(0);
+size_t Config::cpuThreads = 1;
 
 bool Config::has(const std::string& key) const {
   return config_[key];
@@ -105,6 +108,10 @@ void Config::validate(bool translate) const {
           get<std::vector<std::string>>("train-sets").size(),
           "There should be as many validation sets as training sets");
       }
+      UTIL_THROW_IF2(get<size_t>("optimizer-delay") == 0,
+                     "--optimizer-delay has to be at least 1");
+      UTIL_THROW_IF2(get<double>("loss-scale") <= 0,
+                     "--loss-scale has to be positive");
     }
 }
 
@@ -152,6 +159,9 @@ void Config::addOptionsCommon(po::options_description& desc) {
      "Log training process information to file given by  arg")
     ("seed", po::value<size_t>()->default_value(0),
      "Seed for all random number generators. 0 means initialize randomly")
+    ("profile", po::value<std::string>(),
+     "Time every node of the graph and write the results to  arg.<device>.txt (totals),"
+     "  arg.<device>.json (Chrome trace events) and  arg.<device>.dot (last pass)")
     ("relative-paths", po::value<bool>()->zero_tokens()->default_value(false),
      "All paths are relative to the config file location")
     ("dump-config", po::value<bool>()->zero_tokens()->default_value(false),
@@ -159,6 +169,12 @@ void Config::addOptionsCommon(po::options_description& desc) {
     ("help,h", po::value<bool>()->zero_tokens()->default_value(false),
       "Print this help message and exit")
   ;
+#ifndef CUDA_FOUND
+  general.add_options()
+    ("cpu-threads", po::value<size_t>()->default_value(1),
+     "Number of threads per device used for matrix products, 0 means one per core")
+  ;
+#endif
   desc.add(general);
 }
 
@@ -250,7 +266,21 @@ void Config::addOptionsTraining(po::options_description& desc) {
     ("devices,d", po::value<std::vector<int>>()
       ->multitoken()
       ->default_value(std::vector<int>({0}), "0"),
-      "GPUs to use for training. Asynchronous SGD is used with multiple devices.")
+      "GPUs to use for training. Asynchronous SGD is used with multiple devices, "
+      "unless --sync-sgd is given")
+    ("sync-sgd", po::value<bool>()->zero_tokens()->default_value(false),
+     "Synchronous SGD with multiple devices: one batch per device and update, "
+     "gradients are summed with a ring all-reduce")
+    ("optimizer-delay", po::value<size_t>()->default_value(1),
+     "Accumulate the gradients of  arg  mini-batches before each update, "
+     "only with a single device")
+    ("fp16", po::value<bool>()->zero_tokens()->default_value(false),
+     "Mixed precision training with a single device: weights and gradients "
+     "are rounded to fp16, the optimizer keeps fp32 master weights")
+    ("loss-scale", po::value<double>()->default_value(32768),
+     "Initial loss scale of --fp16, halved after an overflow of the gradients")
+    ("loss-scale-freq", po::value<size_t>()->default_value(2000),
+     "Double the loss scale of --fp16 after  arg  updates without overflow")
     ("mini-batch", po::value<int>()->default_value(64),
       "Size of mini-batch used during update")
     ("mini-batch-words", po::value<int>()->default_value(0),
@@ -271,6 +301,9 @@ void Config::addOptionsTraining(po::options_description& desc) {
      "Maintain and save moving average of parameters")
     ("moving-decay", po::value<double>()->default_value(0.999),
      "Decay factor for moving average")
+    ("graph-cache", po::value<size_t>()->default_value(0),
+     "Record the graphs of up to  arg  batch shapes per device and replay them "
+     "instead of rebuilding the graph for every batch (0 to disable)")
     //("lexical-table", po::value<std::string>(),
     // "Load lexical table")
     ("guided-alignment", po::value<std::string>(),
@@ -341,14 +374,37 @@ void Config::addOptionsTranslate(po::options_description& desc) {
       "GPUs to use for translating.")
     ("tied-embeddings", po::value<bool>()->zero_tokens()->default_value(false),
      "Tie target embeddings and output embeddings in output layer")
-    ("mini-batch", po::value<int>()->default_value(1),
-      "Size of mini-batch used during update")
+    ("mini-batch", po::value<int>()->default_value(32),
+      "Number of sentences translated together")
     ("maxi-batch", po::value<int>()->default_value(1),
-      "Number of batches to preload for length-based sorting")
+      "Number of batches read ahead and grouped by source length, "
+      "translations keep the input order")
     ("n-best", po::value<bool>()->zero_tokens()->default_value(false),
       "Display n-best list")
     ("lexical-table", po::value<std::string>(),
      "Path to lexical table")
+    ("shortlist", po::value<std::vector<std::string>>()->multitoken(),
+     "Restrict the output layer to a shortlist per batch: lexical table "
+     "(target source probability), number of most frequent words (100), "
+     "best translations per source word (100) and probability threshold (0)")
+    ("max-length-factor", po::value<float>()->default_value(3),
+     "Maximum length of a translation as a multiple of the source length")
+    ("no-early-stop", po::value<bool>()->zero_tokens()->default_value(false),
+     "Search until all hypotheses have finished, also when no live hypothesis "
+     "can beat the best finished one")
+    ("encoder-cache", po::value<size_t>()->default_value(0),
+     "Cache the encoder outputs of source sentences in this many MB, "
+     "repeated sentences are not encoded again")
+    ("parallel-scorers", po::value<bool>()->zero_tokens()->default_value(false),
+     "Run every model of an ensemble on a graph and thread of its own, each "
+     "graph reserves --workspace")
+    ("server", po::value<std::string>(),
+     "Keep the model loaded and translate requests from a unix socket at this "
+     "path, one sentence per line")
+    ("server-batch-words", po::value<size_t>()->default_value(0),
+     "Maximum number of source words of a server batch, 0 for no limit")
+    ("server-max-wait", po::value<size_t>()->default_value(10),
+     "Milliseconds a server request waits for other requests to share its batch")
     ("weights", po::value<std::vector<float>>()
       ->multitoken(),
       "Scorer weights")
@@ -458,12 +514,18 @@ void Config::addOptions(int argc, char** argv,
     SET_OPTION("clip-norm", double);
     SET_OPTION("moving-average", bool);
     SET_OPTION("moving-decay", double);
+    SET_OPTION("graph-cache", size_t);
     //SET_OPTION_NONDEFAULT("lexical-table", std::string);
 
     SET_OPTION_NONDEFAULT("guided-alignment", std::string);
     SET_OPTION("guided-alignment-cost", std::string);
     SET_OPTION("guided-alignment-weight", double);
     SET_OPTION("drop-rate", double);
+    SET_OPTION("sync-sgd", bool);
+    SET_OPTION("optimizer-delay", size_t);
+    SET_OPTION("fp16", bool);
+    SET_OPTION("loss-scale", double);
+    SET_OPTION("loss-scale-freq", size_t);
   }
   /** training end **/
   else {
@@ -473,6 +535,14 @@ void Config::addOptions(int argc, char** argv,
     SET_OPTION("beam-size", size_t);
     SET_OPTION("allow-unk", bool);
     SET_OPTION_NONDEFAULT("weights", std::vector<float>);
+    SET_OPTION_NONDEFAULT("shortlist", std::vector<std::string>);
+    SET_OPTION("max-length-factor", float);
+    SET_OPTION("no-early-stop", bool);
+    SET_OPTION("encoder-cache", size_t);
+    SET_OPTION("parallel-scorers", bool);
+    SET_OPTION_NONDEFAULT("server", std::string);
+    SET_OPTION("server-batch-words", size_t);
+    SET_OPTION("server-max-wait", size_t);
     //SET_OPTION_NONDEFAULT("lexical-table", std::string);
   }
 
@@ -511,6 +581,10 @@ void Config::addOptions(int argc, char** argv,
   SET_OPTION("workspace", size_t);
   SET_OPTION_NONDEFAULT("log", std::string);
   SET_OPTION("seed", size_t);
+#ifndef CUDA_FOUND
+  SET_OPTION("cpu-threads", size_t);
+#endif
+  SET_OPTION_NONDEFAULT("profile", std::string);
   SET_OPTION("relative-paths", bool);
   SET_OPTION("devices", std::vector<int>);
   SET_OPTION("mini-batch", int);
@@ -531,6 +605,10 @@ void Config::addOptions(int argc, char** argv,
   else
     seed = vm_["seed"].as<size_t>();
 
+#ifndef CUDA_FOUND
+  cpuThreads = get<size_t>("cpu-threads");
+#endif
+
   if(!translate) {
     if(boost::filesystem::exists(vm_["model"].as<std::string>()) &&
        (translate || !vm_["no-reload"].as<bool>())) {
@@ -591,6 +669,14 @@ void Config::loadModelParameters(const std::string& name) {
 void Config::GetYamlFromNpz(YAML::Node& yaml,
                             const std::string& varName,
                             const std::string& fName) {
+  if(BinaryModel::isBinaryModel(fName)) {
+    BinaryModel model(fName);
+    auto item = model.get(varName);
+    UTIL_THROW_IF2(!item, "No " << varName << " in " << fName);
+    yaml = YAML::Load(std::string(item->data, strnlen(item->data, item->bytes)));
+    return;
+  }
+
   yaml = YAML::Load(cnpy::npz_load(fName, varName).data);
 }
 
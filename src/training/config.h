@@ -18,6 +18,7 @@ class Config {
   public:
 
     static size_t seed;
+    static size_t cpuThreads;
 
     Config(int argc, char** argv, bool validate=true, bool translate=false)
       : cmdline_options_("Allowed options", guess_terminal_width()) {
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "tensors/tensor.h"
+
+namespace marian {
+
+/**
+ * A gradient of one worker for one parameter shard. Every worker owns one
+ * slot per shard and refills it only after the shard has consumed it.
+ */
+struct GradientSlot {
+  Tensor grads;
+  size_t worker{0};
+  size_t version{0};   // version of the shard the gradient was computed on
+
+  std::atomic<bool> pending{false};
+  GradientSlot* next{nullptr};
+};
+
+/**
+ * Lock-free queue of gradient slots with many producers, the workers, and
+ * one consumer, the update thread of a shard. Producers push onto a stack
+ * with a compare-and-swap; the consumer takes the whole stack at once with
+ * an exchange, so there is no ABA problem, and reverses it into arrival
+ * order. The mutex is only used to put the consumer to sleep while the
+ * queue is empty, a producer takes it only if the consumer is waiting.
+ */
+class GradientQueue {
+  private:
+    std::atomic<GradientSlot*> head_{nullptr};
+    std::atomic<size_t> depth_{0};
+
+    std::atomic<bool> waiting_{false};
+    std::atomic<bool> closed_{false};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    void wake() {
+      if(waiting_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_one();
+      }
+    }
+
+  public:
+    void push(GradientSlot* slot) {
+      slot->pending = true;
+      depth_++;
+      slot->next = head_.load();
+      while(!head_.compare_exchange_weak(slot->next, slot));
+      wake();
+    }
+
+    /**
+     * All queued slots, oldest first, linked by next. Waits while the queue
+     * is empty, returns nullptr once it is empty and closed.
+     */
+    GradientSlot* popAll() {
+      GradientSlot* slots = head_.exchange(nullptr);
+      if(!slots) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_ = true;
+        cv_.wait(lock, [this] { return head_.load() || closed_; });
+        waiting_ = false;
+        slots = head_.exchange(nullptr);
+      }
+
+      GradientSlot* ordered = nullptr;
+      while(slots) {
+        GradientSlot* next = slots->next;
+        slots->next = ordered;
+        ordered = slots;
+        slots = next;
+        depth_--;
+      }
+      return ordered;
+    }
+
+    /** Gradients pushed and not yet taken */
+    size_t depth() const {
+      return depth_;
+    }
+
+    /** Wakes the consumer, popAll() returns nullptr when nothing is left */
+    void close() {
+      closed_ = true;
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_all();
+    }
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cmath>
 #include <thread>
 #include <future>
 #include <boost/filesystem.hpp>
@@ -11,10 +12,14 @@
 #include "optimizers/optimizers.h"
 #include "training/training.h"
 #include "training/validator.h"
+#include "training/ring_reduce.h"
+#include "training/gradient_queue.h"
 #include "data/batch_generator.h"
 
+#ifdef CUDA_FOUND
 #include "training/dropper.h"
 #include "training/sparse_tensor.h"
+#endif
 
 namespace marian {
 
@@ -58,22 +63,108 @@ class Singleton : public GraphGroup {
     Ptr<ExpressionGraph> mvAvgGraph_;
     bool mvAvg_{false};
     float mvDecay_{0.999};
+
+    // batches whose gradients are accumulated for the next update
+    size_t delay_{1};
+    size_t delayed_{0};
+    size_t delayedSentences_{0};
+    size_t delayedWords_{0};
+    size_t lastSentences_{0};
+    float delayedCost_{0};
+    Ptr<data::CorpusBatch> lastBatch_;
+
+    // mixed precision with dynamic loss scaling
+    bool fp16_{false};
+    float lossScale_{1.f};
+    size_t lossScaleFreq_{2000};
+    size_t sinceOverflow_{0};
     
     void updateMovingAverage(Tensor mvAvgParams, Tensor params) {
       Element(_1 = (mvDecay_ * _1) + ((1.f - mvDecay_) * _2),
               mvAvgParams, params);
     }
     
+    /**
+     * The cost of a batch is the mean over its sentences, so the gradient of
+     * delayed batches is the mean of their gradients weighted by sentences.
+     * The gradients of a batch are added to the accumulated ones without an
+     * extra buffer: before the backward pass the accumulated gradients are
+     * rescaled so that they hold the sum of n_i * g_i divided by the number
+     * of sentences n of the current batch, before the update they are scaled
+     * by n over the sentences of all delayed batches.
+     */
     void execute(Ptr<data::CorpusBatch> batch) {          
-      auto costNode = builder_->build(graph_, batch);
+      auto costNode = graph_->replay(batch);
+      if(!costNode) {
+        costNode = builder_->build(graph_, batch);
+        graph_->record(batch, costNode);
+      }
       
       graph_->forward();
       float cost = costNode->scalar();
-      graph_->backward();
 
-      opt_->update(graph_);
+      if(delayed_ > 0) {
+        float scale = (float)lastSentences_ / batch->size();
+        Element(_1 *= scale, graph_->params()->grads());
+      }
+      graph_->backward(delayed_ == 0, lossScale_);
+
+      delayed_++;
+      delayedSentences_ += batch->size();
+      delayedWords_ += batch->words();
+      delayedCost_ += cost * batch->size();
+      lastSentences_ = batch->size();
+      lastBatch_ = batch;
+
+      if(delayed_ == delay_)
+        updateDelayed();
+    }
+
+    /**
+     * Rounds the gradients to fp16 and divides them by the loss scale. The
+     * cost is multiplied by the loss scale in the backward pass, so that
+     * small gradients are not lost to fp16. If a gradient overflowed, the
+     * loss scale is halved and false is returned, the update is skipped.
+     * After loss-scale-freq updates without overflow the scale is doubled.
+     */
+    bool unscaleGradients() {
+      Tensor grads = graph_->params()->grads();
+      Element(_1 = Float16(_1), grads);
+
+      if(!std::isfinite(L2Norm(grads))) {
+        lossScale_ /= 2.f;
+        sinceOverflow_ = 0;
+        LOG(info, "Gradient overflow, skipping update, loss scale {}", lossScale_);
+        return false;
+      }
+
+      Element(_1 *= 1.f / lossScale_, grads);
+      if(++sinceOverflow_ % lossScaleFreq_ == 0) {
+        lossScale_ *= 2.f;
+        LOG(info, "Loss scale {}", lossScale_);
+      }
+      return true;
+    }
+
+    void updateDelayed() {
+      auto batch = lastBatch_;
+      if(delayed_ > 1) {
+        float scale = (float)lastSentences_ / delayedSentences_;
+        Element(_1 *= scale, graph_->params()->grads());
+      }
+
+      bool overflow = fp16_ && !unscaleGradients();
+      if(!overflow)
+        opt_->update(graph_);
+
+      float cost = delayedCost_ / delayedSentences_;
+      size_t sentences = delayedSentences_;
+      size_t words = delayedWords_;
+      delayed_ = delayedSentences_ = delayedWords_ = 0;
+      delayedCost_ = 0;
+      lastBatch_ = nullptr;
       
-      if(mvAvg_) {
+      if(mvAvg_ && !overflow) {
         if(!mvAvgGraph_) {
           mvAvgGraph_ = New<ExpressionGraph>();
           mvAvgGraph_->setDevice(graph_->getDevice());
@@ -91,13 +182,13 @@ class Singleton : public GraphGroup {
       }
       
       if(getReporter()) {
-        reporter_->update(cost, batch);
+        reporter_->update(cost, sentences, words);
         
         if(getReporter()->saving())
           this->save();
          
         if(getReporter()->validating())
-          if(mvAvg_)
+          if(mvAvg_ && mvAvgGraph_)
             getReporter()->validate(mvAvgGraph_);
           else
             getReporter()->validate(graph_);
@@ -111,14 +202,24 @@ class Singleton : public GraphGroup {
     Singleton(Ptr<Config> options, Args ...args)
      : GraphGroup(options),
        mvAvg_{options_->get<bool>("moving-average")},
-       mvDecay_{(float)options_->get<double>("moving-decay")} {
+       mvDecay_{(float)options_->get<double>("moving-decay")},
+       delay_{options_->get<size_t>("optimizer-delay")},
+       fp16_{options_->get<bool>("fp16")},
+       lossScaleFreq_{options_->get<size_t>("loss-scale-freq")} {
 
       size_t device = options_->get<std::vector<size_t>>("devices")[0];
        
       graph_ = New<ExpressionGraph>();
       graph_->setDevice(device);
       graph_->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+      graph_->setTapeCache(options_->get<size_t>("graph-cache"));
+      if(options_->has("profile"))
+        graph_->setProfiler(options_->get<std::string>("profile"));
       opt_ = Optimizer(options_);
+      if(fp16_) {
+        opt_->setMasterWeights(true);
+        lossScale_ = options_->get<double>("loss-scale");
+      }
       
       builder_ = New<Builder>(options_, args...); 
     }
@@ -138,11 +239,23 @@ class Singleton : public GraphGroup {
     }
     
     void save(bool final=false) {
+      // the last batches of the training are not lost
+      if(final && delayed_ > 0)
+        updateDelayed();
+
       auto saveGraph = graph_;
       if(mvAvg_)
         saveGraph = mvAvgGraph_;
+
+      // the model gets the fp32 master weights, not their fp16 copies
+      Tensor master = opt_->masterParams();
+      if(master)
+        graph_->params()->vals()->copyFrom(master);
         
       save(saveGraph, final);
+
+      if(master)
+        Element(_1 = Float16(_2), graph_->params()->vals(), master);
     }
     
     void save(Ptr<ExpressionGraph> graph, bool final=false) {
@@ -188,17 +301,21 @@ class AsyncGraphGroup : public GraphGroup {
     std::vector<std::mutex> shardSync_;
     
     boost::shared_mutex reporterMutex_;
-    
+
+#ifdef CUDA_FOUND
     std::vector<SparseTensor> localSparseGrads_;
     std::vector<SparseTensor> sparseGrads_;
     std::vector<SparseTensor> tmpSparseDelta;
     std::vector<std::vector<SparseTensor>> localSparseDelta;
+#endif
 
-    std::vector<int> globalVersionNumber; //version number per-shard
+    std::vector<std::atomic<int>> globalVersionNumber; //version number per-shard
 
     std::vector<std::vector<int>> localVersionNumbers; //each worker has the version number obtained from each shard
-    
+
+#ifdef CUDA_FOUND
     std::vector<std::vector<GradientDrop>> fetchDropper;
+#endif
     std::vector<Tensor> tmpTensor, tmpDelta;
 
     std::vector<std::vector<Tensor>> params_;
@@ -217,10 +334,26 @@ class AsyncGraphGroup : public GraphGroup {
     bool movingAvg_{false};
     float mvDecay_{0.999};
 
-    ThreadPool pool_;
+    Ptr<ThreadPool> pool_;
 
     double drop_rate_{0};
-    int history_size_{1};
+    int history_size_{2};
+
+    // one update thread per shard, fed by the workers through its queue
+    std::vector<Ptr<GradientQueue>> queues_;
+    std::vector<std::vector<Ptr<GradientSlot>>> slots_; // [shard][worker]
+    std::vector<std::thread> shardThreads_;
+
+    // per shard since the last display, staleness in versions of the shard
+    struct ShardMetrics {
+      std::atomic<size_t> updates{0};
+      std::atomic<size_t> gradients{0};
+      std::atomic<size_t> maxDepth{0};
+      std::atomic<size_t> staleness{0};
+      std::atomic<size_t> maxStaleness{0};
+      std::atomic<size_t> retries{0};      // repeated fetches
+    };
+    std::vector<Ptr<ShardMetrics>> metrics_;
 
     std::vector<Ptr<TensorAllocator>> allocators;
     Tensor newTensor(int size, int device){
@@ -233,60 +366,127 @@ class AsyncGraphGroup : public GraphGroup {
       return T;
     }
 
-    void fetchParams(Tensor oldParams, const std::vector<Tensor>& params) {
-      // @TODO read guard on parameters
-      int pos = 0;
+    int shardOffset(int idx) {
+      return idx * shardSize_;
+    }
 
-      std::vector<std::thread> threads;
-      for (int idx = 0; idx < devices_.size(); idx++) {
-        threads.emplace_back( std::thread( [=](int idx, int pos) {
-          //individual mutex per-shard
-          std::lock_guard<std::mutex> guard( shardSync_[idx] );
-          oldParams->subtensor(pos , params[idx]->size())->copyFrom(params[idx]);
-        }, idx, pos) );
+    /**
+     * Copies the latest version of every shard into the parameters of a
+     * worker, without locking. A shard writes its update into the buffer
+     * after the published one and publishes it by incrementing its version,
+     * so a published buffer is rewritten only history_size_ - 1 versions
+     * later; a copy that overlapped that many updates is repeated.
+     */
+    void fetchParams(Tensor oldParams, size_t worker) {
+      for(int idx = 0; idx < devices_.size(); idx++) {
+        auto shardParams = oldParams->subtensor(shardOffset(idx), grads_[idx]->size());
+        int version = globalVersionNumber[idx];
+        shardParams->copyFrom(params_[version % history_size_][idx]);
+        while(globalVersionNumber[idx] - version > history_size_ - 2) {
+          metrics_[idx]->retries++;
+          version = globalVersionNumber[idx];
+          shardParams->copyFrom(params_[version % history_size_][idx]);
+        }
+        localVersionNumbers[worker][idx] = version;
+      }
+      cudaSetDevice(oldParams->getDevice());
+    }
 
-        pos += shardSize_;
+    void fetchAverage(Tensor oldParams) {
+      for(int idx = 0; idx < devices_.size(); idx++) {
+        std::lock_guard<std::mutex> guard(shardSync_[idx]);
+        oldParams->subtensor(shardOffset(idx), paramsAvg_[idx]->size())
+          ->copyFrom(paramsAvg_[idx]);
       }
-      for (auto &&t : threads) {
-        t.join();
+      cudaSetDevice(oldParams->getDevice());
+    }
+
+    /**
+     * Hands the gradients of a worker to the shards. The slices are copied
+     * into the slots of the worker, so the worker can go on with its next
+     * batch while the shards update.
+     */
+    void pushGradients(Tensor newGrads, size_t worker) {
+      for(int idx = 0; idx < devices_.size(); idx++) {
+        auto slot = slots_[idx][worker];
+        // the shard has taken the previous gradient long before, usually
+        while(slot->pending)
+          std::this_thread::yield();
+
+        slot->grads->copyFrom(newGrads->subtensor(shardOffset(idx), slot->grads->size()));
+        slot->version = localVersionNumbers[worker][idx];
+        queues_[idx]->push(slot.get());
       }
+      cudaSetDevice(newGrads->getDevice());
     }
 
-    void pushGradients(Tensor newGrads) {
-      // add instead of copy?
-      std::vector<std::thread> threads;
-      int pos = 0;
-      for (int idx = 0; idx < devices_.size(); idx++) {
-        threads.emplace_back( std::thread([=](int idx, int pos) {
-          //individual mutex per-shard
-          std::lock_guard<std::mutex> guard(shardSync_[idx]);
-          grads_[idx]->copyFrom(newGrads->subtensor(pos, grads_[idx]->size()));
+    /**
+     * The update thread of shard idx. The gradients that queued up while it
+     * was busy are summed and applied as one update, into the buffer after
+     * the published one.
+     */
+    void updateShard(int idx) {
+      cudaSetDevice(devices_[idx]);
+      auto& metrics = *metrics_[idx];
+
+      while(GradientSlot* slot = queues_[idx]->popAll()) {
+        int version = globalVersionNumber[idx];
+
+        size_t gradients = 0;
+        for(; slot; ++gradients) {
+          if(gradients == 0)
+            grads_[idx]->copyFrom(slot->grads);
+          else
+            Element(_1 += _2, grads_[idx], slot->grads);
+          cudaStreamSynchronize(0);
 
-          // apply and increment your version number, if history is enabled
-          int latestVersion = 0;
+          size_t staleness = version - slot->version;
+          metrics.staleness += staleness;
+          if(staleness > metrics.maxStaleness)
+            metrics.maxStaleness = staleness;
 
-          if (history_size_ > 1){
-            int pastVersion = globalVersionNumber[idx] % history_size_;
-            latestVersion =  ++globalVersionNumber[idx] % history_size_;
-            params_[latestVersion][idx]->copyFrom(params_[pastVersion][idx]);
-          }
+          // the worker may refill the slot as soon as it is released
+          GradientSlot* next = slot->next;
+          slot->pending = false;
+          slot = next;
+        }
 
-          shardOpt_[idx]->update(params_[latestVersion][idx],  grads_[idx] );
+        int past = version % history_size_;
+        int latest = (version + 1) % history_size_;
+        params_[latest][idx]->copyFrom(params_[past][idx]);
+        shardOpt_[idx]->update(params_[latest][idx], grads_[idx]);
 
+        if(movingAvg_) {
+          std::lock_guard<std::mutex> guard(shardSync_[idx]);
+          updateMovingAverage(paramsAvg_[idx], params_[latest][idx]);
+        }
 
-          if(movingAvg_)
-            updateMovingAverage(paramsAvg_[idx], params_[latestVersion][idx]);
-          
-          cudaStreamSynchronize(0);
-        }, idx, pos));
+        cudaStreamSynchronize(0);
+        globalVersionNumber[idx] = version + 1;
 
-        pos += shardSize_;
+        metrics.updates++;
+        metrics.gradients += gradients;
+        if(gradients > metrics.maxDepth)
+          metrics.maxDepth = gradients;
       }
-      for(auto&& t : threads)
-        t.join();    
     }
 
+    void logShards() {
+      for(int idx = 0; idx < metrics_.size(); idx++) {
+        auto& metrics = *metrics_[idx];
+        size_t updates = metrics.updates.exchange(0);
+        size_t gradients = metrics.gradients.exchange(0);
+        LOG(info, "Shard {} : {} updates : Depth {:.2f} max {} : Staleness {:.2f} max {} : "
+            "Queued {} : Fetches repeated {}",
+            idx, updates,
+            updates ? (float)gradients / updates : 0.f, metrics.maxDepth.exchange(0),
+            gradients ? (float)metrics.staleness.exchange(0) / gradients : 0.f,
+            metrics.maxStaleness.exchange(0), queues_[idx]->depth(),
+            metrics.retries.exchange(0));
+      }
+    }
 
+#ifdef CUDA_FOUND
     void sparseFetchParams(Tensor oldParams, int worker_id ) {
       if(graphs_.size() < 2)
         return;
@@ -389,6 +589,7 @@ class AsyncGraphGroup : public GraphGroup {
           t.join();
       }
     }
+#endif
 
 
     void updateMovingAverage(Tensor paramsAvg, Tensor params) {
@@ -406,7 +607,6 @@ class AsyncGraphGroup : public GraphGroup {
             graphs_[i]->forward();
           );
 
-          globalVersionNumber.push_back(0);
           std::vector<int> localVersion;
           for (int j=0;j<graphs_.size();j++)
             localVersion.push_back(0);
@@ -416,12 +616,12 @@ class AsyncGraphGroup : public GraphGroup {
         
         if(params_[0].size() == 0) {
           int totalSize = graphs_[0]->params()->vals()->size();
-          shardSize_ = ceil(totalSize / devices_.size());
+          shardSize_ = (totalSize + devices_.size() - 1) / devices_.size();
 
           int pos = 0;
           //parameter sharding
           for (auto device : devices_){
-            int __size__ = min(shardSize_, totalSize);
+            int __size__ = std::min(shardSize_, totalSize);
             totalSize -= __size__;
            
 
@@ -443,7 +643,7 @@ class AsyncGraphGroup : public GraphGroup {
           int totalSize = graphs_[0]->params()->vals()->size();
 
           for (auto device : devices_){
-            int __size__ = min(shardSize_, totalSize);
+            int __size__ = std::min(shardSize_, totalSize);
             totalSize -= __size__;
             Tensor grad_;
             Ptr<TensorAllocator> allocator_ = New<TensorAllocator>(device);
@@ -452,6 +652,15 @@ class AsyncGraphGroup : public GraphGroup {
             allocator_->allocate(grad_, {1, __size__});
             gradsAlloc_.push_back(allocator_);
             grads_.push_back(grad_);
+
+            std::vector<Ptr<GradientSlot>> slots;
+            for(size_t worker = 0; worker < devices_.size(); ++worker) {
+              auto slot = New<GradientSlot>();
+              slot->grads = newTensor(__size__, device);
+              slot->worker = worker;
+              slots.push_back(slot);
+            }
+            slots_.push_back(slots);
           }
         }
         if(movingAvg_) {
@@ -460,7 +669,7 @@ class AsyncGraphGroup : public GraphGroup {
             
             int i = 0;
             for(auto device : devices_){
-              int __size__ = min(shardSize_, totalSize);
+              int __size__ = std::min(shardSize_, totalSize);
               totalSize -= __size__;
               Tensor paramAvg;
               Ptr<TensorAllocator> allocator = New<TensorAllocator>(device);
@@ -476,6 +685,7 @@ class AsyncGraphGroup : public GraphGroup {
           }
         }
         
+#ifdef CUDA_FOUND
         if(drop_rate_ && first_) {
           int totalSize = graphs_[0]->params()->vals()->size();
           int sparseCap = totalSize / 10;
@@ -489,7 +699,10 @@ class AsyncGraphGroup : public GraphGroup {
             localSparseDelta.push_back(tmp);
           }
         }
+#endif
 
+        for(int idx = 0; idx < devices_.size(); idx++)
+          shardThreads_.emplace_back(&AsyncGraphGroup::updateShard, this, idx);
 
         first_ = false;
       }
@@ -500,9 +713,10 @@ class AsyncGraphGroup : public GraphGroup {
         thread_local Ptr<Builder> builder;
         thread_local size_t t = 0;
 
+#ifdef CUDA_FOUND
         //gradient drop purpose
         thread_local GradientDrop dropper;
-        
+#endif
 
         thread_local size_t my_id = 0;
         
@@ -516,7 +730,8 @@ class AsyncGraphGroup : public GraphGroup {
             tmpDelta.push_back( newTensor( graph->params()->vals()->size() , graph->params()->vals()->getDevice() ) );
         }
 
-        
+
+#ifdef CUDA_FOUND
         if(!dropper) {
           std::lock_guard<std::mutex> lock(sync_);
           dropper = GradientDrop(new GradientDropBase());
@@ -525,13 +740,20 @@ class AsyncGraphGroup : public GraphGroup {
             tmp.push_back(GradientDrop(new GradientDropBase()));
           fetchDropper.push_back(tmp);
         }
+#endif
 
-        auto costNode = builder->build(graph, batch);
-        
+        auto costNode = graph->replay(batch);
+        if(!costNode) {
+          costNode = builder->build(graph, batch);
+          graph->record(batch, costNode);
+        }
+
+#ifdef CUDA_FOUND
         if (drop_rate_ && t > 0 )
           sparseFetchParams(graph->params()->vals(), my_id );
         else
-          fetchParams(graph->params()->vals(), params_[globalVersionNumber[my_id] % history_size_]);
+#endif
+          fetchParams(graph->params()->vals(), my_id);
         
         graph->forward();
         float cost = costNode->scalar();
@@ -540,37 +762,41 @@ class AsyncGraphGroup : public GraphGroup {
         t++;
         
         cudaStreamSynchronize(0);
+#ifdef CUDA_FOUND
         if (drop_rate_){
           dropper->dropGraph(graph->params()->grads() , localSparseGrads_[my_id] , drop_rate_ );
           sparsePush(localSparseGrads_[my_id]);
         }
         else
-          pushGradients(graph->params()->grads());
+#endif
+          pushGradients(graph->params()->grads(), my_id);
 
         if(getReporter()) {
           boost::upgrade_lock<boost::shared_mutex> lock(reporterMutex_);
           {
             boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
             getReporter()->update(cost, batch);
+            if(getReporter()->batches % options_->get<size_t>("disp-freq") == 0)
+              logShards();
           }
           
           if(getReporter()->saving()) {
             boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
             if(movingAvg_)
-              fetchParams(graph->params()->vals(), paramsAvg_);
+              fetchAverage(graph->params()->vals());
             this->save(graph);
           }
            
           if(getReporter()->validating()) {
             boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
             if(movingAvg_)
-              fetchParams(graph->params()->vals(), paramsAvg_);
+              fetchAverage(graph->params()->vals());
             getReporter()->validate(graph);
           }
         }
       };
 
-      pool_.enqueue(task, batch);
+      pool_->enqueue(task, batch);
     }
 
   public:
@@ -580,14 +806,18 @@ class AsyncGraphGroup : public GraphGroup {
     AsyncGraphGroup(Ptr<Config> options, Args ...args)
      : GraphGroup(options),
        devices_{options_->get<std::vector<size_t>>("devices")},
-       pool_{devices_.size(), devices_.size()},
        shardSync_{devices_.size()},
+       globalVersionNumber(devices_.size()),
        movingAvg_{options_->get<bool>("moving-average")},
        mvDecay_{(float)options_->get<double>("moving-decay")},
        drop_rate_{options_->get<double>("drop-rate")} {
 
+#ifndef CUDA_FOUND
+      UTIL_THROW_IF2(drop_rate_ > 0.0,
+                     "Gradient dropping (--drop-rate) is only available in the GPU version");
+#endif
       if (drop_rate_ > 0.0){
-          history_size_ = devices_.size() * 1.5;
+          history_size_ = std::max<int>(2, devices_.size() * 1.5);
       }
       for (int i=0;i<history_size_;i++)
         params_.push_back(std::vector<Tensor>());
@@ -595,10 +825,25 @@ class AsyncGraphGroup : public GraphGroup {
         auto graph = New<ExpressionGraph>();
         graph->setDevice(device);
         graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+        graph->setTapeCache(options_->get<size_t>("graph-cache"));
+        if(options_->has("profile"))
+          graph->setProfiler(options_->get<std::string>("profile"));
         graphs_.push_back(graph);
         shardOpt_.push_back(Optimizer(options_));
         builders_.push_back(New<Builder>(options_, args...));
+        queues_.push_back(New<GradientQueue>());
+        metrics_.push_back(New<ShardMetrics>());
       }
+      pool_ = New<ThreadPool>(devices_.size(), devices_.size());
+    }
+
+    ~AsyncGraphGroup() {
+      // the workers finish their batches before the shards stop
+      pool_.reset();
+      for(auto queue : queues_)
+        queue->close();
+      for(auto& t : shardThreads_)
+        t.join();
     }
 
     void update(Ptr<data::CorpusBatch> batch) {
@@ -658,121 +903,178 @@ class AsyncGraphGroup : public GraphGroup {
 };
 
 
+/**
+ * Synchronous SGD: every update computes one batch per device and applies
+ * the average gradient, so all graphs keep the same parameters. The
+ * gradients are summed with a ring reduce-scatter (see RingReduce); each
+ * worker then updates the chunk of the parameters it holds the sum of with
+ * an optimizer of its own, and the updated chunks are passed around the
+ * ring to all graphs. No device sums or updates more than its chunk.
+ */
 template <class Builder>
 class SyncGraphGroup : public GraphGroup {
   private:
-    Ptr<Builder> builder_;
+    std::vector<Ptr<Builder>> builders_;
+    std::vector<size_t> devices_;
     std::vector<Ptr<data::CorpusBatch>> batches_;
 
+    Ptr<RingReduce> ring_;
+    std::vector<Ptr<OptimizerBase>> shardOpt_;
+
+    // moving average of the chunk each worker updates
+    bool movingAvg_{false};
+    float mvDecay_{0.999};
+    std::vector<Tensor> paramsAvg_;
+    Tensor paramsBackup_;
+    std::vector<Ptr<TensorAllocator>> allocators_;
+
     bool first_{true};
 
-    void accumulateGradients(Ptr<ExpressionGraph> master,
-                             std::vector<Ptr<ExpressionGraph>> graphs) {
-      if(graphs_.size() < 2) {
-        return;
+    Tensor newTensor(int size, size_t device) {
+      Tensor t;
+      auto allocator = New<TensorAllocator>(device);
+      allocator->reserveExact(size);
+      allocator->allocate(t, {1, size});
+      allocators_.push_back(allocator);
+      return t;
+    }
+
+    void initialize(Ptr<data::CorpusBatch> batch) {
+      for(size_t i = 0; i < graphs_.size(); ++i) {
+        THREAD_GUARD(
+          builders_[i]->build(graphs_[i], batch);
+          graphs_[i]->forward();
+        );
       }
 
-      Tensor grads = master->params()->grads();
-      Tensor tempGrads;
-      master->tensor(tempGrads, grads->shape());
+      // all graphs start from the parameters of the first one
+      int totalSize = graphs_[0]->params()->vals()->size();
+      for(size_t i = 1; i < graphs_.size(); ++i)
+        graphs_[i]->params()->vals()->copyFrom(graphs_[0]->params()->vals());
 
-      for(auto graph : graphs) {
-        if(graph != master) {
-          Tensor remoteGrads = graph->params()->grads();
-          tempGrads->copyFrom(remoteGrads);
-          Element(_1 += _2, grads, tempGrads);
+      ring_ = New<RingReduce>(devices_, totalSize);
+
+      if(movingAvg_) {
+        for(size_t i = 0; i < graphs_.size(); ++i) {
+          auto chunk = ring_->chunk(graphs_[i]->params()->vals(), ring_->owner(i));
+          paramsAvg_.push_back(chunk ? newTensor(chunk->size(), devices_[i]) : nullptr);
+          if(chunk)
+            paramsAvg_.back()->copyFrom(chunk);
         }
+        paramsBackup_ = newTensor(totalSize, devices_[0]);
       }
-
-      float denom = graphs_.size();
-      Element(_1 /= denom, grads);
     }
 
-    void distributeParameters(Ptr<ExpressionGraph> master,
-                              std::vector<Ptr<ExpressionGraph>> graphs) {
-      if(graphs_.size() < 2)
-        return;
-
-      Tensor params = master->params()->vals();
-      for(auto graph : graphs) {
-        if(graph != master) {
-          graph->params()->vals()->copyFrom(params);
-        }
+    /** Swaps the parameters of the first graph with the moving average */
+    void swapAverage(bool average) {
+      Tensor params = graphs_[0]->params()->vals();
+      if(average) {
+        paramsBackup_->copyFrom(params);
+        for(size_t i = 0; i < graphs_.size(); ++i)
+          if(paramsAvg_[i])
+            ring_->chunk(params, ring_->owner(i))->copyFrom(paramsAvg_[i]);
+      }
+      else {
+        params->copyFrom(paramsBackup_);
       }
     }
 
     void execute() {
+      if(batches_.empty())
+        return;
+
       if(first_) {
-        for(auto graph : graphs_) {
-          builder_->build(graph, batches_[0]);
-          graph->forward();
-        }
-        distributeParameters(graphs_[0], graphs_);
+        initialize(batches_[0]);
         first_ = false;
       }
 
-      auto task = [this](int i,
-                         Ptr<data::CorpusBatch> batch) {
-        thread_local int j = -1;
-        if(j == -1)
-          j = i;
-        auto localGraph = this->graphs_[j];
-
-        auto costNode = builder_->build(localGraph, batch);
-        localGraph->forward();
-        float cost = costNode->scalar();
-        localGraph->backward();
-
-        if(getReporter()) {
-          getReporter()->update(cost, batch);
-          if(getReporter()->batches % options_->get<size_t>("save-freq") == 0)
-            this->save();
+      // one batch per graph, graphs without a batch add zero gradients
+      std::vector<float> costs(batches_.size());
+      ring_->forEach([&](size_t i) {
+        auto graph = graphs_[i];
+        if(i >= batches_.size()) {
+          graph->params()->grads()->set(0);
+          return;
         }
-      };
 
-      {
-        size_t workers = graphs_.size();
-        ThreadPool pool(workers, workers);
+        auto costNode = graph->replay(batches_[i]);
+        if(!costNode) {
+          costNode = builders_[i]->build(graph, batches_[i]);
+          graph->record(batches_[i], costNode);
+        }
+        graph->forward();
+        costs[i] = costNode->scalar();
+        graph->backward();
+      });
 
-        for(int i = 0; i < batches_.size(); ++i)
-          pool.enqueue(task, i % (int)workers, batches_[i]);
+      std::vector<Tensor> grads, params;
+      for(auto graph : graphs_) {
+        grads.push_back(graph->params()->grads());
+        params.push_back(graph->params()->vals());
       }
-      accumulateGradients(graphs_[0], graphs_);
-      opt_->update(graphs_[0]);
-      distributeParameters(graphs_[0], graphs_);
 
-      batches_.clear();
-    }
+      ring_->reduceScatter(grads);
 
-    void load() {
-      if(options_->has("init")) {
-        std::string init = options_->get<std::string>("init");
-        for(auto graph : graphs_)
-        builder_->load(graph, init);
+      float denom = batches_.size();
+      ring_->forEach([&](size_t i) {
+        size_t c = ring_->owner(i);
+        auto grad = ring_->chunk(grads[i], c);
+        if(!grad)
+          return;
+        auto param = ring_->chunk(params[i], c);
+        Element(_1 /= denom, grad);
+        shardOpt_[c]->update(param, grad);
+        if(movingAvg_)
+          Element(_1 = (mvDecay_ * _1) + ((1.f - mvDecay_) * _2),
+                  paramsAvg_[i], param);
+      });
+
+      ring_->allGather(params);
+
+      if(getReporter()) {
+        for(size_t i = 0; i < batches_.size(); ++i) {
+          getReporter()->update(costs[i], batches_[i]);
+
+          if(getReporter()->saving())
+            this->save();
+
+          if(getReporter()->validating()) {
+            if(movingAvg_)
+              swapAverage(true);
+            getReporter()->validate(graphs_[0]);
+            if(movingAvg_)
+              swapAverage(false);
+          }
+        }
       }
+
+      batches_.clear();
     }
 
   public:
     typedef Builder builder_type;
 
-    SyncGraphGroup(Ptr<Config> options)
+    template <class ...Args>
+    SyncGraphGroup(Ptr<Config> options, Args ...args)
      : GraphGroup(options),
-       builder_{New<Builder>(options_)} {
+       devices_{options_->get<std::vector<size_t>>("devices")},
+       movingAvg_{options_->get<bool>("moving-average")},
+       mvDecay_{(float)options_->get<double>("moving-decay")} {
 
-      auto devices = options_->get<std::vector<size_t>>("devices");
-      size_t workers = devices.size();
+      UTIL_THROW_IF2(options_->get<double>("drop-rate") > 0.0,
+                     "Gradient dropping (--drop-rate) cannot be used with --sync-sgd");
 
-      for(auto device : devices) {
-        graphs_.emplace_back(New<ExpressionGraph>());
-        graphs_.back()->setDevice(device);
-        graphs_.back()->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+      for(auto device : devices_) {
+        auto graph = New<ExpressionGraph>();
+        graph->setDevice(device);
+        graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+        graph->setTapeCache(options_->get<size_t>("graph-cache"));
+        if(options_->has("profile"))
+          graph->setProfiler(options_->get<std::string>("profile"));
+        graphs_.push_back(graph);
+        shardOpt_.push_back(Optimizer(options_));
+        builders_.push_back(New<Builder>(options_, args...));
       }
-
-      load();
-    }
-
-    ~SyncGraphGroup() {
-      execute();
     }
 
     void update(Ptr<data::CorpusBatch> batch) {
@@ -781,20 +1083,42 @@ class SyncGraphGroup : public GraphGroup {
         execute();
     }
 
-    void save(bool final=false) {
-      if(options_->get<bool>("overwrite")) {
-        std::string name = options_->get<std::string>("model") + ".npz";
-        builder_->save(graphs_[0], name);
+    void load() {
+      if(!options_->get<bool>("no-reload")) {
+        std::string init = options_->get<std::string>("model");
+        if(boost::filesystem::exists(init)) {
+          size_t i = 0;
+          getReporter()->load(init);
+          for(auto graph : graphs_)
+            builders_[i++]->load(graph, init);
+        }
       }
-      else {
-        std::string name = options_->get<std::string>("model")
-          + "." + std::to_string(getReporter()->batches) + ".npz";
-        builder_->save(graphs_[0], name);
+    }
+
+    void save(bool final=false) {
+      // the last batches of the training are fewer than the devices
+      if(final)
+        execute();
+
+      if(movingAvg_ && !first_)
+        swapAverage(true);
+
+      std::string name = options_->get<std::string>("model");
+      if(!options_->get<bool>("overwrite") && !final) {
+        std::string nameOverwrite = name;
+        nameOverwrite.replace(name.size() - 4, 4,
+          ".iter" + std::to_string(getReporter()->batches) + ".npz");
+        builders_[0]->save(graphs_[0], nameOverwrite);
       }
+      builders_[0]->save(graphs_[0], name, true);
+      getReporter()->save(name);
+
+      if(movingAvg_ && !first_)
+        swapAverage(false);
     }
-    
+
     Ptr<data::BatchStats> collectStats() {
-      return builder_->collectStats(graphs_[0]);
+      return builders_[0]->collectStats(graphs_[0]);
     }
 };
 
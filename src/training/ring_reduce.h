@@ -0,0 +1,118 @@
+#pragma once
+
+#include <future>
+#include <vector>
+
+#include "3rd_party/threadpool.h"
+#include "kernels/tensor_operators.h"
+#include "tensors/tensor_allocator.h"
+
+namespace marian {
+
+/**
+ * Sums equally sized tensors of several workers, each on the device of its
+ * worker, without a master. The tensors are cut into one chunk per worker.
+ * In the reduce-scatter every worker adds the chunk of its predecessor in
+ * the ring to its own copy of that chunk, N - 1 times, after which worker i
+ * holds the full sum of chunk owner(i). In the all-gather the owned chunks
+ * are passed on around the ring the same way. Every step moves one chunk
+ * per worker and all workers move theirs at the same time, so each worker
+ * sends and receives 2 (N - 1) / N tensor sizes in total, independent of N.
+ */
+class RingReduce {
+  private:
+    std::vector<size_t> devices_;
+    std::vector<int> offsets_;
+    std::vector<int> sizes_;
+
+    // the chunk received from the predecessor in the reduce-scatter
+    std::vector<Tensor> buffers_;
+    std::vector<Ptr<TensorAllocator>> allocators_;
+
+    ThreadPool pool_;
+
+  public:
+    RingReduce(const std::vector<size_t>& devices, int size)
+    : devices_(devices),
+      pool_(devices.size()) {
+      int workers = devices_.size();
+      int chunkSize = (size + workers - 1) / workers;
+      for(int c = 0; c < workers; ++c) {
+        offsets_.push_back(std::min(c * chunkSize, size));
+        sizes_.push_back(std::min(chunkSize, size - offsets_.back()));
+      }
+
+      for(auto device : devices_) {
+        Tensor buffer;
+        auto allocator = New<TensorAllocator>(device);
+        allocator->reserveExact(std::max(chunkSize, 1));
+        allocator->allocate(buffer, {1, std::max(chunkSize, 1)});
+        buffers_.push_back(buffer);
+        allocators_.push_back(allocator);
+      }
+    }
+
+    size_t size() const {
+      return devices_.size();
+    }
+
+    /** The chunk whose sum worker i holds after reduceScatter() */
+    size_t owner(size_t i) const {
+      return (i + 1) % devices_.size();
+    }
+
+    /** Chunk c of tensor t, empty chunks are null */
+    Tensor chunk(Tensor t, size_t c) const {
+      if(sizes_[c] == 0)
+        return nullptr;
+      return t->subtensor(offsets_[c], sizes_[c]);
+    }
+
+    /** Runs f(i) for all workers i concurrently, each on its device, and waits */
+    template <class F>
+    void forEach(F f) {
+      std::vector<std::future<void>> done;
+      for(size_t i = 0; i < devices_.size(); ++i) {
+        done.push_back(pool_.enqueue([this, f](size_t j) {
+          cudaSetDevice(devices_[j]);
+          f(j);
+          cudaStreamSynchronize(0);
+        }, i));
+      }
+      for(auto& d : done)
+        d.get();
+    }
+
+    /** Afterwards chunk owner(i) of tensors[i] is the sum over all workers */
+    void reduceScatter(const std::vector<Tensor>& tensors) {
+      size_t workers = devices_.size();
+      for(size_t step = 0; step + 1 < workers; ++step) {
+        forEach([&](size_t i) {
+          size_t prev = (i + workers - 1) % workers;
+          size_t c = (i + 2 * workers - step - 1) % workers;
+          auto from = chunk(tensors[prev], c);
+          if(!from)
+            return;
+          auto buffer = buffers_[i]->subtensor(0, from->size());
+          buffer->copyFrom(from);
+          Element(_1 += _2, chunk(tensors[i], c), buffer);
+        });
+      }
+    }
+
+    /** Copies chunk owner(i) of tensors[i] to the tensors of all workers */
+    void allGather(const std::vector<Tensor>& tensors) {
+      size_t workers = devices_.size();
+      for(size_t step = 0; step + 1 < workers; ++step) {
+        forEach([&](size_t i) {
+          size_t prev = (i + workers - 1) % workers;
+          size_t c = (i + workers - step) % workers;
+          auto from = chunk(tensors[prev], c);
+          if(from)
+            chunk(tensors[i], c)->copyFrom(from);
+        });
+      }
+    }
+};
+
+}
@@ -98,10 +98,15 @@ class Reporter {
     }
 
     void update(float cost, Ptr<data::CorpusBatch> batch) {
-      costSum += cost * batch->size();
-      samples += batch->size();
-      samplesDisp += batch->size();
-      wordsDisp += batch->words();
+      update(cost, batch->size(), batch->words());
+    }
+
+    /** One update over several batches, cost is the mean over their sentences */
+    void update(float cost, size_t sentences, size_t words) {
+      costSum += cost * sentences;
+      samples += sentences;
+      samplesDisp += sentences;
+      wordsDisp += words;
       batches++;
 
       if(batches % options_->get<size_t>("disp-freq") == 0) {
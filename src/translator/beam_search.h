@@ -43,58 +43,160 @@ class BeamSearch {
        beamSize_(options_->get<size_t>("beam-size"))
     {}
 
-    Beam toHyps(const std::vector<uint> keys,
-                const std::vector<float> costs,
-                size_t vocabSize,
-                const Beam& beam,
-                std::vector<Ptr<ScorerState>>& states) {
-
-      Beam newBeam;
-      for(int i = 0; i < keys.size(); ++i) {
-        int embIdx = keys[i] % vocabSize;
-        int hypIdx = keys[i] / vocabSize;
-        float cost = costs[i];
+    /**
+     * Turns the selected keys into hypotheses of the arena. The cost matrix
+     * has localBeamSize rows per sentence, grouped by sentence, while the
+     * rows of the decoder states are grouped by beam position, i.e. row
+     * k * dimBatch + b holds hypothesis k of sentence b. Each sentence keeps
+     * as many of its best keys as it has live hypotheses.
+     *
+     * If the arena keeps cost breakdowns, the cost of every scorer is
+     * accumulated per hypothesis. The costs of all new hypotheses are
+     * gathered with one copy per scorer.
+     */
+    Beams toHyps(const std::vector<uint> keys,
+                 const std::vector<float> costs,
+                 size_t vocabSize,
+                 const Beams& beams,
+                 std::vector<Ptr<ScorerState>>& states,
+                 size_t localBeamSize,
+                 bool first,
+                 Hypotheses& hyps,
+                 Ptr<FilterInfo> shortlist = nullptr) {
+
+      size_t dimBatch = beams.size();
+      size_t selected = keys.size() / dimBatch;
+
+      // positions of the new hypotheses in the scorer outputs
+      std::vector<size_t> positions;
+
+      Beams newBeams(dimBatch);
+      for(size_t b = 0; b < dimBatch; ++b) {
+        const Beam& beam = beams[b];
+        size_t keep = first ? selected : beam.size();
+
+        for(size_t i = 0; i < keep; ++i) {
+          size_t key = keys[b * selected + i];
+          size_t embIdx = key % vocabSize;
+          size_t beamHypIdx = key / vocabSize - b * localBeamSize;
+          size_t hypIdx = beamHypIdx * dimBatch + b;
+          float cost = costs[b * selected + i];
+
+          // costs are over the shortlist, hypotheses hold vocabulary ids
+          size_t word = shortlist ? shortlist->reverseMap(embIdx) : embIdx;
+
+          positions.push_back(hypIdx * vocabSize + embIdx);
+          newBeams[b].push_back(hyps.add(beam[beamHypIdx], word, hypIdx, cost));
+        }
+      }
 
-        std::vector<float> breakDown(states.size(), 0);
-        beam[hypIdx]->GetCostBreakdown().resize(states.size(), 0);
+      size_t breakdownSize = hyps.GetCostBreakdownSize();
+      if(breakdownSize > 0) {
+        std::vector<std::vector<float>> scorerCosts(states.size());
+        for(size_t j = 0; j < states.size(); ++j)
+          states[j]->breakDown(positions, scorerCosts[j]);
+
+        size_t i = 0;
+        for(auto& beam : newBeams) {
+          for(Hyp h : beam) {
+            const float* prev = hyps.GetCostBreakdown(hyps.GetPrevHyp(h));
+            float* breakdown = hyps.GetCostBreakdown(h);
+            for(size_t j = 0; j < breakdownSize; ++j)
+              breakdown[j] = scorerCosts[j][i] + prev[j];
+            ++i;
+          }
+        }
+      }
 
-        for(int j = 0; j < states.size(); ++j)
-          breakDown[j] = states[j]->breakDown(keys[i])
-            + beam[hypIdx]->GetCostBreakdown()[j];
+      return newBeams;
+    }
 
-        auto hyp = New<Hypothesis>(beam[hypIdx], embIdx, hypIdx, cost);
-        hyp->GetCostBreakdown() = breakDown;
-        newBeam.push_back(hyp);
+    /** The largest cost a step can add to a hypothesis, infinite if unbounded */
+    float stepCostBound() {
+      float bound = 0;
+      for(auto scorer : scorers_) {
+        float weight = scorer->getWeight();
+        if(weight > 0)
+          bound += weight * scorer->maxStepCost();
+        else if(weight < 0)
+          bound += weight * scorer->minStepCost();
       }
-      return newBeam;
+      return bound;
     }
 
-    Beam pruneBeam(const Beam& beam) {
+    Beam pruneBeam(const Beam& beam, const Hypotheses& hyps) {
       Beam newBeam;
-      for(auto hyp : beam) {
-        if(hyp->GetWord() > 0) {
-          newBeam.push_back(hyp);
+      for(Hyp h : beam) {
+        if(hyps.GetWord(h) > 0) {
+          newBeam.push_back(h);
         }
       }
       return newBeam;
     }
 
-    Ptr<History> search(Ptr<ExpressionGraph> graph,
-                        Ptr<data::CorpusBatch> batch,
-                        size_t sentenceId = 0) {
+    /**
+     * Translates all sentences of the batch at once. Every step decodes a
+     * {batch, vocab, 1, beam} block, where beam is the largest number of live
+     * hypotheses of any sentence; sentences with fewer are padded with
+     * hypotheses that cannot be selected.
+     *
+     * With a shortlist the scorers only compute the costs of its words.
+     * Scorers with graphs of their own (see ConcurrentScorer) compute their
+     * steps concurrently, the search waits for all of them before it sums
+     * their costs.
+     *
+     * A sentence is done when all of its hypotheses have finished or it
+     * reaches max-length-factor times its source length. Without n-best
+     * lists it is also done as soon as no live hypothesis can end better
+     * than the best finished one (see History::Decided()), which does not
+     * change the best translation.
+     */
+    Histories search(Ptr<ExpressionGraph> graph,
+                     Ptr<data::CorpusBatch> batch,
+                     Ptr<FilterInfo> shortlist = nullptr) {
+
+      size_t dimBatch = batch->size();
+      auto sentenceIds = batch->getSentenceIds();
+
+      // search stops at a multiple of the length of a source sentence
+      float factor = options_->get<float>("max-length-factor");
+      std::vector<float> srcLengths(dimBatch, 0);
+      auto srcBatch = batch->front();
+      for(size_t i = 0; i < srcBatch->mask().size(); ++i)
+        srcLengths[i % dimBatch] += srcBatch->mask()[i];
+      std::vector<size_t> maxLengths;
+      for(auto length : srcLengths)
+        maxLengths.push_back(std::max<size_t>(1, factor * length));
+
+      // one arena for the search trees of the batch, cost breakdowns are
+      // only printed with n-best lists
+      bool nbest = options_->has("n-best") && options_->get<bool>("n-best");
+
+      float stepCost = stepCostBound();
+      bool earlyStop = !nbest && !options_->get<bool>("no-early-stop")
+                       && stepCost < std::numeric_limits<float>::infinity();
+      auto hyps = New<Hypotheses>(nbest ? scorers_.size() : 0);
+      hyps->reserve(dimBatch * beamSize_ * (srcBatch->batchWidth() + 1));
+
+      Histories histories;
+      Beams beams;
+      for(size_t b = 0; b < dimBatch; ++b) {
+        size_t lineNo = b < sentenceIds.size() ? sentenceIds[b] : b;
+        histories.push_back(New<History>(lineNo, hyps, options_->get<bool>("normalize")));
+        beams.push_back(Beam(1, Hypotheses::START));
+        histories.back()->Add(beams.back());
+      }
 
-      auto history = New<History>(sentenceId, options_->get<bool>("normalize"));
-      Beam beam(1, New<Hypothesis>());
       bool first = true;
-      bool final = false;
-      std::vector<size_t> beamSizes(1, beamSize_);
-      auto nth = New<NthElement>(beamSize_, batch->size(), stream_);
-      history->Add(beam);
+      bool done = false;
+      auto nth = New<NthElement>(beamSize_, dimBatch, stream_);
 
       std::vector<Ptr<ScorerState>> states;
 
       for(auto scorer : scorers_) {
         scorer->clear(graph);
+        if(shortlist)
+          scorer->setShortlist(shortlist);
       }
 
       for(auto scorer : scorers_) {
@@ -104,7 +206,11 @@ class BeamSearch {
       do {
 
         //**********************************************************************
-        // create constant containing previous costs for current beam
+        // create constant containing previous costs for current beams
+        size_t localBeamSize = 1;
+        for(auto& beam : beams)
+          localBeamSize = std::max(localBeamSize, beam.size());
+
         std::vector<size_t> hypIndices;
         std::vector<size_t> embIndices;
         Expr prevCosts;
@@ -114,12 +220,22 @@ class BeamSearch {
         }
         else {
           std::vector<float> beamCosts;
-          for(auto hyp : beam) {
-            hypIndices.push_back(hyp->GetPrevStateIndex());
-            embIndices.push_back(hyp->GetWord());
-            beamCosts.push_back(hyp->GetCost());
+          for(size_t k = 0; k < localBeamSize; ++k) {
+            for(size_t b = 0; b < dimBatch; ++b) {
+              if(k < beams[b].size()) {
+                Hyp h = beams[b][k];
+                hypIndices.push_back(hyps->GetPrevStateIndex(h));
+                embIndices.push_back(hyps->GetWord(h));
+                beamCosts.push_back(hyps->GetCost(h));
+              }
+              else {
+                hypIndices.push_back(b);
+                embIndices.push_back(0);
+                beamCosts.push_back(std::numeric_limits<float>::lowest());
+              }
+            }
           }
-          prevCosts = graph->constant({1, 1, 1, (int)beamCosts.size()},
+          prevCosts = graph->constant({(int)dimBatch, 1, 1, (int)localBeamSize},
                                       keywords::init=inits::from_vector(beamCosts));
         }
 
@@ -127,13 +243,36 @@ class BeamSearch {
         // prepare costs for beam search
         auto totalCosts = prevCosts;
 
+        // scorers with graphs of their own step concurrently
+        std::vector<std::future<Ptr<ScorerState>>> nextStates;
+        for(int i = 0; i < scorers_.size(); ++i)
+          nextStates.push_back(scorers_[i]->stepAsync(graph, states[i],
+                                                      hypIndices, embIndices));
+
         for(int i = 0; i < scorers_.size(); ++i) {
-          states[i] = scorers_[i]->step(graph, states[i], hypIndices, embIndices);
+          states[i] = nextStates[i].get();
           totalCosts = totalCosts + scorers_[i]->getWeight() * states[i]->getProbs();
           //debug(states[i]->getProbs(), "p" + std::to_string(i));
           //debug(totalCosts, "total");
         }
 
+        // group the rows by sentence for NthElement
+        int dimTrgVoc = totalCosts->shape()[1];
+        UTIL_THROW_IF2(shortlist && dimTrgVoc != shortlist->indeces().size(),
+                       "This model type does not support shortlists");
+        auto costRow = [=](size_t i) {
+          return (i % dimBatch) * localBeamSize + i / dimBatch;
+        };
+
+        Expr costs = totalCosts;
+        if(dimBatch > 1 && localBeamSize > 1) {
+          std::vector<size_t> rowOrder(dimBatch * localBeamSize);
+          for(size_t i = 0; i < rowOrder.size(); ++i)
+            rowOrder[costRow(i)] = i;
+          costs = rows(reshape(totalCosts, {(int)rowOrder.size(), dimTrgVoc}),
+                       rowOrder);
+        }
+
         if(first)
           graph->forward();
         else
@@ -142,20 +281,19 @@ class BeamSearch {
         //**********************************************************************
         // suppress specific symbols if not at right positions
         if(!options_->get<bool>("allow-unk"))
-          suppressUnk(totalCosts);
+          suppressUnk(costs);
         for(auto state : states) {
           auto attState = std::dynamic_pointer_cast<DecoderStateHardAtt>(state);
           if(attState) {
             auto attentionIdx = attState->getAttentionIndices();
-            int dimVoc = totalCosts->shape()[1];
             for(int i = 0; i < attentionIdx.size(); i++) {
               if(batch->front()->indeces()[attentionIdx[i]] != 0) {
-                totalCosts->val()->set(i * dimVoc + EOS_ID,
-                                       std::numeric_limits<float>::lowest());
+                costs->val()->set(costRow(i) * dimTrgVoc + EOS_ID,
+                                  std::numeric_limits<float>::lowest());
               }
               else {
-                totalCosts->val()->set(i * dimVoc + STP_ID,
-                                       std::numeric_limits<float>::lowest());
+                costs->val()->set(costRow(i) * dimTrgVoc + STP_ID,
+                                  std::numeric_limits<float>::lowest());
               }
             }
           }
@@ -166,22 +304,41 @@ class BeamSearch {
         std::vector<unsigned> outKeys;
         std::vector<float> outCosts;
 
-        beamSizes[0] = first ? beamSize_ : beam.size();
-        nth->getNBestList(beamSizes, totalCosts->val(),
+        // a shortlist can have fewer words than the beam
+        size_t firstBeamSize = std::min(beamSize_, (size_t)dimTrgVoc);
+        std::vector<size_t> beamSizes(dimBatch, first ? firstBeamSize : localBeamSize);
+        nth->getNBestList(beamSizes, costs->val(),
                           outCosts, outKeys, first);
 
-        int dimTrgVoc = totalCosts->shape()[1];
-        beam = toHyps(outKeys, outCosts, dimTrgVoc, beam, states);
+        auto newBeams = toHyps(outKeys, outCosts, dimTrgVoc, beams, states,
+                               localBeamSize, first, *hyps, shortlist);
 
-        final = history->size() >= 3 * batch->words();
-        history->Add(beam, final);
-        beam = pruneBeam(beam);
+        done = true;
+        for(size_t b = 0; b < dimBatch; ++b) {
+          if(beams[b].empty())
+            continue;
+
+          bool final = histories[b]->size() >= maxLengths[b];
+          histories[b]->Add(newBeams[b], final);
+          beams[b] = final ? Beam() : pruneBeam(newBeams[b], *hyps);
+
+          if(final) {
+            histories[b]->SetStop(History::MaxLength);
+          }
+          else if(earlyStop && !beams[b].empty()
+                  && histories[b]->Decided(beams[b], stepCost, maxLengths[b])) {
+            histories[b]->SetStop(History::Bound);
+            beams[b].clear();
+          }
+
+          done = done && beams[b].empty();
+        }
 
         first = false;
 
-      } while(!beam.empty() && !final);
+      } while(!done);
 
-      return history;
+      return histories;
     }
 };
 
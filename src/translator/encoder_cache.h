@@ -0,0 +1,219 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "models/encdec.h"
+
+namespace marian {
+
+/**
+ * Encoder outputs of single source sentences, shared by the scorers of all
+ * devices. An entry is keyed on the scorer name and the source words and
+ * holds the context of the sentence, its mask is all ones. The least
+ * recently used entries are dropped when the entries exceed the byte budget.
+ *
+ * encode() computes the encoder only for the sentences of a batch that are
+ * not cached. Their contexts have values only after the forward pass, the
+ * scorer adds them with insert() once they are computed.
+ */
+class EncoderCache {
+  public:
+    /** Sentences of a batch computed by encode() and not yet cached */
+    struct Misses {
+      Expr context;
+      std::vector<std::string> keys;
+      std::vector<size_t> lengths;
+    };
+
+  private:
+    struct Entry {
+      std::string key;
+      std::vector<float> context;
+
+      size_t bytes() const {
+        return key.size() + context.size() * sizeof(float);
+      }
+    };
+
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    size_t bytes_{0};
+    size_t budget_;
+
+    size_t hits_{0};
+    size_t misses_{0};
+
+    std::mutex mutex_;
+
+    static std::string key(const std::string& name,
+                           Ptr<data::SubBatch> subBatch,
+                           size_t b,
+                           size_t& length) {
+      size_t dimBatch = subBatch->batchSize();
+      std::string key = name + '\0';
+      for(length = 0; length < subBatch->batchWidth(); ++length) {
+        size_t i = length * dimBatch + b;
+        if(!subBatch->mask()[i])
+          break;
+        key.append((const char*)&subBatch->indeces()[i], sizeof(Word));
+      }
+      return key;
+    }
+
+    /** The sentences ids of batch in a batch of their own, padded as before */
+    static Ptr<data::CorpusBatch> select(Ptr<data::CorpusBatch> batch,
+                                         const std::vector<size_t>& ids) {
+      std::vector<Ptr<data::SubBatch>> subBatches;
+      for(size_t j = 0; j < batch->sets(); ++j) {
+        auto from = (*batch)[j];
+        size_t dimBatch = from->batchSize();
+        auto to = New<data::SubBatch>(ids.size(), from->batchWidth());
+        size_t words = 0;
+        for(size_t t = 0; t < from->batchWidth(); ++t) {
+          for(size_t i = 0; i < ids.size(); ++i) {
+            to->indeces()[t * ids.size() + i] = from->indeces()[t * dimBatch + ids[i]];
+            to->mask()[t * ids.size() + i] = from->mask()[t * dimBatch + ids[i]];
+            words += to->mask()[t * ids.size() + i];
+          }
+        }
+        to->setWords(words);
+        subBatches.push_back(to);
+      }
+      return New<data::CorpusBatch>(subBatches);
+    }
+
+  public:
+    /** A cache of at most budget bytes */
+    EncoderCache(size_t budget) : budget_(budget) {}
+
+    /**
+     * The encoder state of sub-batch index of batch. Cached contexts are
+     * copied into a constant, the other sentences are encoded as a smaller
+     * batch of the same width, and the rows of both are interleaved in batch
+     * order. The encoded sentences are returned in misses.
+     */
+    Ptr<EncoderState> encode(Ptr<ExpressionGraph> graph,
+                             Ptr<EncoderBase> encoder,
+                             Ptr<data::CorpusBatch> batch,
+                             size_t index,
+                             const std::string& name,
+                             Misses& misses) {
+      using namespace keywords;
+
+      auto subBatch = (*batch)[index];
+      int dimBatch = subBatch->batchSize();
+      int dimWords = subBatch->batchWidth();
+
+      // contexts are copied out, the entries may be dropped meanwhile
+      std::vector<size_t> hitIds, missIds;
+      std::vector<std::vector<float>> hitContexts;
+      std::vector<size_t> hitLengths;
+      misses = Misses();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(int b = 0; b < dimBatch; ++b) {
+          size_t length;
+          auto k = key(name, subBatch, b, length);
+          auto it = index_.find(k);
+          if(it != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            hitIds.push_back(b);
+            hitContexts.push_back(it->second->context);
+            hitLengths.push_back(length);
+          }
+          else {
+            missIds.push_back(b);
+            misses.keys.push_back(k);
+            misses.lengths.push_back(length);
+          }
+        }
+        hits_ += hitIds.size();
+        misses_ += missIds.size();
+      }
+
+      if(hitIds.empty()) {
+        auto state = encoder->build(graph, batch, index);
+        misses.context = state->getContext();
+        return state;
+      }
+
+      // cached contexts as rows t * hits + h of a matrix, zero when padded
+      int dimHits = hitIds.size();
+      int dimContext = hitContexts.front().size() / hitLengths.front();
+      std::vector<float> values(dimHits * dimWords * dimContext, 0.f);
+      for(int h = 0; h < dimHits; ++h)
+        for(size_t t = 0; t < hitLengths[h]; ++t)
+          std::copy(hitContexts[h].begin() + t * dimContext,
+                    hitContexts[h].begin() + (t + 1) * dimContext,
+                    values.begin() + (t * dimHits + h) * dimContext);
+      auto context = graph->constant({dimHits * dimWords, dimContext},
+                                     init=inits::from_vector(values));
+
+      if(!missIds.empty()) {
+        int dimMisses = missIds.size();
+        misses.context = encoder->build(graph, select(batch, missIds), index)->getContext();
+        context = concatenate({reshape(misses.context, {dimMisses * dimWords, dimContext}),
+                               context},
+                              axis=0);
+
+        // row t * batch + b of the context from the misses or the hits
+        std::vector<size_t> order(dimBatch * dimWords);
+        for(int t = 0; t < dimWords; ++t) {
+          for(int i = 0; i < dimMisses; ++i)
+            order[t * dimBatch + missIds[i]] = t * dimMisses + i;
+          for(int h = 0; h < dimHits; ++h)
+            order[t * dimBatch + hitIds[h]] = dimMisses * dimWords + t * dimHits + h;
+        }
+        context = rows(context, order);
+      }
+
+      auto mask = graph->constant({dimBatch, 1, dimWords},
+                                  init=inits::from_vector(subBatch->mask()));
+      return encoder->fromContext(reshape(context, {dimBatch, dimContext, dimWords}),
+                                  mask, batch);
+    }
+
+    /** Adds the contexts of misses, after the forward pass computed them */
+    void insert(Misses& misses) {
+      if(!misses.context || !misses.context->val())
+        return;
+
+      std::vector<float> values;
+      misses.context->val()->get(values);
+      auto shape = misses.context->shape();
+      size_t dimBatch = shape[0], dimContext = shape[1];
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      for(size_t i = 0; i < misses.keys.size(); ++i) {
+        if(index_.count(misses.keys[i]))
+          continue;
+
+        Entry entry{misses.keys[i], {}};
+        for(size_t t = 0; t < misses.lengths[i]; ++t) {
+          auto from = values.begin() + (t * dimBatch + i) * dimContext;
+          entry.context.insert(entry.context.end(), from, from + dimContext);
+        }
+        if(entry.bytes() > budget_)
+          continue;
+
+        bytes_ += entry.bytes();
+        entries_.push_front(std::move(entry));
+        index_[entries_.front().key] = entries_.begin();
+
+        while(bytes_ > budget_) {
+          bytes_ -= entries_.back().bytes();
+          index_.erase(entries_.back().key);
+          entries_.pop_back();
+        }
+      }
+      misses = Misses();
+    }
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t bytes() const { return bytes_; }
+};
+
+}
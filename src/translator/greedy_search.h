@@ -0,0 +1,142 @@
+#pragma once
+
+#include "marian.h"
+#include "translator/helpers.h"
+#include "translator/history.h"
+#include "translator/scorers.h"
+
+namespace marian {
+
+/**
+ * Search with beam size 1. Each step picks the best word of every sentence
+ * with one Argmax over the costs and copies only the word indices to the
+ * host, instead of selecting the n best costs. With a single scorer the
+ * costs are its unnormalized scores, which have the same argmax as the
+ * log-probabilities, so no softmax is computed. The words are collected
+ * per sentence; the hypotheses and histories are built once at the end,
+ * their costs are 0.
+ *
+ * Finished sentences stay in the batch, fed with the end of sentence, so
+ * the decoder states keep their shapes. Sentences end at the end of
+ * sentence or at max-length-factor times their source length.
+ */
+class GreedySearch {
+  private:
+    Ptr<Config> options_;
+    std::vector<Ptr<Scorer>> scorers_;
+
+  public:
+    template <class ...Args>
+    GreedySearch(Ptr<Config> options,
+                 const std::vector<Ptr<Scorer>>& scorers,
+                 Args ...args)
+     : options_(options),
+       scorers_(scorers)
+    {}
+
+    Histories search(Ptr<ExpressionGraph> graph,
+                     Ptr<data::CorpusBatch> batch,
+                     Ptr<FilterInfo> shortlist = nullptr) {
+      using namespace keywords;
+
+      size_t dimBatch = batch->size();
+      auto sentenceIds = batch->getSentenceIds();
+
+      float factor = options_->get<float>("max-length-factor");
+      std::vector<float> srcLengths(dimBatch, 0);
+      auto srcBatch = batch->front();
+      for(size_t i = 0; i < srcBatch->mask().size(); ++i)
+        srcLengths[i % dimBatch] += srcBatch->mask()[i];
+      std::vector<size_t> maxLengths;
+      for(auto length : srcLengths)
+        maxLengths.push_back(std::max<size_t>(1, factor * length));
+
+      // argmax of the scores is argmax of the log-probabilities for one scorer
+      bool scores = scorers_.size() == 1 && scorers_[0]->getWeight() > 0;
+
+      for(auto scorer : scorers_) {
+        scorer->clear(graph);
+        if(shortlist)
+          scorer->setShortlist(shortlist);
+      }
+
+      std::vector<Ptr<ScorerState>> states;
+      for(auto scorer : scorers_)
+        states.push_back(scorer->startState(graph, batch));
+
+      std::vector<Words> words(dimBatch);
+      std::vector<bool> finished(dimBatch, false);
+      std::vector<size_t> embIndices;
+      std::vector<float> best;
+      size_t live = dimBatch;
+
+      for(bool first = true; live > 0; first = false) {
+        std::vector<std::future<Ptr<ScorerState>>> nextStates;
+        if(!scores)
+          for(size_t i = 0; i < scorers_.size(); ++i)
+            nextStates.push_back(scorers_[i]->stepAsync(graph, states[i], {}, embIndices));
+
+        Expr costs;
+        for(size_t i = 0; i < scorers_.size(); ++i) {
+          states[i] = scores ?
+            scorers_[i]->stepScores(graph, states[i], {}, embIndices) :
+            nextStates[i].get();
+          auto weighted = scorers_[i]->getWeight() * states[i]->getProbs();
+          costs = costs ? costs + weighted : weighted;
+        }
+
+        int dimTrgVoc = costs->shape()[1];
+        UTIL_THROW_IF2(shortlist && dimTrgVoc != shortlist->indeces().size(),
+                       "This model type does not support shortlists");
+
+        auto bestWords = graph->constant({(int)dimBatch, 1}, init=inits::zeros);
+
+        if(first)
+          graph->forward();
+        else
+          graph->forwardNext();
+
+        if(!options_->get<bool>("allow-unk"))
+          suppressUnk(costs);
+
+        Argmax(bestWords->val(), costs->val());
+        bestWords->val()->get(best);
+
+        embIndices.clear();
+        for(size_t b = 0; b < dimBatch; ++b) {
+          // costs are over the shortlist, words are vocabulary ids
+          size_t word = shortlist ? shortlist->reverseMap(best[b]) : best[b];
+          if(!finished[b]) {
+            words[b].push_back(word);
+            if(word == 0 || words[b].size() >= maxLengths[b]) {
+              finished[b] = true;
+              live--;
+            }
+          }
+          embIndices.push_back(finished[b] ? 0 : word);
+        }
+      }
+
+      // one chain of hypotheses per sentence, the last one is the result
+      auto hyps = New<Hypotheses>();
+      Histories histories;
+      for(size_t b = 0; b < dimBatch; ++b) {
+        size_t lineNo = b < sentenceIds.size() ? sentenceIds[b] : b;
+        auto history = New<History>(lineNo, hyps, options_->get<bool>("normalize"));
+
+        Hyp hyp = Hypotheses::START;
+        history->Add(Beam(1, hyp));
+        for(size_t i = 0; i < words[b].size(); ++i) {
+          hyp = hyps->add(hyp, words[b][i], b, 0.f);
+          history->Add(Beam(1, hyp), i + 1 == words[b].size());
+        }
+        if(words[b].back() != 0)
+          history->SetStop(History::MaxLength);
+
+        histories.push_back(history);
+      }
+      return histories;
+    }
+};
+
+}
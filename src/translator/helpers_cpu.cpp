@@ -0,0 +1,26 @@
+#include <limits>
+
+#include "translator/helpers.h"
+#include "tensors/tensor.h"
+#include "data/types.h"
+
+namespace marian {
+
+void SetColumn(Tensor in, size_t col, float value) {
+  int nRows = in->shape()[0] * in->shape()[2] * in->shape()[3];
+  int nColumns = in->shape()[1];
+
+  float* data = in->data();
+  for(int rowNumber = 0; rowNumber < nRows; ++rowNumber)
+    data[col + rowNumber * nColumns] = value;
+}
+
+void suppressUnk(Expr probs) {
+  SetColumn(probs->val(), UNK_ID, std::numeric_limits<float>::lowest());
+}
+
+void suppressWord(Expr probs, Word id) {
+  SetColumn(probs->val(), id, std::numeric_limits<float>::lowest());
+}
+
+}
@@ -2,8 +2,9 @@
 
 namespace marian {
 
-History::History(size_t lineNo, bool normalize)
- : normalize_(normalize),
+History::History(size_t lineNo, Ptr<Hypotheses> hyps, bool normalize)
+ : hyps_(hyps),
+   normalize_(normalize),
    lineNo_(lineNo)
 {}
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <queue>
 
 #include "hypothesis.h"
@@ -13,27 +14,69 @@ class History {
         return cost < hc.cost;
       }
 
-      size_t i;
-      size_t j;
+      Hyp hyp;
       float cost;
     };
 
   public:
-    History(size_t lineNo, bool normalize=false);
+    /** Why the search of the sentence ended */
+    enum Stop { Finished, Bound, MaxLength };
 
+    History(size_t lineNo, Ptr<Hypotheses> hyps, bool normalize=false);
+
+    /**
+     * Adds the beam of the next step. Only finished hypotheses are kept
+     * here, the others are reachable from them through the arena.
+     */
     void Add(const Beam& beam, bool last = false) {
-      if (beam.back()->GetPrevHyp() != nullptr) {
+      if (beam.back() != Hypotheses::START) {
         for (size_t j = 0; j < beam.size(); ++j)
-          if(beam[j]->GetWord() == 0 || last) {
-            float cost = normalize_ ? beam[j]->GetCost() / history_.size() : beam[j]->GetCost();
-            topHyps_.push({ history_.size(), j, cost });
+          if(hyps_->GetWord(beam[j]) == 0 || last) {
+            float cost = normalize_ ? hyps_->GetCost(beam[j]) / steps_ : hyps_->GetCost(beam[j]);
+            topHyps_.push({ beam[j], cost });
           }
       }
-      history_.push_back(beam);
+      steps_++;
     }
 
     size_t size() const {
-      return history_.size();
+      return steps_;
+    }
+
+    /**
+     * Whether no hypothesis of the live beam can end better than the best
+     * finished one, if each further step adds at most stepCost and no
+     * translation gets longer than maxLength. A live hypothesis has
+     * size() - 1 words; its best final cost, normalized by length if
+     * requested, is reached at one of the two ends of the length range.
+     */
+    bool Decided(const Beam& beam, float stepCost, size_t maxLength) const {
+      if(topHyps_.empty())
+        return false;
+
+      float best = topHyps_.top().cost;
+      float length = steps_ - 1;
+      float maxLen = std::max<float>(maxLength, length + 1);
+      for(Hyp h : beam) {
+        float cost = hyps_->GetCost(h);
+        float shortest = cost + stepCost;
+        float longest = cost + (maxLen - length) * stepCost;
+        if(normalize_) {
+          shortest /= length + 1;
+          longest /= maxLen;
+        }
+        if(std::max(shortest, longest) >= best)
+          return false;
+      }
+      return true;
+    }
+
+    void SetStop(Stop stop) {
+      stop_ = stop;
+    }
+
+    Stop GetStop() const {
+      return stop_;
     }
 
     NBestList NBest(size_t n) const {
@@ -43,18 +86,15 @@ class History {
         auto bestHypCoord = topHypsCopy.top();
         topHypsCopy.pop();
 
-        size_t start = bestHypCoord.i;
-        size_t j  = bestHypCoord.j;
-
         Words targetWords;
-        Ptr<Hypothesis> bestHyp = history_[start][j];
-        while(bestHyp->GetPrevHyp() != nullptr) {
-          targetWords.push_back(bestHyp->GetWord());
-          bestHyp = bestHyp->GetPrevHyp();
+        Hyp bestHyp = bestHypCoord.hyp;
+        while(bestHyp != Hypotheses::START) {
+          targetWords.push_back(hyps_->GetWord(bestHyp));
+          bestHyp = hyps_->GetPrevHyp(bestHyp);
         }
 
         std::reverse(targetWords.begin(), targetWords.end());
-        nbest.emplace_back(targetWords, history_[bestHypCoord.i][bestHypCoord.j]);
+        nbest.emplace_back(targetWords, bestHypCoord.hyp);
       }
       return nbest;
     }
@@ -66,14 +106,20 @@ class History {
     size_t GetLineNum() const
     { return lineNo_; }
 
+    /** The arena that holds the hypotheses of the results */
+    Ptr<Hypotheses> GetHypotheses() const
+    { return hyps_; }
+
   private:
-    std::vector<Beam> history_;
+    Ptr<Hypotheses> hyps_;
+    size_t steps_{0};
+    Stop stop_{Finished};
     std::priority_queue<HypothesisCoord> topHyps_;
     bool normalize_;
     size_t lineNo_;
 
 };
 
-typedef std::vector<History> Histories;
+typedef std::vector<Ptr<History>> Histories;
 
 }
@@ -1,59 +1,98 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 #include "common/definitions.h"
 
 namespace marian {
 
-class Hypothesis {
+/** Position of a hypothesis in its Hypotheses arena */
+typedef uint32_t Hyp;
+
+/**
+ * The hypotheses of a search, stored as plain arrays. A hypothesis refers
+ * to its predecessor by position, so the search trees of all sentences of a
+ * batch live in a few vectors and are released together with the arena,
+ * i.e. when the last History of the batch is gone.
+ *
+ * Position 0 is the empty start hypothesis shared by all sentences.
+ */
+class Hypotheses {
+  private:
+    std::vector<Hyp> prevHyps_;
+    std::vector<uint32_t> words_;
+    std::vector<uint32_t> prevStateIndices_;
+    std::vector<float> costs_;
+
+    // breakdownSize_ costs per hypothesis if cost breakdowns are kept
+    size_t breakdownSize_;
+    std::vector<float> breakdowns_;
+
   public:
-    Hypothesis()
-     : prevHyp_(nullptr),
-       prevIndex_(0),
-       word_(0),
-       cost_(0.0)
-    {}
+    static const Hyp START = 0;
 
-    Hypothesis(const Ptr<Hypothesis> prevHyp, size_t word, size_t prevIndex, float cost)
-      : prevHyp_(prevHyp),
-        prevIndex_(prevIndex),
-        word_(word),
-        cost_(cost)
-    {}
+    Hypotheses(size_t breakdownSize = 0)
+      : breakdownSize_(breakdownSize) {
+      add(START, 0, 0, 0.f);
+    }
 
-    const Ptr<Hypothesis> GetPrevHyp() const {
-      return prevHyp_;
+    /** Appends a hypothesis, its breakdown is zero */
+    Hyp add(Hyp prevHyp, size_t word, size_t prevStateIndex, float cost) {
+      prevHyps_.push_back(prevHyp);
+      words_.push_back(word);
+      prevStateIndices_.push_back(prevStateIndex);
+      costs_.push_back(cost);
+      breakdowns_.resize(breakdowns_.size() + breakdownSize_, 0.f);
+      return prevHyps_.size() - 1;
     }
 
-    size_t GetWord() const {
-      return word_;
+    void reserve(size_t n) {
+      prevHyps_.reserve(n);
+      words_.reserve(n);
+      prevStateIndices_.reserve(n);
+      costs_.reserve(n);
+      breakdowns_.reserve(n * breakdownSize_);
     }
 
-    size_t GetPrevStateIndex() const {
-      return prevIndex_;
+    size_t size() const {
+      return prevHyps_.size();
     }
 
-    float GetCost() const {
-      return cost_;
+    Hyp GetPrevHyp(Hyp h) const {
+      return prevHyps_[h];
     }
 
-    std::vector<float>& GetCostBreakdown() {
-      return costBreakdown_;
+    size_t GetWord(Hyp h) const {
+      return words_[h];
     }
 
-  private:
-    const Ptr<Hypothesis> prevHyp_;
-    const size_t prevIndex_;
-    const size_t word_;
-    const float cost_;
-    
-    std::vector<float> costBreakdown_;
+    size_t GetPrevStateIndex(Hyp h) const {
+      return prevStateIndices_[h];
+    }
+
+    float GetCost(Hyp h) const {
+      return costs_[h];
+    }
+
+    /** Number of scorer costs per hypothesis, 0 if breakdowns are not kept */
+    size_t GetCostBreakdownSize() const {
+      return breakdownSize_;
+    }
+
+    float* GetCostBreakdown(Hyp h) {
+      return breakdowns_.data() + h * breakdownSize_;
+    }
+
+    const float* GetCostBreakdown(Hyp h) const {
+      return breakdowns_.data() + h * breakdownSize_;
+    }
 };
 
-typedef std::vector<Ptr<Hypothesis>> Beam;
+typedef std::vector<Hyp> Beam;
 typedef std::vector<Beam> Beams;
 typedef std::vector<size_t> Words;
-typedef std::pair<Words, Ptr<Hypothesis>> Result;
+typedef std::pair<Words, Hyp> Result;
 typedef std::vector<Result> NBestList;
 
 }
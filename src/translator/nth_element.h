@@ -3,7 +3,7 @@
 #include <vector>
 #include <algorithm>
 
-#include <cuda.h>
+#include "kernels/backend.h"
 #include "tensors/tensor.h"
 
 namespace marian {
@@ -0,0 +1,154 @@
+#include <algorithm>
+
+#include "kernels/simd_cpu.h"
+#include "translator/nth_element.h"
+
+namespace marian {
+
+namespace {
+
+// The n best entries of a batch found so far, best first. Entries compare by
+// cost and then by position: the scan visits positions in increasing order,
+// so an entry only enters when it is strictly better than the current worst.
+struct Selection {
+  float* costs;
+  int* keys;
+  int n;
+  int size;
+
+  float worst() const {
+    return costs[n - 1];
+  }
+
+  void insert(float cost, int key) {
+    int i = size < n ? size++ : n - 1;
+    for(; i > 0 && cost > costs[i - 1]; --i) {
+      costs[i] = costs[i - 1];
+      keys[i] = keys[i - 1];
+    }
+    costs[i] = cost;
+    keys[i] = key;
+  }
+};
+
+// Scans blocks of 4 * W costs. A block is only looked at element by element
+// if one of its costs beats the worst selected entry, which after the first
+// few blocks is rarely the case for a distribution over the vocabulary.
+template <int W>
+MARIAN_SIMD_INLINE void selectNBest(const float* probs, int begin, int end,
+                                    Selection& selection) {
+  typedef cpu::Simd<W> S;
+  const int BLOCK = 4 * W;
+
+  int i = begin;
+  for(; i < end && selection.size < selection.n; ++i)
+    selection.insert(probs[i], i);
+
+  for(; i + BLOCK <= end; i += BLOCK) {
+    const float* p = probs + i;
+    auto m = S::max(S::max(S::load(p), S::load(p + W)),
+                    S::max(S::load(p + 2 * W), S::load(p + 3 * W)));
+    if(!S::any(m > selection.worst()))
+      continue;
+
+    for(int j = 0; j < BLOCK; ++j)
+      if(p[j] > selection.worst())
+        selection.insert(p[j], i + j);
+  }
+
+  for(; i < end; ++i)
+    if(probs[i] > selection.worst())
+      selection.insert(probs[i], i);
+}
+
+#define SELECT_ARGS const float* probs, int begin, int end, Selection& selection
+#define SELECT_PARAMS probs, begin, end, selection
+
+void selectNBestGeneric(SELECT_ARGS) {
+  selectNBest<4>(SELECT_PARAMS);
+}
+
+MARIAN_TARGET_AVX2 void selectNBestAvx2(SELECT_ARGS) {
+  selectNBest<8>(SELECT_PARAMS);
+}
+
+MARIAN_TARGET_AVX512 void selectNBestAvx512(SELECT_ARGS) {
+  selectNBest<16>(SELECT_PARAMS);
+}
+
+}
+
+NthElement::NthElement(size_t maxBeamSize, size_t maxBatchSize, cudaStream_t stream)
+    : NUM_BLOCKS(0),
+      stream_(stream),
+      d_ind(0), d_out(0), d_res_idx(0), d_res(0),
+      d_breakdown(0), d_batchPosition(0), d_cumBeamSizes(0),
+      lastN(0)
+{
+  h_res = new float[maxBeamSize * maxBatchSize];
+  h_res_idx = new int[maxBeamSize * maxBatchSize];
+}
+
+NthElement::~NthElement()
+{
+  delete[] h_res;
+  delete[] h_res_idx;
+}
+
+void NthElement::getNBestList(float* probs, const std::vector<int>& batchFirstElementIdxs,
+                              const std::vector<int>& cummulatedBeamSizes)
+{
+  const int numBatches = batchFirstElementIdxs.size() - 1;
+
+  for(int batchIdx = 0; batchIdx < numBatches; ++batchIdx) {
+    int begin = batchFirstElementIdxs[batchIdx];
+    int end = batchFirstElementIdxs[batchIdx + 1];
+    int pos = cummulatedBeamSizes[batchIdx];
+    int n = std::min(cummulatedBeamSizes[batchIdx + 1] - pos, end - begin);
+    if(n <= 0)
+      continue;
+
+    Selection selection{h_res + pos, h_res_idx + pos, n, 0};
+    const float* in = probs;
+    switch(cpu::isa()) {
+      case cpu::Isa::Avx512: selectNBestAvx512(in, begin, end, selection); break;
+      case cpu::Isa::Avx2:   selectNBestAvx2(in, begin, end, selection); break;
+      default:               selectNBestGeneric(in, begin, end, selection); break;
+    }
+  }
+}
+
+void NthElement::getNBestList(const std::vector<size_t>& beamSizes, Tensor Probs,
+                  std::vector<float>& outCosts, std::vector<unsigned>& outKeys,
+                  const bool isFirst) {
+  std::vector<int> cummulatedBeamSizes(beamSizes.size() + 1, 0);
+  std::vector<int> batchFirstElementIdxs(beamSizes.size() + 1, 0);
+
+  const size_t vocabSize = Probs->shape()[1];
+  for (size_t i = 0; i < beamSizes.size(); ++i) {
+
+    cummulatedBeamSizes[i + 1] = cummulatedBeamSizes[i] + beamSizes[i];
+    batchFirstElementIdxs[i + 1] += ((isFirst) ? (i + 1) : cummulatedBeamSizes[i + 1]) * vocabSize;
+  }
+
+  getNBestList(Probs->data(), batchFirstElementIdxs, cummulatedBeamSizes);
+  GetPairs(cummulatedBeamSizes.back(), outKeys, outCosts);
+}
+
+void NthElement::GetPairs(size_t number,
+                    std::vector<unsigned>& outKeys,
+                    std::vector<float>& outValues) {
+  for (size_t i = 0; i < number; ++i) {
+    outKeys.push_back(h_res_idx[i]);
+    outValues.push_back(h_res[i]);
+  }
+
+  lastN = number;
+}
+
+void NthElement::getValueByKey(std::vector<float>& out, float* d_in) {
+  for (size_t i = 0; i < lastN; ++i)
+    out[i] = d_in[h_res_idx[i]];
+}
+
+}
@@ -16,30 +16,31 @@ void Printer(Ptr<Config> options,
   if(options->has("n-best") && options->get<bool>("n-best")) {
     const auto &nbl = history->NBest(options->get<size_t>("beam-size"));
     
+    auto hyps = history->GetHypotheses();
     for (size_t i = 0; i < nbl.size(); ++i) {
       const auto& result = nbl[i];
       const auto& words = result.first;
-      const auto& hypo = result.second;
+      Hyp hypo = result.second;
 
       std::string translation = Join((*vocab)(words));
       
       out << history->GetLineNum() << " ||| " << translation << " |||";
       
-      if(hypo->GetCostBreakdown().empty()) {
-        out << " F0=" << hypo->GetCost();  
+      if(hyps->GetCostBreakdownSize() == 0) {
+        out << " F0=" << hyps->GetCost(hypo);  
       }
       else {
-        for(size_t j = 0; j < hypo->GetCostBreakdown().size(); ++j) {
-          out << " F" << j << "= " << hypo->GetCostBreakdown()[j];
+        for(size_t j = 0; j < hyps->GetCostBreakdownSize(); ++j) {
+          out << " F" << j << "= " << hyps->GetCostBreakdown(hypo)[j];
         }
       }
       
       
       if(options->get<bool>("normalize")) {
-        out << " ||| " << hypo->GetCost() / words.size();
+        out << " ||| " << hyps->GetCost(hypo) / words.size();
       }
       else {
-        out << " ||| " << hypo->GetCost();
+        out << " ||| " << hyps->GetCost(hypo);
       }
       
       if(i < nbl.size() - 1)
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <future>
+
 #include "marian.h"
+#include "3rd_party/threadpool.h"
+#include "translator/encoder_cache.h"
 
 namespace marian {
 
@@ -8,8 +12,10 @@ class ScorerState {
   public:
     virtual Expr getProbs() = 0;
 
-    virtual float breakDown(size_t i) {
-      return getProbs()->val()->get(i);
+    /** The costs at positions indices of getProbs(), gathered in one copy */
+    virtual void breakDown(const std::vector<size_t>& indices,
+                           std::vector<float>& costs) {
+      getProbs()->val()->getSparse(indices, costs);
     }
 };
 
@@ -32,7 +38,42 @@ class Scorer {
                                   const std::vector<size_t>&,
                                   const std::vector<size_t>&) = 0;
 
+    /**
+     * Like step(), but the costs may be unnormalized scores in the same
+     * order, e.g. logits instead of log-probabilities.
+     */
+    virtual Ptr<ScorerState> stepScores(Ptr<ExpressionGraph> graph,
+                                        Ptr<ScorerState> state,
+                                        const std::vector<size_t>& hypIndices,
+                                        const std::vector<size_t>& embIndices) {
+      return step(graph, state, hypIndices, embIndices);
+    }
+
+    /**
+     * Starts step(), its state is taken from the future. Scorers on graphs
+     * of their own step on their own threads, the others step right away,
+     * so the states are always taken in scorer order.
+     */
+    virtual std::future<Ptr<ScorerState>> stepAsync(Ptr<ExpressionGraph> graph,
+                                                    Ptr<ScorerState> state,
+                                                    const std::vector<size_t>& hypIndices,
+                                                    const std::vector<size_t>& embIndices) {
+      std::promise<Ptr<ScorerState>> next;
+      next.set_value(step(graph, state, hypIndices, embIndices));
+      return next.get_future();
+    }
+
     virtual void init(Ptr<ExpressionGraph> graph) {}
+
+    /** Restricts the output to a shortlist until the next clear() */
+    virtual void setShortlist(Ptr<FilterInfo> shortlist) {}
+
+    /** Takes encoder outputs from the cache and adds new ones to it */
+    virtual void setEncoderCache(Ptr<EncoderCache> cache) {}
+
+    /** Range of the cost a step adds to a hypothesis, log-probabilities by default */
+    virtual float minStepCost() { return -std::numeric_limits<float>::infinity(); }
+    virtual float maxStepCost() { return 0.f; }
 };
 
 class ScorerWrapperState : public ScorerState {
@@ -57,6 +98,10 @@ class ScorerWrapper : public Scorer {
   private:
     Ptr<EncoderDecoder> encdec_;
     std::string fname_;
+    size_t batchIndex_;
+
+    Ptr<EncoderCache> cache_;
+    EncoderCache::Misses misses_;
 
   public:
     template <class ...Args>
@@ -66,7 +111,8 @@ class ScorerWrapper : public Scorer {
     : Scorer(name, weight),
       encdec_(New<EncoderDecoder>(options, std::vector<size_t>({0, 1}),
                                   keywords::inference=true, args...)),
-      fname_(fname)
+      fname_(fname),
+      batchIndex_(0)
     {}
 
     template <class ...Args>
@@ -78,7 +124,8 @@ class ScorerWrapper : public Scorer {
     : Scorer(name, weight),
       encdec_(New<EncoderDecoder>(options, batchIndices,
                                   keywords::inference=true, args...)),
-      fname_(fname)
+      fname_(fname),
+      batchIndex_(batchIndices.front())
     {}
 
     virtual void init(Ptr<ExpressionGraph> graph) {
@@ -87,40 +134,205 @@ class ScorerWrapper : public Scorer {
     }
 
     virtual void clear(Ptr<ExpressionGraph> graph) {
+      if(cache_)
+        cache_->insert(misses_);
       graph->switchParams(getName());
       encdec_->clear(graph);
     }
 
+    virtual void setShortlist(Ptr<FilterInfo> shortlist) {
+      encdec_->getDecoder()->setShortlist(shortlist);
+    }
+
+    virtual void setEncoderCache(Ptr<EncoderCache> cache) {
+      cache_ = cache;
+    }
+
     virtual Ptr<ScorerState> startState(Ptr<ExpressionGraph> graph,
                                         Ptr<data::CorpusBatch> batch) {
       graph->switchParams(getName());
-      return New<ScorerWrapperState>(encdec_->startState(graph, batch));
+      if(!cache_)
+        return New<ScorerWrapperState>(encdec_->startState(graph, batch));
+
+      auto encState = cache_->encode(graph, encdec_->getEncoder(), batch,
+                                     batchIndex_, getName(), misses_);
+      return New<ScorerWrapperState>(encdec_->getDecoder()->startState(encState));
     }
 
     virtual Ptr<ScorerState> step(Ptr<ExpressionGraph> graph,
                                   Ptr<ScorerState> state,
                                   const std::vector<size_t>& hypIndices,
                                   const std::vector<size_t>& embIndices) {
+      return step(graph, state, hypIndices, embIndices, true);
+    }
+
+    virtual Ptr<ScorerState> stepScores(Ptr<ExpressionGraph> graph,
+                                        Ptr<ScorerState> state,
+                                        const std::vector<size_t>& hypIndices,
+                                        const std::vector<size_t>& embIndices) {
+      return step(graph, state, hypIndices, embIndices, false);
+    }
+
+  private:
+    Ptr<ScorerState> step(Ptr<ExpressionGraph> graph,
+                          Ptr<ScorerState> state,
+                          const std::vector<size_t>& hypIndices,
+                          const std::vector<size_t>& embIndices,
+                          bool normalize) {
+      // the encoder outputs are computed by the first forward pass
+      if(cache_)
+        cache_->insert(misses_);
+
       graph->switchParams(getName());
       auto wrappedState = std::dynamic_pointer_cast<ScorerWrapperState>(state)->getState();
-      return New<ScorerWrapperState>(encdec_->step(graph, wrappedState, hypIndices, embIndices));
+      return New<ScorerWrapperState>(encdec_->step(graph, wrappedState,
+                                                   hypIndices, embIndices,
+                                                   normalize));
+    }
+};
+
+class ConcurrentScorerState : public ScorerState {
+  private:
+    Ptr<ScorerState> state_;
+    Ptr<ExpressionGraph> graph_;
+    Expr probs_;
+
+  public:
+    ConcurrentScorerState(Ptr<ScorerState> state, Ptr<ExpressionGraph> graph)
+    : state_(state), graph_(graph) {}
+
+    Ptr<ScorerState> getState() { return state_; }
+
+    /**
+     * The costs of the wrapped state as a constant of the search graph,
+     * copied when the search graph runs forward. The wrapped state has been
+     * computed by then, and stays valid until the next step.
+     */
+    virtual Expr getProbs() {
+      if(!probs_) {
+        auto probs = state_->getProbs();
+        probs_ = graph_->constant(probs->shape(),
+                                  keywords::init=inits::from_tensor(probs->val()));
+      }
+      return probs_;
+    }
+};
+
+/**
+ * Runs a scorer on a graph and a thread of its own, on the device of the
+ * search graph. Its steps are built and computed on its thread, so the
+ * models of an ensemble decode concurrently; the search graph only sums
+ * their costs. The search graph is never touched by the thread, the costs
+ * are copied into it by ConcurrentScorerState.
+ */
+class ConcurrentScorer : public Scorer {
+  private:
+    Ptr<Scorer> scorer_;
+    size_t workspace_;
+
+    Ptr<ExpressionGraph> graph_;
+    Ptr<ThreadPool> thread_;
+    bool first_{true};
+
+    std::future<Ptr<ScorerState>> run(Ptr<ExpressionGraph> graph,
+                                      Ptr<ScorerState> state,
+                                      const std::vector<size_t>& hypIndices,
+                                      const std::vector<size_t>& embIndices,
+                                      bool normalize) {
+      auto wrapped = std::dynamic_pointer_cast<ConcurrentScorerState>(state)->getState();
+      bool first = first_;
+      first_ = false;
+
+      auto task = [=]() -> Ptr<ScorerState> {
+        cudaSetDevice(graph_->getDevice());
+        auto next = normalize ?
+          scorer_->step(graph_, wrapped, hypIndices, embIndices) :
+          scorer_->stepScores(graph_, wrapped, hypIndices, embIndices);
+        if(first)
+          graph_->forward();
+        else
+          graph_->forwardNext();
+        return New<ConcurrentScorerState>(next, graph);
+      };
+      return thread_->enqueue(task);
+    }
+
+  public:
+    ConcurrentScorer(Ptr<Scorer> scorer, Ptr<Config> options)
+    : Scorer(scorer->getName(), scorer->getWeight()),
+      scorer_(scorer),
+      workspace_(options->get<size_t>("workspace")),
+      thread_(New<ThreadPool>(1)) {}
+
+    virtual void init(Ptr<ExpressionGraph> graph) {
+      graph_ = New<ExpressionGraph>(true);
+      graph_->setDevice(graph->getDevice());
+      graph_->reserveWorkspaceMB(workspace_);
+      scorer_->init(graph_);
+    }
+
+    virtual void clear(Ptr<ExpressionGraph> graph) {
+      scorer_->clear(graph_);
+      first_ = true;
+    }
+
+    virtual Ptr<ScorerState> startState(Ptr<ExpressionGraph> graph,
+                                        Ptr<data::CorpusBatch> batch) {
+      return New<ConcurrentScorerState>(scorer_->startState(graph_, batch), graph);
+    }
+
+    virtual std::future<Ptr<ScorerState>> stepAsync(Ptr<ExpressionGraph> graph,
+                                                    Ptr<ScorerState> state,
+                                                    const std::vector<size_t>& hypIndices,
+                                                    const std::vector<size_t>& embIndices) {
+      return run(graph, state, hypIndices, embIndices, true);
+    }
+
+    virtual Ptr<ScorerState> step(Ptr<ExpressionGraph> graph,
+                                  Ptr<ScorerState> state,
+                                  const std::vector<size_t>& hypIndices,
+                                  const std::vector<size_t>& embIndices) {
+      return run(graph, state, hypIndices, embIndices, true).get();
     }
+
+    virtual Ptr<ScorerState> stepScores(Ptr<ExpressionGraph> graph,
+                                        Ptr<ScorerState> state,
+                                        const std::vector<size_t>& hypIndices,
+                                        const std::vector<size_t>& embIndices) {
+      return run(graph, state, hypIndices, embIndices, false).get();
+    }
+
+    virtual void setShortlist(Ptr<FilterInfo> shortlist) {
+      scorer_->setShortlist(shortlist);
+    }
+
+    virtual void setEncoderCache(Ptr<EncoderCache> cache) {
+      scorer_->setEncoderCache(cache);
+    }
+
+    virtual float minStepCost() { return scorer_->minStepCost(); }
+    virtual float maxStepCost() { return scorer_->maxStepCost(); }
 };
 
 class WordPenaltyState : public ScorerState {
   private:
-    int dimVocab_;
+    int size_;
     Expr penalties_;
 
   public:
-    WordPenaltyState(int dimVocab, Expr penalties)
-    : dimVocab_(dimVocab), penalties_(penalties)
+    // penalties are broadcast over the beam, size is their number of elements
+    WordPenaltyState(int size, Expr penalties)
+    : size_(size), penalties_(penalties)
     {}
 
     virtual Expr getProbs() { return penalties_; };
 
-    virtual float breakDown(size_t i) {
-      return getProbs()->val()->get(i % dimVocab_);
+    virtual void breakDown(const std::vector<size_t>& indices,
+                           std::vector<float>& costs) {
+      std::vector<size_t> broadcast;
+      for(auto i : indices)
+        broadcast.push_back(i % size_);
+      getProbs()->val()->getSparse(broadcast, costs);
     }
 };
 
@@ -135,6 +347,9 @@ class WordPenalty : public Scorer {
 
     virtual void clear(Ptr<ExpressionGraph> graph) {}
 
+    virtual float minStepCost() { return 0.f; }
+    virtual float maxStepCost() { return 1.f; }
+
     virtual Ptr<ScorerState> startState(Ptr<ExpressionGraph> graph,
                                         Ptr<data::CorpusBatch> batch) {
       std::vector<float> p(dimVocab_, 1);
@@ -165,15 +380,23 @@ class UnseenWordPenalty : public Scorer {
 
     virtual void clear(Ptr<ExpressionGraph> graph) {}
 
+    virtual float minStepCost() { return -1.f; }
+    virtual float maxStepCost() { return 0.f; }
+
     virtual Ptr<ScorerState> startState(Ptr<ExpressionGraph> graph,
                                         Ptr<data::CorpusBatch> batch) {
-      std::vector<float> p(dimVocab_, -1);
-      for(auto i : (*batch)[batchIndex_]->indeces())
-        p[i] = 0;
-      p[2] = 0;
-
-      penalties_ = graph->constant({1, dimVocab_}, keywords::init=inits::from_vector(p));
-      return New<WordPenaltyState>(dimVocab_, penalties_);
+      // one row of penalties per sentence
+      auto subBatch = (*batch)[batchIndex_];
+      int dimBatch = subBatch->batchSize();
+
+      std::vector<float> p(dimBatch * dimVocab_, -1);
+      for(size_t i = 0; i < subBatch->indeces().size(); ++i)
+        p[(i % dimBatch) * dimVocab_ + subBatch->indeces()[i]] = 0;
+      for(int b = 0; b < dimBatch; ++b)
+        p[b * dimVocab_ + 2] = 0;
+
+      penalties_ = graph->constant({dimBatch, dimVocab_}, keywords::init=inits::from_vector(p));
+      return New<WordPenaltyState>(dimBatch * dimVocab_, penalties_);
     }
 
     virtual Ptr<ScorerState> step(Ptr<ExpressionGraph> graph,
@@ -231,11 +454,31 @@ createScorers(Ptr<Config> options) {
     weights = options->get<std::vector<float>>("weights");
 
   int i = 0;
+  int dimEnsembleVocab = 0;
   for(auto model : models) {
     std::string fname = "F" + std::to_string(i);
     auto modelOptions = New<Config>(*options);
     modelOptions->loadModelParameters(model);
-    scorers.push_back(scorerByType(fname, weights[i], model, modelOptions));
+
+    std::string type = modelOptions->get<std::string>("type");
+    UTIL_THROW_IF2(options->has("shortlist") && type != "s2s" && type != "amun",
+                   "Shortlists are not supported for models of type " << type);
+    UTIL_THROW_IF2(options->get<size_t>("encoder-cache") && type != "s2s"
+                   && type != "amun" && type != "hard-att" && type != "hard-soft-att",
+                   "The encoder cache is not supported for models of type " << type);
+
+    // the costs of all models are summed per target word
+    int dimModelVocab = modelOptions->get<std::vector<int>>("dim-vocabs").back();
+    if(i == 0)
+      dimEnsembleVocab = dimModelVocab;
+    UTIL_THROW_IF2(dimModelVocab != dimEnsembleVocab,
+                   "Target vocabulary of " << model << " has " << dimModelVocab
+                   << " words, of " << models.front() << " " << dimEnsembleVocab);
+
+    auto scorer = scorerByType(fname, weights[i], model, modelOptions);
+    if(options->get<bool>("parallel-scorers") && models.size() > 1)
+      scorer = New<ConcurrentScorer>(scorer, options);
+    scorers.push_back(scorer);
     i++;
   }
 
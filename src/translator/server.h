@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "translator/translator.h"
+
+namespace marian {
+
+namespace server {
+
+typedef std::chrono::steady_clock Clock;
+
+// set by SIGINT and SIGTERM, the server finishes the pending requests
+static std::atomic<bool> stop(false);
+
+inline void onSignal(int) {
+  stop = true;
+}
+
+}
+
+/**
+ * Keeps the models loaded and translates requests from a unix socket at the
+ * path given by --server. A client writes one source sentence per line and
+ * reads one translation per line, in the order of its requests. A client may
+ * send many lines before reading, and many clients may be connected.
+ *
+ * Requests of all clients are queued and cut into batches in arrival order.
+ * A batch holds at most mini-batch sentences and --server-batch-words source
+ * words, it is cut as soon as it is full or its first request has waited
+ * --server-max-wait milliseconds, and only when a device is free. While all
+ * devices are busy, requests keep queueing and the next batches get larger.
+ * The batches are translated by the thread pool with one worker per device,
+ * as in TranslateMultiGPU::run().
+ *
+ * SIGINT and SIGTERM stop the server: it translates the queued requests,
+ * answers them and logs the throughput and the latency percentiles.
+ */
+template <class Search>
+class TranslationServer : public TranslateMultiGPU<Search> {
+  private:
+    typedef TranslateMultiGPU<Search> Base;
+    typedef server::Clock Clock;
+
+    struct Connection {
+      int fd;
+      std::string input;
+      bool eof{false};
+
+      // answers are written in request order, later ones wait in pending
+      std::mutex mutex;
+      size_t requests{0};
+      size_t answered{0};
+      std::map<size_t, std::string> pending;
+      bool broken{false};
+    };
+
+    struct Request {
+      Ptr<Connection> connection;
+      size_t index;
+      Words words;
+      Clock::time_point arrival;
+    };
+
+    std::string path_;
+    size_t miniBatch_;
+    size_t batchWords_;
+    std::chrono::milliseconds maxWait_;
+    size_t maxLength_;
+
+    std::map<int, Ptr<Connection>> connections_;
+    std::deque<Request> queue_;
+    size_t queueWords_{0};
+
+    // workers write to the pipe when a batch is done to wake up poll()
+    int wakeup_[2];
+    std::atomic<size_t> busy_{0};
+
+    std::mutex statsMutex_;
+    std::vector<float> latencies_;
+    size_t received_{0};
+    size_t batches_{0};
+    Clock::time_point first_, last_;
+
+    int listen() {
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      UTIL_THROW_IF2(fd == -1, "Cannot create socket: " << std::strerror(errno));
+
+      sockaddr_un addr;
+      std::memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      UTIL_THROW_IF2(path_.size() >= sizeof(addr.sun_path),
+                     "Socket path " << path_ << " is too long");
+      std::strcpy(addr.sun_path, path_.c_str());
+
+      unlink(path_.c_str());
+      UTIL_THROW_IF2(bind(fd, (sockaddr*)&addr, sizeof(addr)) == -1
+                     || ::listen(fd, SOMAXCONN) == -1,
+                     "Cannot listen on " << path_ << ": " << std::strerror(errno));
+      return fd;
+    }
+
+    void accept(int listenFd) {
+      int fd = ::accept(listenFd, nullptr, nullptr);
+      if(fd == -1)
+        return;
+      auto connection = New<Connection>();
+      connection->fd = fd;
+      connections_[fd] = connection;
+    }
+
+    /** Reads what is available and queues the complete lines */
+    void read(Ptr<Connection> connection) {
+      char buffer[65536];
+      ssize_t bytes = ::read(connection->fd, buffer, sizeof(buffer));
+      if(bytes <= 0) {
+        if(bytes == 0 || errno != EINTR)
+          connection->eof = true;
+        return;
+      }
+      connection->input.append(buffer, bytes);
+
+      auto& vocab = *this->corpus_->getVocabs().front();
+      size_t begin = 0, end;
+      while((end = connection->input.find('\n', begin)) != std::string::npos) {
+        Request request;
+        request.connection = connection;
+        request.words = vocab(connection->input.substr(begin, end - begin));
+        request.arrival = Clock::now();
+        begin = end + 1;
+
+        // every request is answered, long ones are cut at max-length
+        if(request.words.size() > maxLength_) {
+          request.words.resize(maxLength_);
+          request.words.back() = 0;
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(connection->mutex);
+          request.index = connection->requests++;
+        }
+        if(received_++ == 0)
+          first_ = request.arrival;
+        queueWords_ += request.words.size();
+        queue_.push_back(std::move(request));
+      }
+      connection->input.erase(0, begin);
+    }
+
+    void answer(const Request& request, const std::string& translation) {
+      auto connection = request.connection;
+      {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->pending[request.index] = translation + "\n";
+        while(!connection->pending.empty()
+              && connection->pending.begin()->first == connection->answered) {
+          const std::string& out = connection->pending.begin()->second;
+          for(size_t sent = 0; sent < out.size() && !connection->broken;) {
+            ssize_t bytes = send(connection->fd, out.data() + sent,
+                                 out.size() - sent, MSG_NOSIGNAL);
+            if(bytes > 0)
+              sent += bytes;
+            else if(errno != EINTR)
+              connection->broken = true;
+          }
+          connection->pending.erase(connection->pending.begin());
+          connection->answered++;
+        }
+      }
+
+      auto now = Clock::now();
+      std::lock_guard<std::mutex> lock(statsMutex_);
+      latencies_.push_back(
+          std::chrono::duration<float, std::milli>(now - request.arrival).count());
+      last_ = now;
+    }
+
+    /** Whether a batch should be cut from the queue now */
+    bool ready(size_t devices, bool flush) {
+      if(queue_.empty() || busy_ >= devices)
+        return false;
+      return flush || queue_.size() >= miniBatch_
+             || (batchWords_ && queueWords_ >= batchWords_)
+             || Clock::now() - queue_.front().arrival >= maxWait_;
+    }
+
+    void enqueue(ThreadPool& threadPool) {
+      auto requests = New<std::vector<Request>>();
+      std::vector<data::SentenceTuple> sentences;
+      size_t words = 0;
+      while(!queue_.empty() && requests->size() < miniBatch_) {
+        size_t length = queue_.front().words.size();
+        if(!requests->empty() && batchWords_ && words + length > batchWords_)
+          break;
+        words += length;
+        queueWords_ -= length;
+
+        // the line number of a sentence is its position in the batch
+        data::SentenceTuple sentence(requests->size());
+        sentence.push_back(queue_.front().words);
+        sentences.push_back(sentence);
+
+        requests->push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+      auto batch = this->corpus_->toBatch(sentences);
+
+      busy_++;
+      {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        batches_++;
+      }
+
+      size_t devices = this->graphs_.size();
+      auto task = [=](size_t id) {
+        thread_local int device = -1;
+
+        if(device < 0) {
+          device = id % devices;
+          cudaSetDevice(this->graphs_[device]->getDevice());
+        }
+
+        auto histories = this->translate(batch, device);
+
+        for(auto history : histories) {
+          std::stringstream ss;
+          Printer(this->options_, this->trgVocab_, history, ss);
+          answer((*requests)[history->GetLineNum()], ss.str());
+        }
+
+        busy_--;
+        char c = 0;
+        ssize_t written = write(wakeup_[1], &c, 1);
+        (void)written;
+      };
+
+      threadPool.enqueue(task, batches_);
+    }
+
+    /** Closes the connections that are done reading and have all answers */
+    void closeFinished() {
+      for(auto it = connections_.begin(); it != connections_.end();) {
+        auto connection = it->second;
+        bool done;
+        {
+          std::lock_guard<std::mutex> lock(connection->mutex);
+          done = connection->eof && connection->answered == connection->requests;
+        }
+        if(done) {
+          close(connection->fd);
+          it = connections_.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+
+    void report() {
+      std::lock_guard<std::mutex> lock(statsMutex_);
+      if(latencies_.empty()) {
+        LOG(info, "Server stopped, no requests");
+        return;
+      }
+
+      std::sort(latencies_.begin(), latencies_.end());
+      auto percentile = [this](double p) {
+        return latencies_[std::min(latencies_.size() - 1,
+                                   (size_t)(p * latencies_.size()))];
+      };
+      double seconds = std::chrono::duration<double>(last_ - first_).count();
+
+      LOG(info, "Served {} requests in {} batches, {:.1f} sentences/s, "
+          "latency p50 {:.1f} ms, p99 {:.1f} ms",
+          latencies_.size(), batches_, latencies_.size() / std::max(seconds, 1e-3),
+          percentile(0.5), percentile(0.99));
+      this->logSearch();
+      if(this->encoderCache_)
+        this->logEncoderCache();
+    }
+
+  public:
+    TranslationServer(Ptr<Config> options)
+    : Base(options),
+      path_(options->get<std::string>("server")),
+      miniBatch_(options->get<int>("mini-batch")),
+      batchWords_(options->get<size_t>("server-batch-words")),
+      maxWait_(options->get<size_t>("server-max-wait")),
+      maxLength_(options->get<size_t>("max-length")) {
+
+      UTIL_THROW_IF2(options->get<bool>("n-best"),
+                     "--n-best cannot be used with --server");
+      UTIL_THROW_IF2(this->corpus_->getVocabs().size() != 1,
+                     "--server translates from one source only");
+    }
+
+    void run() {
+      size_t devices = this->graphs_.size();
+
+      UTIL_THROW_IF2(pipe(wakeup_) == -1,
+                     "Cannot create pipe: " << std::strerror(errno));
+      fcntl(wakeup_[0], F_SETFL, O_NONBLOCK);
+
+      int listenFd = listen();
+      std::signal(SIGINT, server::onSignal);
+      std::signal(SIGTERM, server::onSignal);
+      LOG(info, "Serving translations on {}", path_);
+
+      {
+        ThreadPool threadPool(devices, devices);
+
+        // after a stop signal, only the queued requests are translated
+        while(!server::stop || !queue_.empty() || busy_ > 0) {
+          std::vector<pollfd> fds{{wakeup_[0], POLLIN, 0}};
+          if(!server::stop) {
+            fds.push_back({listenFd, POLLIN, 0});
+            for(auto& it : connections_)
+              if(!it.second->eof)
+                fds.push_back({it.first, POLLIN, 0});
+          }
+
+          int timeout = 100;
+          if(!queue_.empty() && busy_ < devices) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                queue_.front().arrival + maxWait_ - Clock::now());
+            timeout = std::max<int>(0, std::min<int>(timeout, wait.count() + 1));
+          }
+
+          if(poll(fds.data(), fds.size(), timeout) > 0) {
+            for(auto& p : fds) {
+              if(!(p.revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+              if(p.fd == wakeup_[0]) {
+                char buffer[256];
+                while(::read(wakeup_[0], buffer, sizeof(buffer)) > 0);
+              }
+              else if(p.fd == listenFd) {
+                accept(listenFd);
+              }
+              else {
+                read(connections_[p.fd]);
+              }
+            }
+          }
+
+          while(ready(devices, server::stop))
+            enqueue(threadPool);
+
+          closeFinished();
+        }
+      }
+
+      for(auto& it : connections_)
+        close(it.first);
+      close(listenFd);
+      close(wakeup_[0]);
+      close(wakeup_[1]);
+      unlink(path_.c_str());
+
+      report();
+    }
+};
+
+}
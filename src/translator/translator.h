@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <numeric>
+
 #include "data/batch_generator.h"
 #include "data/corpus.h"
 
@@ -15,14 +18,57 @@ namespace marian {
 
 template <class Search>
 class TranslateMultiGPU : public ModelTask {
-  private:
+  protected:
     Ptr<Config> options_;
     std::vector<Ptr<ExpressionGraph>> graphs_;
     std::vector<std::vector<Ptr<Scorer>>> scorers_;
     
     Ptr<data::Corpus> corpus_;
     Ptr<Vocab> trgVocab_;
+    Ptr<Filter> shortlist_;
+    Ptr<EncoderCache> encoderCache_;
     //Ptr<LexProbs> lexProbs_;
+
+    // decoding steps and the reasons sentences stopped
+    std::atomic<size_t> searched_{0};
+    std::atomic<size_t> steps_{0};
+    std::atomic<size_t> boundStops_{0};
+    std::atomic<size_t> lengthStops_{0};
+
+    void logEncoderCache() {
+      size_t lookups = encoderCache_->hits() + encoderCache_->misses();
+      LOG(info, "Encoder cache: {} hits of {} sentences ({:.1f}%), {:.1f} MB",
+          encoderCache_->hits(), lookups,
+          lookups ? 100.0 * encoderCache_->hits() / lookups : 0.0,
+          encoderCache_->bytes() / (1024.0 * 1024.0));
+    }
+
+    /** Translates a batch with the graph and scorers of device i */
+    Histories translate(Ptr<data::CorpusBatch> batch, size_t i) {
+      Ptr<FilterInfo> shortlist;
+      if(shortlist_)
+        shortlist = shortlist_->createInfo(batch->front());
+
+      auto search = New<Search>(options_, scorers_[i]);
+      auto histories = search->search(graphs_[i], batch, shortlist);
+
+      for(auto history : histories) {
+        searched_++;
+        steps_ += history->size() - 1;
+        if(history->GetStop() == History::Bound)
+          boundStops_++;
+        else if(history->GetStop() == History::MaxLength)
+          lengthStops_++;
+      }
+      return histories;
+    }
+
+    void logSearch() {
+      LOG(info, "Search: {:.1f} steps per sentence, {} sentences stopped early, "
+          "{} at the maximum length",
+          searched_ ? (double)steps_ / searched_ : 0.0,
+          (size_t)boundStops_, (size_t)lengthStops_);
+    }
     
   public:  
     TranslateMultiGPU(Ptr<Config> options)
@@ -37,58 +83,99 @@ class TranslateMultiGPU : public ModelTask {
       //  lexProbs_ = New<LexProbs>(options_,
       //                       corpus_->getVocabs().front(),
       //                       trgVocab_);
+
+      if(options_->has("shortlist"))
+        shortlist_ = New<Filter>(options_,
+                                 corpus_->getVocabs().front(),
+                                 trgVocab_);
+
+      if(options_->get<size_t>("encoder-cache"))
+        encoderCache_ = New<EncoderCache>(options_->get<size_t>("encoder-cache") * 1024 * 1024);
         
       auto devices = options_->get<std::vector<int>>("devices");
       for(auto& device : devices) {
         auto graph = New<ExpressionGraph>(true);
         graph->setDevice(device);
         graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
+        if(options_->has("profile"))
+          graph->setProfiler(options_->get<std::string>("profile"));
         graphs_.push_back(graph);
         
         auto scorers = createScorers(options);    
-        for(auto scorer : scorers)
+        for(auto scorer : scorers) {
           scorer->init(graph);
+          if(encoderCache_)
+            scorer->setEncoderCache(encoderCache_);
+        }
         scorers_.push_back(scorers);
       }
       
     }
     
+    /**
+     * Translates the input in batches. The batch generator reads
+     * maxi-batch * mini-batch lines at a time and groups them by source
+     * length; the collector writes the translations in input order. At most
+     * one batch per device waits in the queue, so memory is bounded by the
+     * window and the translations of lines that precede it.
+     */
     void run() {
       
       data::BatchGenerator<data::Corpus> bg(corpus_, options_);
       
       auto devices = options_->get<std::vector<int>>("devices");
-      ThreadPool threadPool(devices.size(), devices.size());
-      
       auto collector = New<OutputCollector>();
-      size_t sentenceId = 0;
+      size_t batchId = 0;
+
+      // words and padded positions of the source batches
+      size_t sentences = 0;
+      double words = 0, positions = 0;
+      boost::timer::cpu_timer timer;
       
-      bg.prepare(false);
-      while(bg) {
-        auto batch = bg.next();
+      // the pool joins the workers when it goes out of scope
+      {
+        ThreadPool threadPool(devices.size(), devices.size());
+
+        bg.prepare(false);
+        while(bg) {
+          auto batch = bg.next();
+
+          auto& mask = batch->front()->mask();
+          sentences += batch->size();
+          words += std::accumulate(mask.begin(), mask.end(), 0.0);
+          positions += mask.size();
         
-        auto task = [=](size_t id) {
-          thread_local Ptr<ExpressionGraph> graph;
-          thread_local std::vector<Ptr<Scorer>> scorers;
+          auto task = [=](size_t id) {
+            thread_local int device = -1;
           
-          if(!graph) {
-            graph = graphs_[id % devices.size()];
-            cudaSetDevice(graph->getDevice());
-            scorers = scorers_[id % devices.size()];
-          }
+            if(device < 0) {
+              device = id % devices.size();
+              cudaSetDevice(graphs_[device]->getDevice());
+            }
           
-          auto search = New<Search>(options_, scorers);
-          auto history = search->search(graph, batch, id);
-      
-          std::stringstream ss;
-          Printer(options_, trgVocab_, history, ss);
-          collector->Write(history->GetLineNum(), ss.str());
-        };
+            auto histories = translate(batch, device);
+
+            for(auto history : histories) {
+              std::stringstream ss;
+              Printer(options_, trgVocab_, history, ss);
+              collector->Write(history->GetLineNum(), ss.str());
+            }
+          };
         
-        threadPool.enqueue(task, sentenceId);
+          threadPool.enqueue(task, batchId);
         
-        sentenceId++;
+          batchId++;
+        }
       }
+
+      double seconds = std::stod(timer.format(5, "%w"));
+      LOG(info, "Translated {} sentences in {} batches, {:.1f} sentences/s, "
+          "source mask density {:.1f}%",
+          sentences, batchId, sentences / std::max(seconds, 1e-3),
+          positions > 0 ? 100 * words / positions : 100.0);
+      logSearch();
+      if(encoderCache_)
+        logEncoderCache();
     }
 };
 